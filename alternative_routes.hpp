@@ -0,0 +1,362 @@
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "geometry.hpp"
+#include "map_graph.hpp"
+#include "path_search.hpp"
+
+/**
+ * Most paths find_alternative_routes() searches for in one query, one bit
+ * of a node's corridor_bits each
+ */
+const size_t MAX_PATHS_SEARCHED = 64;
+
+/**
+ * Penalized searches allowed per route wanted, before giving up on finding more
+ */
+const size_t SEARCHES_PER_ROUTE = 3;
+
+/**
+ * How close a node must be to a path, in pixels, to count as in the same
+ * hallway; nodes along one hallway are rarely in one exact line
+ */
+const double ROUTE_CORRIDOR_WIDTH = 20;
+
+/**
+ * Factor on an edge's weight for every path found so far whose hallway it runs along
+ */
+const double ROUTE_PENALTY = 1.4;
+
+/**
+ * How much longer than the shortest route an alternative may be
+ */
+const double MAX_ROUTE_STRETCH = 1.5;
+
+/**
+ * Share of an alternative's length that may run along the hallway of any one route already taken
+ */
+const double MAX_SHARED_FRACTION = 0.6;
+
+/**
+ * One of several routes between the same two nodes
+ */
+struct Route
+{
+    std::vector<NodeId> path; // from the start to the end
+    double length = 0;
+};
+
+/**
+ * Search data for find_alternative_routes(), kept between its searches
+ * and reused by the next query
+ * Which paths a node is near is only worked out for the nodes the
+ * penalized searches reach, and only against the paths found since the
+ * node was last checked
+ */
+struct AlternativeSearch
+{
+    SearchState to_end; // distance from every node to the end node, settled once per query
+    SearchState penalized; // search with the edges along paths found so far made longer
+    std::vector<Route> paths; // every path found this query, taken or not
+    std::vector<sf::FloatRect> path_bounds; // of each path, grown by ROUTE_CORRIDOR_WIDTH
+    std::vector<size_t> taken; // index in paths of each route taken
+    std::vector<uint64_t> corridor_bits; // per node, bit i set if the node is near paths[i]
+    std::vector<uint8_t> paths_checked; // per node, paths checked for corridor_bits so far
+    std::vector<uint32_t> checked_round; // per node, query the other two were written in
+    uint32_t round = 0;
+    uint32_t nodes_expanded = 0; // by every search of the last query
+
+    /**
+     * Forgets the paths of the last query
+     * @param num_nodes number of node ids in the query to come
+     */
+    void reset(size_t num_nodes)
+    {
+        if (corridor_bits.size() < num_nodes)
+        {
+            corridor_bits.assign(num_nodes, 0);
+            paths_checked.assign(num_nodes, 0);
+            checked_round.assign(num_nodes, 0);
+            round = 0;
+        }
+
+        // Rounds Wrapped Around, Old Marks Would Look Current
+        if (++round == 0)
+        {
+            std::fill(checked_round.begin(), checked_round.end(), 0);
+            round = 1;
+        }
+        paths.clear();
+        path_bounds.clear();
+        taken.clear();
+        nodes_expanded = 0;
+    }
+
+    /**
+     * Records a path found, with its bounds for quick corridor checks
+     * @param graph
+     * @param route
+     */
+    void add_path(const MapGraph& graph, Route route)
+    {
+        float min_x = graph.x[route.path[0]], max_x = min_x;
+        float min_y = graph.y[route.path[0]], max_y = min_y;
+        for (NodeId node : route.path)
+        {
+            min_x = std::min(min_x, graph.x[node]);
+            max_x = std::max(max_x, graph.x[node]);
+            min_y = std::min(min_y, graph.y[node]);
+            max_y = std::max(max_y, graph.y[node]);
+        }
+        float width = (float) ROUTE_CORRIDOR_WIDTH;
+        path_bounds.push_back(sf::FloatRect(min_x - width, min_y - width, max_x - min_x + 2 * width, max_y - min_y + 2 * width));
+        paths.push_back(std::move(route));
+    }
+
+    /**
+     * @param graph
+     * @param path_index
+     * @param point
+     * @return boolean whether the point is within ROUTE_CORRIDOR_WIDTH of paths[path_index]
+     */
+    bool is_near_path(const MapGraph& graph, size_t path_index, sf::Vector2<double> point) const
+    {
+        if (!path_bounds[path_index].contains((float) point.x, (float) point.y))
+        {
+            return false;
+        }
+        const std::vector<NodeId>& path = paths[path_index].path;
+        for (size_t i = 1; i < path.size(); i++)
+        {
+            sf::Vector2<double> a(graph.x[path[i - 1]], graph.y[path[i - 1]]);
+            sf::Vector2<double> b(graph.x[path[i]], graph.y[path[i]]);
+            if (distance_to_segment(point, a, b) <= ROUTE_CORRIDOR_WIDTH)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @param graph
+     * @param node
+     * @return bit i set if the node is within ROUTE_CORRIDOR_WIDTH of paths[i]
+     */
+    uint64_t corridors(const MapGraph& graph, NodeId node)
+    {
+        if (checked_round[node] != round)
+        {
+            corridor_bits[node] = 0;
+            paths_checked[node] = 0;
+            checked_round[node] = round;
+        }
+        for (size_t i = paths_checked[node]; i < paths.size(); i++)
+        {
+            if (is_near_path(graph, i, sf::Vector2<double>(graph.x[node], graph.y[node])))
+            {
+                corridor_bits[node] |= (uint64_t) 1 << i;
+            }
+        }
+        paths_checked[node] = (uint8_t) paths.size();
+        return corridor_bits[node];
+    }
+
+    /**
+     * Measures how much of an edge runs near a path, in pieces half the
+     * corridor width long, so long edges are judged along their whole length
+     * @param graph
+     * @param path_index
+     * @param from
+     * @param to
+     * @return length of the edge near paths[path_index]
+     */
+    double length_near_path(const MapGraph& graph, size_t path_index, NodeId from, NodeId to) const
+    {
+        double length = node_distance(graph, from, to);
+        size_t num_pieces = std::max<size_t>(1, (size_t) std::ceil(2 * length / ROUTE_CORRIDOR_WIDTH));
+        size_t pieces_near = 0;
+        for (size_t i = 0; i < num_pieces; i++)
+        {
+            double t = (i + 0.5) / num_pieces;
+            sf::Vector2<double> point(graph.x[from] + t * (graph.x[to] - graph.x[from]), graph.y[from] + t * (graph.y[to] - graph.y[from]));
+            pieces_near += is_near_path(graph, path_index, point);
+        }
+        return length * pieces_near / num_pieces;
+    }
+};
+
+/**
+ * Uses A* to find the shortest path once every edge running along a path
+ * found so far (both of its ends near that path) is made longer
+ * Penalties only ever lengthen edges, so the unpenalized distances to the
+ * end node never overestimate and serve as the estimate; the search
+ * mostly settles just the nodes of the path it finds
+ * Helper function for find_alternative_routes()
+ * @param graph
+ * @param search holds the distances to the end and the paths found so far
+ * @param start_node
+ * @param end_node
+ */
+inline void find_penalized_path(const MapGraph& graph, AlternativeSearch& search, NodeId start_node, NodeId end_node)
+{
+    SearchState& state = search.penalized;
+    const SearchState& to_end = search.to_end;
+    state.reset(graph.node_count());
+    SearchQueue& queue = state.queue;
+
+    state.set(start_node, 0, NO_NODE);
+    queue.push(QueueEntry(to_end.get_cost(start_node), start_node));
+    state.heap_pushes++;
+
+    // Loop Until End Node is Settled or No Reachable Nodes Remain
+    while (!queue.empty())
+    {
+        NodeId current_node = queue.top().second;
+        queue.pop();
+        state.heap_pops++;
+        if (state.is_visited(current_node))
+        {
+            continue;
+        }
+        state.visit(current_node);
+        state.nodes_expanded++;
+
+        if (current_node == end_node)
+        {
+            break;
+        }
+
+        // Update Paths to Unvisited Neighbors That Can Reach the End
+        double current_cost = state.cost[current_node];
+        uint64_t current_corridors = search.corridors(graph, current_node);
+        for (uint32_t edge = graph.offsets[current_node]; edge < graph.offsets[current_node + 1]; edge++)
+        {
+            NodeId neighbor = graph.targets[edge];
+            if (state.is_visited(neighbor) || !to_end.is_visited(neighbor))
+            {
+                continue;
+            }
+
+            size_t times = std::bitset<64>(current_corridors & search.corridors(graph, neighbor)).count();
+            double weight = times == 0 ? graph.weights[edge] : graph.weights[edge] * std::pow(ROUTE_PENALTY, (double) times);
+            double distance_through = current_cost + weight;
+            if (distance_through < state.get_cost(neighbor))
+            {
+                state.set(neighbor, distance_through, current_node);
+                queue.push(QueueEntry(distance_through + to_end.cost[neighbor], neighbor));
+                state.edges_relaxed++;
+                state.heap_pushes++;
+            }
+        }
+    }
+    search.nodes_expanded += state.nodes_expanded;
+    profile_search(state);
+}
+
+/**
+ * Finds the shortest route between two nodes and alternatives that differ from it
+ * Alternatives come from the penalty method: after every path found, the
+ * edges along its hallway are made longer and the search runs again, so
+ * the next path is pushed into other hallways. A path is taken if it is
+ * at most MAX_ROUTE_STRETCH times the shortest route's length and at most
+ * MAX_SHARED_FRACTION of it runs along any one route taken before. Plain
+ * k shortest paths are no use on a visibility graph, where the next
+ * shortest ones mostly take the same hallway through a node more or less
+ * One search from the end node gives every node's exact distance to the
+ * end, which guides every penalized search straight there. Edges are
+ * assumed to go both ways, as visibility edges do, so that search runs on
+ * the graph as it is
+ * @param graph
+ * @param search search data, reused between queries
+ * @param state holds the shortest route, as find_path() leaves it
+ * @param start_node
+ * @param end_node
+ * @param num_routes most routes to find, counting the shortest one
+ * @param routes gets the shortest route and then the alternatives, shortest first;
+ *        empty if there is no route at all
+ */
+inline void find_alternative_routes(
+    const MapGraph& graph,
+    AlternativeSearch& search,
+    const SearchState& state,
+    NodeId start_node,
+    NodeId end_node,
+    size_t num_routes,
+    std::vector<Route>& routes
+)
+{
+    routes.clear();
+    search.reset(graph.node_count());
+    if (!state.is_visited(end_node))
+    {
+        return;
+    }
+
+    // The Shortest Route is the One Already Found
+    Route shortest;
+    for (NodeId node = end_node; node != NO_NODE; node = state.get_previous(node))
+    {
+        shortest.path.push_back(node);
+    }
+    std::reverse(shortest.path.begin(), shortest.path.end());
+    shortest.length = state.get_cost(end_node);
+    routes.push_back(shortest);
+    if (num_routes <= 1 || start_node == end_node)
+    {
+        return;
+    }
+    search.add_path(graph, std::move(shortest));
+    search.taken.push_back(0);
+
+    // Distances to the End, Shared by Every Penalized Search
+    find_path_dijkstra(graph, search.to_end, end_node, NO_NODE);
+    search.nodes_expanded += search.to_end.nodes_expanded;
+
+    size_t max_searches = std::min(num_routes * SEARCHES_PER_ROUTE, MAX_PATHS_SEARCHED - 1);
+    for (size_t searches = 0; searches < max_searches && routes.size() < num_routes; searches++)
+    {
+        find_penalized_path(graph, search, start_node, end_node);
+        Route candidate;
+        for (NodeId node = end_node; node != NO_NODE; node = search.penalized.get_previous(node))
+        {
+            candidate.path.push_back(node);
+        }
+        std::reverse(candidate.path.begin(), candidate.path.end());
+
+        // Add Up Its Unpenalized Length Front to Back, as set_path() Does,
+        // Along With How Much of It Runs Along Each Route Taken
+        std::vector<double> shared(search.taken.size(), 0);
+        for (size_t i = 1; i < candidate.path.size(); i++)
+        {
+            candidate.length += edge_weight(graph, candidate.path[i - 1], candidate.path[i]);
+            for (size_t route = 0; route < search.taken.size(); route++)
+            {
+                shared[route] += search.length_near_path(graph, search.taken[route], candidate.path[i - 1], candidate.path[i]);
+            }
+        }
+
+        // Take It if It is Short Enough and Different Enough
+        bool different = true;
+        for (double shared_length : shared)
+        {
+            different = different && shared_length <= MAX_SHARED_FRACTION * candidate.length;
+        }
+        if (candidate.length <= MAX_ROUTE_STRETCH * routes[0].length && different)
+        {
+            search.taken.push_back(search.paths.size());
+            routes.push_back(candidate);
+        }
+        search.add_path(graph, std::move(candidate));
+    }
+
+    // Alternatives Shortest First
+    std::sort(routes.begin() + 1, routes.end(), [](const Route& a, const Route& b) {
+        return a.length < b.length;
+    });
+}
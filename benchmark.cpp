@@ -0,0 +1,430 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "geometry.hpp"
+#include "graph_reduction.hpp"
+#include "map_generator.hpp"
+#include "map_graph.hpp"
+#include "map_image.hpp"
+#include "map_text.hpp"
+#include "path_search.hpp"
+#include "route_batch.hpp"
+#include "route_table.hpp"
+#include "visibility_graph.hpp"
+#include "wall_index.hpp"
+
+using namespace std;
+
+/**
+ * Version of the report format, bumped whenever its columns change
+ */
+const int BENCHMARK_FORMAT_VERSION = 3;
+
+/**
+ * Column names of the report, tab separated
+ */
+const char BENCHMARK_COLUMNS[] = "layout\tsize\tnodes\twalls\tedges\tgraph_checksum\tparse_ms\tbuild_ms\tquery_us\tbatch_qps\tparse_mbps\timage_mpps";
+
+/**
+ * Times of parsing are the best of this many runs, since a parse is short
+ */
+const int PARSE_RUNS = 3;
+
+/**
+ * Measurements of one generated map
+ */
+struct BenchmarkRow
+{
+    string layout;
+    size_t size = 0; // node count asked for
+    size_t nodes = 0; // node count generated
+    size_t walls = 0;
+    size_t edges = 0; // undirected
+    uint64_t graph_checksum = 0;
+    double parse_ms = 0;
+    double build_ms = 0; // wall index, visibility graph and reduction
+    double query_us = 0; // mean latency of one query on one thread
+    double batch_qps = 0; // queries per second over all threads
+    double parse_mbps = 0; // megabytes of map text parsed per second
+    double image_mpps = 0; // megapixels of map image compiled per second
+};
+
+typedef chrono::steady_clock Clock;
+
+/**
+ * @param start
+ * @return seconds since start
+ */
+double seconds_since(Clock::time_point start)
+{
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Splits a comma separated list
+ * @param list
+ * @return items
+ */
+vector<string> split_list(const string& list)
+{
+    vector<string> items;
+    istringstream stream(list);
+    string item;
+    while (getline(stream, item, ','))
+    {
+        items.push_back(item);
+    }
+    return items;
+}
+
+/**
+ * Draws a map as a map image would have it: walls as 3 pixel wide green
+ * lines and nodes as red (named) or blue pixels on white
+ * @param walls
+ * @param graph
+ * @param width set to the image width
+ * @param height set to the image height
+ * @return RGBA pixels
+ */
+vector<uint8_t> draw_map_image(const vector<Wall>& walls, const MapGraphStorage& graph, uint32_t& width, uint32_t& height)
+{
+    float max_x = 0, max_y = 0;
+    for (const Wall& wall : walls)
+    {
+        max_x = max({max_x, wall.a.x, wall.b.x});
+        max_y = max({max_y, wall.a.y, wall.b.y});
+    }
+    MapGraph view = graph.view();
+    for (NodeId node = 0; node < view.node_count(); node++)
+    {
+        max_x = max(max_x, view.x[node]);
+        max_y = max(max_y, view.y[node]);
+    }
+    width = (uint32_t) max_x + 3;
+    height = (uint32_t) max_y + 3;
+    vector<uint8_t> pixels((size_t) width * height * 4, 255);
+    auto paint = [&](long x, long y, uint8_t r, uint8_t g, uint8_t b) {
+        if (x >= 0 && y >= 0 && x < width && y < height)
+        {
+            uint8_t* pixel = &pixels[((size_t) y * width + x) * 4];
+            pixel[0] = r;
+            pixel[1] = g;
+            pixel[2] = b;
+        }
+    };
+    for (const Wall& wall : walls)
+    {
+        int steps = (int) max(abs(wall.b.x - wall.a.x), abs(wall.b.y - wall.a.y)) + 1;
+        for (int step = 0; step <= steps; step++)
+        {
+            long x = lround(wall.a.x + (wall.b.x - wall.a.x) * step / steps);
+            long y = lround(wall.a.y + (wall.b.y - wall.a.y) * step / steps);
+            for (long dy = -1; dy <= 1; dy++)
+            {
+                for (long dx = -1; dx <= 1; dx++)
+                {
+                    paint(x + dx, y + dy, 0, 255, 0);
+                }
+            }
+        }
+    }
+    for (NodeId node = 0; node < view.node_count(); node++)
+    {
+        bool named = view.is_named(node);
+        paint(lround(view.x[node]), lround(view.y[node]), named ? 255 : 0, 0, named ? 0 : 255);
+    }
+    return pixels;
+}
+
+/**
+ * Generates, parses, builds and queries one map
+ * @param settings map to generate
+ * @param num_queries queries between random named nodes
+ * @param strategy search algorithm
+ * @param num_threads worker threads for building and batch queries
+ * @param reduce whether to reduce the graph after building it
+ * @param parse_only whether to stop after parsing, for maps too big to build
+ * @return measurements
+ */
+BenchmarkRow run_benchmark(const MapGeneratorSettings& settings, size_t num_queries, SearchStrategy strategy, unsigned num_threads, bool reduce, bool parse_only)
+{
+    BenchmarkRow row;
+    row.layout = map_layout_name(settings.layout);
+    row.size = settings.num_nodes;
+    string text = generate_map_text(settings);
+
+    // Parse
+    vector<Wall> walls;
+    vector<MapArea> areas;
+    MapGraphStorage storage;
+    NodeId start_node = NO_NODE, end_node = NO_NODE;
+    vector<MapTextError> errors;
+    row.parse_ms = 1e300;
+    for (int run = 0; run < PARSE_RUNS; run++)
+    {
+        walls.clear();
+        areas.clear();
+        storage = MapGraphStorage();
+        errors.clear();
+        istringstream map_text(text);
+        Clock::time_point parse_start = Clock::now();
+        read_map_text(map_text, walls, areas, storage, start_node, end_node, errors);
+        row.parse_ms = min(row.parse_ms, seconds_since(parse_start) * 1e3);
+    }
+    row.parse_mbps = text.size() / (row.parse_ms * 1e3);
+    row.nodes = storage.node_count();
+    row.walls = walls.size();
+    if (parse_only)
+    {
+        return row;
+    }
+
+    // Compile the Map Drawn as an Image
+    uint32_t image_width, image_height;
+    vector<uint8_t> pixels = draw_map_image(walls, storage, image_width, image_height);
+    CompiledMapImage compiled;
+    Clock::time_point image_start = Clock::now();
+    compile_map_image(pixels.data(), image_width, image_height, DEFAULT_OUTLINE_TOLERANCE, num_threads, compiled);
+    row.image_mpps = (double) image_width * image_height / (seconds_since(image_start) * 1e6);
+
+    // Build
+    Clock::time_point build_start = Clock::now();
+    WallGrid wall_index;
+    wall_index.build(walls);
+    build_visibility_graph(storage, wall_index, num_threads);
+    if (reduce)
+    {
+        reduce_visibility_graph(storage, start_node, end_node, num_threads);
+    }
+    row.build_ms = seconds_since(build_start) * 1e3;
+    MapGraph graph = storage.view();
+    row.nodes = graph.node_count();
+    row.edges = graph.edge_count() / 2;
+    row.graph_checksum = checksum_graph(graph);
+
+    // Pick Queries Between Named Nodes
+    vector<NodeId> named_nodes;
+    for (NodeId node = 0; node < graph.node_count(); node++)
+    {
+        if (graph.is_named(node))
+        {
+            named_nodes.push_back(node);
+        }
+    }
+    vector<RouteQuery> queries;
+    mt19937_64 random(settings.seed);
+    for (size_t i = 0; i < num_queries && named_nodes.size() >= 2; i++)
+    {
+        queries.push_back({named_nodes[random() % named_nodes.size()], named_nodes[random() % named_nodes.size()]});
+    }
+    if (queries.empty())
+    {
+        return row;
+    }
+
+    // Single Queries
+    SearchState state, backward_state;
+    Clock::time_point query_start = Clock::now();
+    for (const RouteQuery& query : queries)
+    {
+        find_path(graph, strategy, state, backward_state, query.start_node, query.end_node);
+    }
+    row.query_us = seconds_since(query_start) * 1e6 / queries.size();
+
+    // Batch Queries
+    RouteTable no_table;
+    ContractionHierarchy no_hierarchy;
+    BatchReport report;
+    run_route_batch(graph, no_table, no_hierarchy, queries, strategy, 1, num_threads, report);
+    row.batch_qps = report.throughput;
+    return row;
+}
+
+/**
+ * Writes one row of the report
+ * @param out
+ * @param row
+ */
+void write_row(ostream& out, const BenchmarkRow& row)
+{
+    char checksum[17];
+    snprintf(checksum, sizeof(checksum), "%016llx", (unsigned long long) row.graph_checksum);
+    char timings[160];
+    snprintf(timings, sizeof(timings), "%.3f\t%.3f\t%.3f\t%.0f\t%.1f\t%.1f", row.parse_ms, row.build_ms, row.query_us, row.batch_qps, row.parse_mbps, row.image_mpps);
+    out << row.layout << '\t' << row.size << '\t' << row.nodes << '\t' << row.walls << '\t'
+        << row.edges << '\t' << checksum << '\t' << timings << endl;
+}
+
+/**
+ * Reads the rows of an earlier report
+ * @param path
+ * @param rows filled with rows, keyed by layout and size
+ * @return boolean whether the file could be opened
+ */
+bool read_report(const string& path, map<pair<string, size_t>, BenchmarkRow>& rows)
+{
+    ifstream report(path);
+    if (!report.is_open())
+    {
+        return false;
+    }
+    string line;
+    while (getline(report, line))
+    {
+        if (line.empty() || line[0] == '#' || line.rfind("layout\t", 0) == 0)
+        {
+            continue;
+        }
+        istringstream fields(line);
+        BenchmarkRow row;
+        string checksum;
+        fields >> row.layout >> row.size >> row.nodes >> row.walls >> row.edges >> checksum
+               >> row.parse_ms >> row.build_ms >> row.query_us >> row.batch_qps
+               >> row.parse_mbps >> row.image_mpps; // format 1 has neither, format 2 no image_mpps
+        row.graph_checksum = stoull(checksum, nullptr, 16);
+        rows[{row.layout, row.size}] = row;
+    }
+    return true;
+}
+
+/**
+ * Compares a row with the same map in an earlier report
+ * Speedups above 1 mean the current build is faster
+ * @param out
+ * @param row
+ * @param baseline
+ */
+void write_comparison(ostream& out, const BenchmarkRow& row, const BenchmarkRow& baseline)
+{
+    auto speedup = [](double before, double after) { return after > 0 ? before / after : 0; };
+    char line[256];
+    snprintf(line, sizeof(line), "# vs baseline: %s %zu parse %.2fx build %.2fx query %.2fx batch %.2fx%s",
+             row.layout.c_str(), row.size,
+             speedup(baseline.parse_ms, row.parse_ms),
+             speedup(baseline.build_ms, row.build_ms),
+             speedup(baseline.query_us, row.query_us),
+             speedup(row.batch_qps, baseline.batch_qps),
+             row.graph_checksum != baseline.graph_checksum ? " (graph differs)" : "");
+    out << line << endl;
+}
+
+int main(int argc, char* argv[]) {
+    // Read Command Line Options
+    vector<string> layout_names = {"campus", "clutter", "corridors"};
+    vector<string> size_names = {"100", "1000", "10000"};
+    MapGeneratorSettings settings;
+    size_t num_queries = 1000;
+    unsigned num_threads = 0;
+    SearchStrategy strategy = SearchStrategy::Dijkstra;
+    string baseline_path;
+    bool reduce = false;
+    bool parse_only = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string option = argv[i];
+        if (option == "--layouts" && i + 1 < argc)
+        {
+            layout_names = split_list(argv[++i]);
+        }
+        else if (option == "--sizes" && i + 1 < argc)
+        {
+            size_names = split_list(argv[++i]);
+        }
+        else if (option == "--density" && i + 1 < argc)
+        {
+            settings.box_density = stod(argv[++i]);
+        }
+        else if (option == "--seed" && i + 1 < argc)
+        {
+            settings.seed = stoull(argv[++i]);
+        }
+        else if (option == "--queries" && i + 1 < argc)
+        {
+            num_queries = stoul(argv[++i]);
+        }
+        else if (option == "--threads" && i + 1 < argc)
+        {
+            num_threads = stoul(argv[++i]);
+        }
+        else if (option == "--reduce")
+        {
+            reduce = true;
+        }
+        else if (option == "--parse-only")
+        {
+            parse_only = true;
+        }
+        else if (option == "--baseline" && i + 1 < argc)
+        {
+            baseline_path = argv[++i];
+        }
+        else if (option == "--search" && i + 1 < argc && parse_search_strategy(argv[i + 1], strategy))
+        {
+            i++;
+        }
+        else
+        {
+            cout << "Usage: benchmark [--layouts campus,clutter,corridors] [--sizes 100,1000,10000] [--density 0.3] [--seed n] [--queries n] [--threads n] [--search dijkstra|astar|bidirectional] [--reduce] [--parse-only] [--baseline report.tsv]" << endl;
+            return 1;
+        }
+    }
+    vector<MapLayout> layouts;
+    for (const string& name : layout_names)
+    {
+        MapLayout layout;
+        if (!parse_map_layout(name, layout))
+        {
+            cout << "Unknown layout " << name << endl;
+            return 1;
+        }
+        layouts.push_back(layout);
+    }
+    map<pair<string, size_t>, BenchmarkRow> baseline;
+    if (!baseline_path.empty() && !read_report(baseline_path, baseline))
+    {
+        cout << "Unable to open baseline " << baseline_path << endl;
+        return 1;
+    }
+
+    // Report Header
+    cout << "# MissionMaps benchmark, format " << BENCHMARK_FORMAT_VERSION << endl;
+    cout << "# density " << settings.box_density << ", seed " << settings.seed
+         << ", queries " << num_queries << ", search " << search_strategy_name(strategy)
+         << (reduce ? ", reduced graph" : "") << (parse_only ? ", parse only" : "") << endl;
+    cout << BENCHMARK_COLUMNS << endl;
+
+    // Run Every Layout at Every Size
+    vector<string> comparisons;
+    for (MapLayout layout : layouts)
+    {
+        for (const string& size_name : size_names)
+        {
+            settings.layout = layout;
+            settings.num_nodes = stoul(size_name);
+            BenchmarkRow row = run_benchmark(settings, num_queries, strategy, num_threads, reduce, parse_only);
+            write_row(cout, row);
+
+            auto earlier = baseline.find({row.layout, row.size});
+            if (earlier != baseline.end())
+            {
+                ostringstream comparison;
+                write_comparison(comparison, row, earlier->second);
+                comparisons.push_back(comparison.str());
+            }
+        }
+    }
+
+    // Comparisons Go Last So the Table Stays Contiguous
+    for (const string& comparison : comparisons)
+    {
+        cout << comparison;
+    }
+    return 0;
+}
@@ -0,0 +1,409 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "map_graph.hpp"
+#include "path_search.hpp"
+#include "profiling.hpp"
+
+/**
+ * Most nodes a witness search may settle before giving up
+ * Giving up early only adds a shortcut that was not needed, never drops one
+ * that was, so this trades preprocessing time against hierarchy size
+ */
+const uint32_t WITNESS_SETTLE_LIMIT = 100;
+
+/**
+ * Contraction hierarchy over a graph, for answering queries with two small searches
+ * Nodes are contracted one at a time, least important first. Contracting a
+ * node removes it and links its remaining neighbors with a shortcut wherever
+ * the only shortest path between them ran through it. Each node keeps the
+ * edges (graph edges and shortcuts) to the nodes contracted after it, and a
+ * query only ever follows those upward edges from both ends
+ */
+struct ContractionHierarchy
+{
+    std::vector<uint32_t> rank; // position of each node in the contraction order
+
+    // Upward Edges (node i's are up_targets[up_offsets[i]] ... up_targets[up_offsets[i + 1] - 1],
+    // in increasing order of target)
+    std::vector<uint32_t> up_offsets;
+    std::vector<NodeId> up_targets;
+    std::vector<double> up_weights;
+    std::vector<NodeId> up_middles; // node a shortcut skips over, NO_NODE for graph edges
+    size_t num_shortcuts = 0;
+
+    bool empty() const
+    {
+        return up_offsets.empty();
+    }
+
+    size_t node_count() const
+    {
+        return rank.size();
+    }
+
+    void clear()
+    {
+        rank.clear();
+        up_offsets.clear();
+        up_targets.clear();
+        up_weights.clear();
+        up_middles.clear();
+        num_shortcuts = 0;
+    }
+
+    /**
+     * Finds the node a shortcut between two nodes skips over
+     * @param a
+     * @param b
+     * @return middle node, NO_NODE if the edge is a graph edge
+     */
+    NodeId middle_of(NodeId a, NodeId b) const
+    {
+        if (rank[a] > rank[b])
+        {
+            std::swap(a, b);
+        }
+        const NodeId* first = up_targets.data() + up_offsets[a];
+        const NodeId* last = up_targets.data() + up_offsets[a + 1];
+        return up_middles[std::lower_bound(first, last, b) - up_targets.data()];
+    }
+};
+
+/**
+ * Edge of the graph still being contracted
+ * Helper for build_contraction_hierarchy()
+ */
+struct HierarchyEdge
+{
+    NodeId target;
+    double weight;
+    NodeId middle; // NO_NODE for graph edges
+};
+
+/**
+ * Contracts every node of a graph
+ * Importance is the edge difference (shortcuts added minus edges removed)
+ * plus the number of neighbors already contracted plus the node's level
+ * (one more than the highest level below it), which spreads contraction
+ * evenly over the map and keeps the hierarchy shallow; it is recomputed
+ * lazily, when a node reaches the front of the queue
+ * @param hierarchy replaced by the new hierarchy
+ * @param graph
+ */
+inline void build_contraction_hierarchy(ContractionHierarchy& hierarchy, const MapGraph& graph)
+{
+    PROFILE_SCOPE(HierarchyBuild);
+    NodeId num_nodes = graph.node_count();
+    hierarchy.clear();
+    hierarchy.rank.assign(num_nodes, 0);
+
+    // Copy Edges Into Editable Lists
+    std::vector<std::vector<HierarchyEdge>> edges(num_nodes);
+    for (NodeId node = 0; node < num_nodes; node++)
+    {
+        for (uint32_t edge = graph.offsets[node]; edge < graph.offsets[node + 1]; edge++)
+        {
+            edges[node].push_back(HierarchyEdge{graph.targets[edge], graph.weights[edge], NO_NODE});
+        }
+    }
+
+    // Finds or Adds the Edge a-b, Keeping the Shorter Weight
+    auto add_shortcut = [&](NodeId a, NodeId b, double weight, NodeId middle) {
+        for (NodeId from : {a, b})
+        {
+            NodeId to = from == a ? b : a;
+            auto existing = std::find_if(edges[from].begin(), edges[from].end(), [&](const HierarchyEdge& edge) { return edge.target == to; });
+            if (existing == edges[from].end())
+            {
+                edges[from].push_back(HierarchyEdge{to, weight, middle});
+            }
+            else if (weight < existing->weight)
+            {
+                *existing = HierarchyEdge{to, weight, middle};
+            }
+        }
+    };
+
+    // Counts (or Adds) the Shortcuts Contracting a Node Needs
+    SearchState witness;
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> witness_queue;
+    std::vector<uint8_t> contracted(num_nodes, 0);
+    auto contract = [&](NodeId node, bool add) {
+        const std::vector<HierarchyEdge> neighbors = edges[node];
+        int num_shortcuts = 0;
+        for (size_t i = 0; i + 1 < neighbors.size(); i++)
+        {
+            // Longest Path Through the Node a Witness Must Beat
+            double max_cost = 0;
+            for (size_t j = i + 1; j < neighbors.size(); j++)
+            {
+                max_cost = std::max(max_cost, neighbors[i].weight + neighbors[j].weight);
+            }
+
+            // Witness Search Around the Node, Limited in Cost and Size
+            NodeId source = neighbors[i].target;
+            witness.reset(num_nodes);
+            witness_queue = {};
+            witness.set(source, 0, NO_NODE);
+            witness_queue.push(QueueEntry(0, source));
+            uint32_t num_settled = 0;
+            while (!witness_queue.empty() && num_settled < WITNESS_SETTLE_LIMIT)
+            {
+                auto [current_cost, current_node] = witness_queue.top();
+                witness_queue.pop();
+                if (witness.is_visited(current_node))
+                {
+                    continue;
+                }
+                if (current_cost > max_cost)
+                {
+                    break;
+                }
+                witness.visit(current_node);
+                num_settled++;
+                for (const HierarchyEdge& edge : edges[current_node])
+                {
+                    double distance_through = current_cost + edge.weight;
+                    if (edge.target != node && distance_through < witness.get_cost(edge.target))
+                    {
+                        witness.set(edge.target, distance_through, current_node);
+                        witness_queue.push(QueueEntry(distance_through, edge.target));
+                    }
+                }
+            }
+
+            // Shortcut Every Pair No Witness Path Serves as Well
+            for (size_t j = i + 1; j < neighbors.size(); j++)
+            {
+                double through_node = neighbors[i].weight + neighbors[j].weight;
+                if (witness.get_cost(neighbors[j].target) > through_node)
+                {
+                    num_shortcuts++;
+                    if (add)
+                    {
+                        add_shortcut(source, neighbors[j].target, through_node, node);
+                    }
+                }
+            }
+        }
+        return num_shortcuts;
+    };
+
+    std::vector<int> contracted_neighbors(num_nodes, 0);
+    std::vector<int> level(num_nodes, 0);
+    auto importance = [&](NodeId node) {
+        return contract(node, false) - (int) edges[node].size() + contracted_neighbors[node] + level[node];
+    };
+
+    // Queue Nodes by Importance
+    typedef std::pair<int, NodeId> ImportanceEntry;
+    std::priority_queue<ImportanceEntry, std::vector<ImportanceEntry>, std::greater<ImportanceEntry>> queue;
+    for (NodeId node = 0; node < num_nodes; node++)
+    {
+        queue.push(ImportanceEntry(importance(node), node));
+    }
+
+    // Contract Least Important Node, Rechecking Its Importance First
+    std::vector<std::vector<HierarchyEdge>> upward(num_nodes);
+    uint32_t next_rank = 0;
+    while (!queue.empty())
+    {
+        NodeId node = queue.top().second;
+        queue.pop();
+        int current_importance = importance(node);
+        if (!queue.empty() && current_importance > queue.top().first)
+        {
+            queue.push(ImportanceEntry(current_importance, node));
+            continue;
+        }
+
+        contract(node, true);
+        hierarchy.rank[node] = next_rank++;
+        contracted[node] = 1;
+        upward[node] = std::move(edges[node]);
+        edges[node].clear();
+        for (const HierarchyEdge& edge : upward[node])
+        {
+            std::vector<HierarchyEdge>& neighbor_edges = edges[edge.target];
+            neighbor_edges.erase(std::remove_if(neighbor_edges.begin(), neighbor_edges.end(), [&](const HierarchyEdge& other) {
+                return other.target == node;
+            }), neighbor_edges.end());
+            contracted_neighbors[edge.target]++;
+            level[edge.target] = std::max(level[edge.target], level[node] + 1);
+        }
+    }
+
+    // Pack Upward Edges, Sorted by Target
+    hierarchy.up_offsets.push_back(0);
+    for (NodeId node = 0; node < num_nodes; node++)
+    {
+        std::sort(upward[node].begin(), upward[node].end(), [](const HierarchyEdge& a, const HierarchyEdge& b) {
+            return a.target < b.target;
+        });
+        for (const HierarchyEdge& edge : upward[node])
+        {
+            hierarchy.up_targets.push_back(edge.target);
+            hierarchy.up_weights.push_back(edge.weight);
+            hierarchy.up_middles.push_back(edge.middle);
+            hierarchy.num_shortcuts += edge.middle != NO_NODE;
+        }
+        hierarchy.up_offsets.push_back(hierarchy.up_targets.size());
+    }
+}
+
+/**
+ * Appends the graph nodes a hierarchy edge stands for, after its first node
+ * Helper for find_path_hierarchy()
+ * @param hierarchy
+ * @param from
+ * @param to
+ * @param path nodes so far; gets every node after from up to and including to
+ */
+inline void unpack_hierarchy_edge(const ContractionHierarchy& hierarchy, NodeId from, NodeId to, std::vector<NodeId>& path)
+{
+    NodeId middle = hierarchy.middle_of(from, to);
+    if (middle == NO_NODE)
+    {
+        path.push_back(to);
+        return;
+    }
+    unpack_hierarchy_edge(hierarchy, from, middle, path);
+    unpack_hierarchy_edge(hierarchy, middle, to, path);
+}
+
+/**
+ * Uses a contraction hierarchy to find the shortest path between two nodes
+ * Both searches only climb to more important nodes, and each stops once its
+ * smallest key cannot beat the best meeting point. Shortcuts on the path
+ * are then unpacked into graph edges and the path is written into state,
+ * so the result reads exactly like find_path_dijkstra()'s along the path
+ * @param hierarchy built from graph
+ * @param graph
+ * @param state search data for the forward search and the result, reset by this function
+ * @param backward_state search data for the backward search, reset by this function
+ * @param start_node
+ * @param end_node
+ */
+inline void find_path_hierarchy(
+    const ContractionHierarchy& hierarchy,
+    const MapGraph& graph,
+    SearchState& state,
+    SearchState& backward_state,
+    NodeId start_node,
+    NodeId end_node
+)
+{
+    state.reset(graph.node_count());
+    backward_state.reset(graph.node_count());
+    SearchQueue* queues[2] = {&state.queue, &backward_state.queue};
+    SearchState* states[2] = {&state, &backward_state};
+
+    state.set(start_node, 0, NO_NODE);
+    queues[0]->push(QueueEntry(0, start_node));
+    backward_state.set(end_node, 0, NO_NODE);
+    queues[1]->push(QueueEntry(0, end_node));
+    state.heap_pushes += 2;
+
+    double best_length = start_node == end_node ? 0 : UNREACHED_COST;
+    NodeId meeting_node = start_node == end_node ? start_node : NO_NODE;
+
+    // Grow Whichever Side Can Still Beat the Best Meeting Point
+    while (true)
+    {
+        bool forward_open = !queues[0]->empty() && queues[0]->top().first < best_length;
+        bool backward_open = !queues[1]->empty() && queues[1]->top().first < best_length;
+        if (!forward_open && !backward_open)
+        {
+            break;
+        }
+        int side = forward_open && (!backward_open || queues[0]->top().first <= queues[1]->top().first) ? 0 : 1;
+        SearchState& this_side = *states[side];
+        SearchState& other_side = *states[1 - side];
+
+        NodeId current_node = queues[side]->top().second;
+        queues[side]->pop();
+        state.heap_pops++;
+        if (this_side.is_visited(current_node))
+        {
+            continue;
+        }
+        this_side.visit(current_node);
+        state.nodes_expanded++;
+
+        // Stall Nodes a Higher Neighbor Reaches More Cheaply; No Shortest Path Climbs Through Them
+        double current_cost = this_side.cost[current_node];
+        bool stalled = false;
+        for (uint32_t edge = hierarchy.up_offsets[current_node]; !stalled && edge < hierarchy.up_offsets[current_node + 1]; edge++)
+        {
+            stalled = this_side.get_cost(hierarchy.up_targets[edge]) + hierarchy.up_weights[edge] < current_cost;
+        }
+        if (stalled)
+        {
+            continue;
+        }
+
+        for (uint32_t edge = hierarchy.up_offsets[current_node]; edge < hierarchy.up_offsets[current_node + 1]; edge++)
+        {
+            NodeId neighbor = hierarchy.up_targets[edge];
+            double distance_through = current_cost + hierarchy.up_weights[edge];
+            if (distance_through < this_side.get_cost(neighbor))
+            {
+                this_side.set(neighbor, distance_through, current_node);
+                queues[side]->push(QueueEntry(distance_through, neighbor));
+                state.edges_relaxed++;
+                state.heap_pushes++;
+
+                // Check for a Better Meeting Point
+                if (other_side.is_reached(neighbor) && distance_through + other_side.cost[neighbor] < best_length)
+                {
+                    best_length = distance_through + other_side.cost[neighbor];
+                    meeting_node = neighbor;
+                }
+            }
+        }
+    }
+
+    // Unpack Start to Meeting Point, Then Meeting Point to End
+    uint32_t nodes_expanded = state.nodes_expanded, edges_relaxed = state.edges_relaxed;
+    uint32_t heap_pushes = state.heap_pushes, heap_pops = state.heap_pops;
+    thread_local std::vector<NodeId> climb, path;
+    path.clear();
+    if (meeting_node != NO_NODE)
+    {
+        climb.clear();
+        for (NodeId node = meeting_node; node != NO_NODE; node = state.previous[node])
+        {
+            climb.push_back(node);
+        }
+        path.push_back(start_node);
+        for (size_t i = climb.size() - 1; i > 0; i--)
+        {
+            unpack_hierarchy_edge(hierarchy, climb[i], climb[i - 1], path);
+        }
+        for (NodeId node = meeting_node; node != end_node; node = backward_state.previous[node])
+        {
+            unpack_hierarchy_edge(hierarchy, node, backward_state.previous[node], path);
+        }
+        std::reverse(path.begin(), path.end());
+    }
+
+    // Leave State as a Plain Search Along the Path Would
+    state.reset(graph.node_count());
+    state.nodes_expanded = nodes_expanded;
+    state.edges_relaxed = edges_relaxed;
+    state.heap_pushes = heap_pushes;
+    state.heap_pops = heap_pops;
+    if (path.empty())
+    {
+        state.set(start_node, 0, NO_NODE);
+        state.visit(start_node);
+    }
+    set_path(graph, state, path);
+    profile_search(state);
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+
+#include "profiling.hpp"
+
+/**
+ * Stores a wall that spans between 2 points
+ */
+struct Wall
+{
+    sf::Vector2f a;
+    sf::Vector2f b;
+};
+
+// Segment Tests Keep Every Multiply and Subtract Separately Rounded
+// do_intersect() and any_wall_intersects() only agree bit for bit if
+// neither fuses them into multiply-adds, which GCC does by default wherever
+// FMA is available (e.g. -march=native); clang is told so in orientation()
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+/**
+ * Finds orientation of ordered triplet (p, q, r)
+ * Helper function for do_intersect()
+ * Source: https://www.geeksforgeeks.org/orientation-3-ordered-points/
+ * @param p
+ * @param q
+ * @param r
+ * @return orientation: 0 -> collinear, 1 -> CW, 2 -> CCW
+ */
+inline int orientation(sf::Vector2f p, sf::Vector2f q, sf::Vector2f r)
+{
+#ifdef __clang__
+#pragma clang fp contract(off) // keep the same rounding as any_wall_intersects()
+#endif
+    float val = (q.y - p.y) * (r.x - q.x) - (q.x - p.x) * (r.y - q.y);
+
+    if (val == 0) return 0; // Collinear
+
+    if (val > 0) return 1; // CW
+
+    return 2; // CCW
+}
+
+/**
+ * Checks if q lies on line segment pr
+ * Helper function for do_intersect()
+ * Source: https://www.geeksforgeeks.org/check-if-two-given-line-segments-intersect/
+ * @param p
+ * @param q
+ * @param r
+ * @return boolean whether q lies on line segment pr
+ */
+inline bool on_segment(sf::Vector2f p, sf::Vector2f q, sf::Vector2f r)
+{
+    return q.x <= std::max(p.x, r.x)
+        && q.x >= std::min(p.x, r.x)
+        && q.y <= std::max(p.y, r.y)
+        && q.y >= std::min(p.y, r.y);
+}
+
+/**
+ * Determines if line segments p1q1 and p2q2 intersect
+ * Source: https://www.geeksforgeeks.org/check-if-two-given-line-segments-intersect/
+ * @param p1
+ * @param q1
+ * @param p2
+ * @param q2
+ * @return boolean whether line segments p1q1 and p2q2 intersect
+ */
+inline bool do_intersect(sf::Vector2f p1, sf::Vector2f q1, sf::Vector2f p2, sf::Vector2f q2)
+{
+    PROFILE_COUNT(IntersectionTests, 1);
+
+    // Find the four orientations needed for general and special cases
+    int o1 = orientation(p1, q1, p2);
+    int o2 = orientation(p1, q1, q2);
+    int o3 = orientation(p2, q2, p1);
+    int o4 = orientation(p2, q2, q1);
+
+    // General Case
+    if (o1 != o2 && o3 != o4) return true;
+
+    // Special Cases
+    // p1 / q1 / p2 are collinear, p2 lies on p1q1
+    if (o1 == 0 && on_segment(p1, p2, q1)) return true;
+
+    // p1 / q1 / q2 are collinear, q2 lies on p1q1
+    if (o2 == 0 && on_segment(p1, q2, q1)) return true;
+
+    // p2 / q2 / p1 are collinear, p1 lies on p2q2
+    if (o3 == 0 && on_segment(p2, p1, q2)) return true;
+
+    // p2 / q2 / q1 are collinear, q1 lies on p2q2
+    if (o4 == 0 && on_segment(p2, q1, q2)) return true;
+
+    // Doesn't fall into other cases
+    return false;
+}
+
+/**
+ * Checks a segment against every wall one by one
+ * Reference for the accelerated checks in wall_index.hpp
+ * @param walls
+ * @param a
+ * @param b
+ * @return boolean whether any wall intersects segment ab
+ */
+inline bool crosses_any_wall(const std::vector<Wall>& walls, sf::Vector2f a, sf::Vector2f b)
+{
+    for (const Wall& wall : walls)
+    {
+        if (do_intersect(a, b, wall.a, wall.b))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#endif
+
+/**
+ * Finds the distance from a point to a line segment
+ * @param p
+ * @param a
+ * @param b
+ * @return distance from p to the closest point of segment ab
+ */
+inline double distance_to_segment(sf::Vector2<double> p, sf::Vector2<double> a, sf::Vector2<double> b)
+{
+    double dx = b.x - a.x, dy = b.y - a.y;
+    double length_squared = dx * dx + dy * dy;
+    double t = length_squared > 0 ? ((p.x - a.x) * dx + (p.y - a.y) * dy) / length_squared : 0;
+    t = std::clamp(t, 0.0, 1.0);
+    return std::hypot(p.x - (a.x + t * dx), p.y - (a.y + t * dy));
+}
+
+/**
+ * Convex polygon, vertices in order around it
+ */
+typedef std::vector<sf::Vector2<double>> ConvexPolygon;
+
+/**
+ * Cuts away the part of a convex polygon outside a half plane
+ * Keeps the points p with normal_x * p.x + normal_y * p.y <= offset
+ * @param polygon
+ * @param normal_x
+ * @param normal_y
+ * @param offset
+ * @return clipped polygon, empty if nothing is left
+ */
+inline ConvexPolygon clip_polygon(const ConvexPolygon& polygon, double normal_x, double normal_y, double offset)
+{
+    ConvexPolygon clipped;
+    for (size_t i = 0; i < polygon.size(); i++)
+    {
+        sf::Vector2<double> p = polygon[i];
+        sf::Vector2<double> q = polygon[(i + 1) % polygon.size()];
+        double p_side = normal_x * p.x + normal_y * p.y - offset;
+        double q_side = normal_x * q.x + normal_y * q.y - offset;
+
+        if (p_side <= 0)
+        {
+            clipped.push_back(p);
+        }
+        if ((p_side < 0 && q_side > 0) || (p_side > 0 && q_side < 0))
+        {
+            double t = p_side / (p_side - q_side);
+            clipped.push_back(sf::Vector2<double>(p.x + t * (q.x - p.x), p.y + t * (q.y - p.y)));
+        }
+    }
+    return clipped;
+}
+
+/**
+ * Finds the region a wall could hide from a viewer, within a bounding box
+ * Any point p for which segment viewer-p touches the wall lies inside the
+ * result: the wedge between the rays from the viewer through the wall's
+ * ends, on the far side of the wall, with every side moved out by padding.
+ * A viewer on the wall itself is blocked in every direction and gets the
+ * whole box
+ * @param viewer
+ * @param wall
+ * @param min_x
+ * @param min_y
+ * @param max_x
+ * @param max_y
+ * @param padding
+ * @return shadow polygon, possibly empty
+ */
+inline ConvexPolygon wall_shadow(
+    sf::Vector2f viewer,
+    const Wall& wall,
+    double min_x,
+    double min_y,
+    double max_x,
+    double max_y,
+    double padding
+)
+{
+    ConvexPolygon shadow = {
+        sf::Vector2<double>(min_x - padding, min_y - padding),
+        sf::Vector2<double>(max_x + padding, min_y - padding),
+        sf::Vector2<double>(max_x + padding, max_y + padding),
+        sf::Vector2<double>(min_x - padding, max_y + padding)
+    };
+    sf::Vector2<double> u(viewer.x, viewer.y), a(wall.a.x, wall.a.y), b(wall.b.x, wall.b.y);
+    if (distance_to_segment(u, a, b) <= padding)
+    {
+        return shadow;
+    }
+
+    // Order Wall Ends Counterclockwise Around Viewer
+    double turn = (a.x - u.x) * (b.y - u.y) - (a.y - u.y) * (b.x - u.x);
+    if (turn < 0)
+    {
+        std::swap(a, b);
+    }
+
+    // Keep Points Left of the Ray Through a and Right of the Ray Through b
+    double a_length = std::hypot(a.x - u.x, a.y - u.y);
+    double a_normal_x = (a.y - u.y) / a_length, a_normal_y = -(a.x - u.x) / a_length;
+    shadow = clip_polygon(shadow, a_normal_x, a_normal_y, a_normal_x * u.x + a_normal_y * u.y + padding);
+    double b_length = std::hypot(b.x - u.x, b.y - u.y);
+    double b_normal_x = -(b.y - u.y) / b_length, b_normal_y = (b.x - u.x) / b_length;
+    shadow = clip_polygon(shadow, b_normal_x, b_normal_y, b_normal_x * u.x + b_normal_y * u.y + padding);
+
+    // Keep Points on the Far Side of the Wall
+    if (turn != 0)
+    {
+        double wall_length = std::hypot(b.x - a.x, b.y - a.y);
+        double far_normal_x = (b.y - a.y) / wall_length, far_normal_y = -(b.x - a.x) / wall_length;
+        if (far_normal_x * (u.x - a.x) + far_normal_y * (u.y - a.y) > 0)
+        {
+            far_normal_x = -far_normal_x;
+            far_normal_y = -far_normal_y;
+        }
+        shadow = clip_polygon(shadow, -far_normal_x, -far_normal_y, -(far_normal_x * a.x + far_normal_y * a.y) + padding);
+    }
+    return shadow;
+}
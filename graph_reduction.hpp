@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "map_graph.hpp"
+#include "parallel.hpp"
+#include "profiling.hpp"
+#include "routing_profile.hpp"
+
+/**
+ * Number of nodes a reduction worker claims at a time
+ */
+const uint32_t REDUCTION_NODES_PER_CLAIM = 16;
+
+/**
+ * Drops the edges and waypoints that no shortest route between named nodes needs
+ *
+ * Among the shortest paths between two named nodes, take one with the fewest
+ * edges. Every unnamed node x inside it is a real bend: its neighbors z and y
+ * on the path are not linked directly (or the direct link is no shorter), as
+ * the path could otherwise skip x. So an edge x-y is only needed at x's end
+ * if x is named, or some other neighbor z of x cannot reach y directly at
+ * most as cheaply. Edges needed at neither end are dropped, as are unnamed
+ * nodes left with no edges; every route between named nodes (and the start
+ * and end nodes) keeps its exact length. Routes from other points may bend
+ * at a different waypoint than before
+ *
+ * The test is made under the weights of every routing profile, and an end
+ * needs the edge if any profile needs it there, so a detour around stairs
+ * or a closed area that only some profile takes is kept for it. Edge flags
+ * must be set before reducing
+ *
+ * @param graph storage with neighbors in increasing order; replaced by the reduced graph
+ * @param start_node kept, and updated to its new id
+ * @param end_node kept, and updated to its new id
+ * @param num_threads number of worker threads, 0 for one per core
+ */
+inline void reduce_visibility_graph(MapGraphStorage& graph, NodeId& start_node, NodeId& end_node, unsigned num_threads)
+{
+    PROFILE_SCOPE(GraphReduction);
+    MapGraph view = graph.view();
+    NodeId num_nodes = view.node_count();
+    std::vector<uint8_t> is_route_end(num_nodes);
+    for (NodeId node = 0; node < num_nodes; node++)
+    {
+        is_route_end[node] = view.is_named(node) || node == start_node || node == end_node;
+    }
+
+    // Weights to Test Bends Under: the Lengths, and Each Profile's Own Weights Where It Has Them
+    ProfileWeights profile_weights;
+    profile_weights.build(view);
+    std::vector<ArrayView<float>> weight_sets = {view.weights};
+    for (const std::vector<float>& weights : profile_weights.weights)
+    {
+        if (!weights.empty())
+        {
+            weight_sets.push_back(weights);
+        }
+    }
+
+    // Decide for Edge Slot y -> x Whether the Edge Is Needed at x's End
+    std::vector<uint8_t> needed_at_target(view.edge_count(), 0);
+    unsigned max_threads = parallel_for_threads(num_nodes, REDUCTION_NODES_PER_CLAIM, num_threads);
+    std::vector<std::vector<NodeId>> marks(max_threads, std::vector<NodeId>(num_nodes, NO_NODE));
+    std::vector<std::vector<uint32_t>> slots_to_center(max_threads, std::vector<uint32_t>(num_nodes));
+    parallel_for(num_nodes, REDUCTION_NODES_PER_CLAIM, num_threads, [&](unsigned thread_id, NodeId first, NodeId last) {
+        std::vector<NodeId>& mark = marks[thread_id];
+        std::vector<uint32_t>& slot_to_y = slots_to_center[thread_id];
+        for (NodeId y = first; y < last; y++)
+        {
+            for (uint32_t slot = view.offsets[y]; slot < view.offsets[y + 1]; slot++)
+            {
+                mark[view.targets[slot]] = y;
+                slot_to_y[view.targets[slot]] = slot;
+            }
+
+            for (uint32_t slot = view.offsets[y]; slot < view.offsets[y + 1]; slot++)
+            {
+                NodeId x = view.targets[slot];
+                bool needed = is_route_end[x];
+                for (uint32_t bend = view.offsets[x]; !needed && bend < view.offsets[x + 1]; bend++)
+                {
+                    NodeId z = view.targets[bend];
+                    needed = z != y && mark[z] != y;
+                    for (size_t set = 0; !needed && z != y && set < weight_sets.size(); set++)
+                    {
+                        const ArrayView<float>& weights = weight_sets[set];
+                        needed = (double) weights[slot_to_y[z]] > (double) weights[slot] + weights[bend];
+                    }
+                }
+                needed_at_target[slot] = needed;
+            }
+        }
+    });
+
+    // Keep Edges Needed at Both Ends
+    std::vector<uint8_t> keep_edge(view.edge_count(), 0);
+    std::vector<NodeId> new_id(num_nodes, NO_NODE);
+    NodeId num_kept_nodes = 0;
+    for (NodeId y = 0; y < num_nodes; y++)
+    {
+        bool has_edge = false;
+        for (uint32_t slot = view.offsets[y]; slot < view.offsets[y + 1]; slot++)
+        {
+            NodeId x = view.targets[slot];
+            const NodeId* back = std::lower_bound(view.targets.begin() + view.offsets[x], view.targets.begin() + view.offsets[x + 1], y);
+            keep_edge[slot] = needed_at_target[slot] && needed_at_target[back - view.targets.begin()];
+            has_edge = has_edge || keep_edge[slot];
+        }
+        if (has_edge || is_route_end[y])
+        {
+            new_id[y] = num_kept_nodes++;
+        }
+    }
+
+    // Pack Kept Nodes and Edges, Keeping Neighbors in Increasing Order
+    MapGraphStorage reduced;
+    reduced.offsets.push_back(0);
+    for (NodeId node = 0; node < num_nodes; node++)
+    {
+        if (new_id[node] == NO_NODE)
+        {
+            continue;
+        }
+        reduced.add_node(view.x[node], view.y[node], view.name(node));
+        for (uint32_t slot = view.offsets[node]; slot < view.offsets[node + 1]; slot++)
+        {
+            if (keep_edge[slot])
+            {
+                reduced.targets.push_back(new_id[view.targets[slot]]);
+                reduced.weights.push_back(view.weights[slot]);
+                reduced.flags.push_back(view.flags[slot]);
+            }
+        }
+        reduced.offsets.push_back(reduced.targets.size());
+    }
+    start_node = start_node == NO_NODE ? NO_NODE : new_id[start_node];
+    end_node = end_node == NO_NODE ? NO_NODE : new_id[end_node];
+    graph = std::move(reduced);
+}
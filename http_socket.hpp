@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+/**
+ * Largest request or response header block read, in bytes
+ * Route requests are one short line; anything longer is refused
+ */
+const size_t HTTP_HEADER_BUFFER_SIZE = 8192;
+
+/**
+ * Sends a whole buffer, however many calls it takes
+ * A peer that closed the connection gives an error instead of SIGPIPE
+ * @param socket
+ * @param data
+ * @param size
+ * @return boolean whether everything was sent
+ */
+inline bool send_all(int socket, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t sent = send(socket, data, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+/**
+ * @param data bytes received so far
+ * @param size
+ * @return size of the header block including its blank line, 0 if it is not all there yet
+ */
+inline size_t http_header_size(const char* data, size_t size)
+{
+    size_t blank_line = std::string_view(data, size).find("\r\n\r\n");
+    return blank_line == std::string_view::npos ? 0 : blank_line + 4;
+}
+
+/**
+ * @param a
+ * @param b
+ * @return boolean whether the two are the same but for letter case, as header names and tokens are compared
+ */
+inline bool http_equal_ignoring_case(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (std::tolower((unsigned char) a[i]) != std::tolower((unsigned char) b[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Finds a header's value, ignoring the case of its name
+ * @param headers header block, starting with the request or status line
+ * @param name without the colon
+ * @return value with surrounding spaces removed, empty if the header is missing
+ */
+inline std::string_view http_header_value(std::string_view headers, std::string_view name)
+{
+    size_t line_start = headers.find("\r\n");
+    while (line_start != std::string_view::npos && line_start + 2 < headers.size())
+    {
+        line_start += 2;
+        size_t line_end = headers.find("\r\n", line_start);
+        std::string_view line = headers.substr(line_start, line_end - line_start);
+        if (line.size() > name.size() && line[name.size()] == ':' && http_equal_ignoring_case(line.substr(0, name.size()), name))
+        {
+            std::string_view value = line.substr(name.size() + 1);
+            while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+            {
+                value.remove_prefix(1);
+            }
+            while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+            {
+                value.remove_suffix(1);
+            }
+            return value;
+        }
+        line_start = line_end;
+    }
+    return std::string_view();
+}
+
+/**
+ * Decodes %XX escapes and '+' (a space) in a query string value
+ * @param text
+ * @param decoded gets the text, at most text.size() bytes
+ * @return size of the decoded text, or text.size() + 1 if an escape is malformed
+ */
+inline size_t url_decode(std::string_view text, char* decoded)
+{
+    auto hex_digit = [](char c) {
+        return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    };
+    size_t size = 0;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '%')
+        {
+            int high = i + 2 < text.size() ? hex_digit(text[i + 1]) : -1;
+            int low = i + 2 < text.size() ? hex_digit(text[i + 2]) : -1;
+            if (high < 0 || low < 0)
+            {
+                return text.size() + 1;
+            }
+            decoded[size++] = (char) (high * 16 + low);
+            i += 2;
+        }
+        else
+        {
+            decoded[size++] = text[i] == '+' ? ' ' : text[i];
+        }
+    }
+    return size;
+}
+
+/**
+ * Writes text into a buffer allocated up front, so building a response
+ * never allocates; writes past the end are dropped and remembered
+ */
+class HttpWriter
+{
+public:
+    HttpWriter(char* data, size_t capacity) : data(data), capacity(capacity) {}
+
+    void append(std::string_view text)
+    {
+        if (text.size() > capacity - size)
+        {
+            overflowed = true;
+            return;
+        }
+        std::memcpy(data + size, text.data(), text.size());
+        size += text.size();
+    }
+
+    /**
+     * @param value
+     * @param precision digits after the decimal point
+     */
+    void append_number(double value, int precision)
+    {
+        char number[64];
+        int length = std::snprintf(number, sizeof(number), "%.*f", precision, value);
+        append(std::string_view(number, length > 0 ? length : 0));
+    }
+
+    void append_number(size_t value)
+    {
+        char number[32];
+        int length = std::snprintf(number, sizeof(number), "%zu", value);
+        append(std::string_view(number, length > 0 ? length : 0));
+    }
+
+    /**
+     * Appends text as a JSON string, quotes included
+     * @param text
+     */
+    void append_json_string(std::string_view text)
+    {
+        append("\"");
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                char escaped[2] = {'\\', c};
+                append(std::string_view(escaped, 2));
+            }
+            else if ((unsigned char) c < 0x20)
+            {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned) (unsigned char) c);
+                append(std::string_view(escaped, 6));
+            }
+            else
+            {
+                append(std::string_view(&c, 1));
+            }
+        }
+        append("\"");
+    }
+
+    char* data;
+    size_t capacity;
+    size_t size = 0;
+    bool overflowed = false;
+};
@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "http_socket.hpp"
+#include "route_batch.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+/**
+ * Requests timed by one connection after the warmup
+ */
+struct ConnectionLog
+{
+    vector<double> latencies; // seconds
+    vector<uint32_t> seconds; // second of the measured run each request finished in
+    size_t rejected = 0; // answered with a status other than 200 (e.g. an unknown node)
+    size_t errors = 0; // failed connections and requests left unanswered
+};
+
+/**
+ * Escapes everything but unreserved characters, for a query string value
+ * @param text
+ * @return encoded text
+ */
+string url_encode(const string& text)
+{
+    ostringstream encoded;
+    for (unsigned char c : text)
+    {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+        {
+            encoded << c;
+        }
+        else
+        {
+            encoded << '%' << uppercase << hex << setw(2) << setfill('0') << (int) c << dec;
+        }
+    }
+    return encoded.str();
+}
+
+/**
+ * Reads route requests from a query file (a start and end node name per line)
+ * @param path
+ * @param requests gets an HTTP request for every query
+ * @return boolean whether the file could be opened
+ */
+bool read_requests(const string& path, vector<string>& requests)
+{
+    ifstream queries_file = ifstream(path);
+    if (!queries_file.is_open())
+    {
+        return false;
+    }
+    string line;
+    while (getline(queries_file, line))
+    {
+        istringstream line_stream(line);
+        string from, to;
+        if (!(line_stream >> from >> to) || from[0] == '#') continue;
+        requests.push_back("GET /route?from=" + url_encode(from) + "&to=" + url_encode(to) + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    }
+    return true;
+}
+
+/**
+ * @param port
+ * @return connected socket, or -1
+ */
+int connect_to_server(uint16_t port)
+{
+    int connection = socket(AF_INET, SOCK_STREAM, 0);
+    if (connection < 0)
+    {
+        return -1;
+    }
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(connection, (sockaddr*) &address, sizeof(address)) < 0)
+    {
+        close(connection);
+        return -1;
+    }
+    int no_delay = 1;
+    setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+    return connection;
+}
+
+/**
+ * Sends one request and reads its whole response
+ * @param connection
+ * @param request
+ * @param buffer reused for the response
+ * @param status set to the response status
+ * @param keep_alive set to whether the server keeps the connection open
+ * @return boolean whether a whole response arrived
+ */
+bool send_request(int connection, const string& request, vector<char>& buffer, int& status, bool& keep_alive)
+{
+    if (!send_all(connection, request.data(), request.size()))
+    {
+        return false;
+    }
+
+    // Headers
+    size_t filled = 0, header_size = 0;
+    while ((header_size = http_header_size(buffer.data(), filled)) == 0)
+    {
+        if (filled == buffer.size())
+        {
+            buffer.resize(buffer.size() * 2);
+        }
+        ssize_t received = recv(connection, buffer.data() + filled, buffer.size() - filled, 0);
+        if (received <= 0)
+        {
+            return false;
+        }
+        filled += received;
+    }
+    string_view headers(buffer.data(), header_size);
+    status = headers.size() > 12 ? atoi(buffer.data() + 9) : 0;
+    keep_alive = !http_equal_ignoring_case(http_header_value(headers, "Connection"), "close");
+
+    // Body, Read Until Content-Length Bytes Are In
+    size_t body_size = strtoull(string(http_header_value(headers, "Content-Length")).c_str(), nullptr, 10);
+    if (buffer.size() < header_size + body_size)
+    {
+        buffer.resize(header_size + body_size);
+    }
+    while (filled < header_size + body_size)
+    {
+        ssize_t received = recv(connection, buffer.data() + filled, header_size + body_size - filled, 0);
+        if (received <= 0)
+        {
+            return false;
+        }
+        filled += received;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    // Read Command Line Options
+    string queries_path;
+    uint16_t port = 8080;
+    unsigned num_connections = 8;
+    double warmup_seconds = 1;
+    double measured_seconds = 10;
+    for (int i = 1; i < argc; i++)
+    {
+        string option = argv[i];
+        if (option == "--queries" && i + 1 < argc)
+        {
+            queries_path = argv[++i];
+        }
+        else if (option == "--port" && i + 1 < argc)
+        {
+            port = stoi(argv[++i]);
+        }
+        else if (option == "--connections" && i + 1 < argc)
+        {
+            num_connections = max(1ul, stoul(argv[++i]));
+        }
+        else if (option == "--warmup" && i + 1 < argc)
+        {
+            warmup_seconds = stod(argv[++i]);
+        }
+        else if (option == "--seconds" && i + 1 < argc)
+        {
+            measured_seconds = max(1.0, stod(argv[++i]));
+        }
+        else
+        {
+            queries_path.clear();
+            break;
+        }
+    }
+    if (queries_path.empty())
+    {
+        cout << "Usage: load_test --queries queries.txt [--port 8080] [--connections 8] [--warmup 1] [--seconds 10]" << endl;
+        return 1;
+    }
+    vector<string> requests;
+    if (!read_requests(queries_path, requests) || requests.empty())
+    {
+        cout << "Unable to read queries from " << queries_path << endl;
+        return 1;
+    }
+
+    // Each Connection Sends Its Next Request as Soon as the Last One Is Answered
+    Clock::time_point start = Clock::now();
+    Clock::time_point measure_start = start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(warmup_seconds));
+    Clock::time_point stop = measure_start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(measured_seconds));
+    vector<ConnectionLog> logs(num_connections);
+    vector<thread> threads;
+    for (unsigned connection_id = 0; connection_id < num_connections; connection_id++)
+    {
+        threads.emplace_back([&, connection_id]() {
+            ConnectionLog& log = logs[connection_id];
+            vector<char> buffer(HTTP_HEADER_BUFFER_SIZE);
+            int connection = -1;
+            size_t next = connection_id;
+            while (Clock::now() < stop)
+            {
+                if (connection < 0 && (connection = connect_to_server(port)) < 0)
+                {
+                    log.errors++;
+                    this_thread::sleep_for(chrono::milliseconds(100));
+                    continue;
+                }
+                int status = 0;
+                bool keep_alive = false;
+                Clock::time_point request_start = Clock::now();
+                bool answered = send_request(connection, requests[next % requests.size()], buffer, status, keep_alive);
+                Clock::time_point request_end = Clock::now();
+                next += num_connections;
+
+                if (request_start >= measure_start && request_end < stop)
+                {
+                    if (!answered)
+                    {
+                        log.errors++;
+                    }
+                    else
+                    {
+                        log.rejected += status != 200;
+                        log.latencies.push_back(chrono::duration<double>(request_end - request_start).count());
+                        log.seconds.push_back((uint32_t) chrono::duration<double>(request_end - measure_start).count());
+                    }
+                }
+                if (!answered || !keep_alive)
+                {
+                    close(connection);
+                    connection = -1;
+                }
+            }
+            if (connection >= 0)
+            {
+                close(connection);
+            }
+        });
+    }
+    for (thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    // Requests and p99 Latency per Second, to Show Throughput Holds Up
+    size_t num_seconds = (size_t) ceil(measured_seconds);
+    vector<vector<double>> by_second(num_seconds);
+    vector<double> latencies;
+    size_t rejected = 0, errors = 0;
+    for (const ConnectionLog& log : logs)
+    {
+        for (size_t i = 0; i < log.latencies.size(); i++)
+        {
+            by_second[min<size_t>(log.seconds[i], num_seconds - 1)].push_back(log.latencies[i]);
+        }
+        latencies.insert(latencies.end(), log.latencies.begin(), log.latencies.end());
+        rejected += log.rejected;
+        errors += log.errors;
+    }
+    cout << "# MissionMaps load test, 127.0.0.1:" << port
+         << ", connections " << num_connections
+         << ", warmup " << warmup_seconds << " s" << endl;
+    cout << "# second\trequests\tp50_us\tp99_us" << endl;
+    for (size_t second = 0; second < num_seconds; second++)
+    {
+        sort(by_second[second].begin(), by_second[second].end());
+        cout << second + 1 << '\t' << by_second[second].size()
+             << '\t' << fixed << setprecision(1) << latency_percentile(by_second[second], 0.50) * 1e6
+             << '\t' << latency_percentile(by_second[second], 0.99) * 1e6 << endl;
+    }
+
+    // Totals
+    sort(latencies.begin(), latencies.end());
+    cout << "# requests " << latencies.size()
+         << ", rejected " << rejected
+         << ", errors " << errors
+         << ", throughput " << setprecision(0) << latencies.size() / measured_seconds << " requests/s"
+         << ", p50 " << setprecision(1) << latency_percentile(latencies, 0.50) * 1e6 << " us"
+         << ", p99 " << latency_percentile(latencies, 0.99) * 1e6 << " us"
+         << ", p99.9 " << latency_percentile(latencies, 0.999) * 1e6 << " us"
+         << ", max " << (latencies.empty() ? 0 : latencies.back() * 1e6) << " us" << endl;
+    return errors == 0 ? 0 : 1;
+}
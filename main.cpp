@@ -1,320 +1,1268 @@
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <csignal>
+#include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
-#include <list>
+#include <memory>
+#include <random>
 #include <sstream>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <SFML/Graphics.hpp>
 
+#include "alternative_routes.hpp"
+#include "contraction_hierarchy.hpp"
+#include "geometry.hpp"
+#include "graph_reduction.hpp"
+#include "map_cache.hpp"
+#include "map_editor.hpp"
+#include "map_graph.hpp"
+#include "map_image.hpp"
+#include "map_render.hpp"
+#include "map_text.hpp"
+#include "map_tiles.hpp"
+#include "node_index.hpp"
+#include "path_search.hpp"
+#include "point_query.hpp"
+#include "profiling.hpp"
+#include "route_batch.hpp"
+#include "route_server.hpp"
+#include "route_table.hpp"
+#include "routing_profile.hpp"
+#include "search_tree.hpp"
+#include "site_map.hpp"
+#include "visibility_graph.hpp"
+#include "wall_index.hpp"
+#include "wall_kernel.hpp"
+
 using namespace std;
 
-// Structs for Walls and Nodes
+// Variables for Walls and Nodes
+NodeId start_node = NO_NODE, end_node = NO_NODE;
+vector<Wall> walls; // stores all walls
+vector<MapArea> areas; // stores all areas, whose flags go to the edges crossing them
+WallGrid wall_index; // spatial index over walls, rebuilt when walls are added
+MapGraph school_graph; // stores all nodes and their connections
+MapGraphStorage school_storage; // arrays behind school_graph when built from map text
+MapCache school_cache; // arrays behind school_graph when loaded from a compiled map
+SearchState search_state; // Dijkstra's algorithm metrics for the current path
+SearchState backward_search_state; // second search of bidirectional A*
+SearchStrategy search_strategy = SearchStrategy::Dijkstra;
+RoutingProfile routing_profile = RoutingProfile::Shortest;
+ProfileWeights profile_weights; // edge weights of every routing profile for school_graph
+MapGraph routing_graph; // school_graph weighted by routing_profile, which routes are found on
+size_t num_routes = 1; // routes to find between two nodes, counting the shortest; more than 1 adds alternatives
+AlternativeSearch alternative_search; // search data for finding alternatives
+vector<Route> routes; // shortest route and its alternatives, empty unless alternatives are wanted
+vector<NodeId> route_path; // nodes of the route shown, end to start, measured every frame
+PointQuery point_query; // links of a start or end that is a point rather than a node
+RouteTable route_table; // precomputed routes between named nodes, empty unless enabled
+bool use_route_table = false;
+ContractionHierarchy hierarchy; // shortcuts for fast searches, empty unless enabled
+bool use_hierarchy = false;
+bool reduce_graph = false; // drop edges and waypoints no route between named nodes needs
+string profile_path; // where to write the profiling report on exit, empty for none
+unsigned worker_threads = 0; // threads for graph building and batch queries, 0 for one per core
+bool map_changed = true; // walls or graph changed since the map was last drawn
+NodeGrid named_node_index; // named nodes, for finding the one under the cursor
+NodeGrid node_index; // all nodes, for snapping clicks to the graph
+EditableMap map_edits; // editable copy of the map, made on the first change
+bool map_edited = false;
+
+const double FEET_PER_PIXEL = 0.6;
+
+// Functions for Obstruction Checking
+
 /**
- * Stores a wall that spans between 2 points
+ * Checks whether two points are obstructed by an obstacle in the map
+ * Only walls near the segment are tested, using wall_index
+ * @param a
+ * @param b
+ * @return boolean whether the line segment connecting the points is obstructed by any wall
  */
-struct Wall
+bool is_obstructed(sf::Vector2f a, sf::Vector2f b)
 {
-    sf::Vector2f a;
-    sf::Vector2f b;
-};
+    // Index Walls Added Since the Last Check
+    if (wall_index.wall_count != walls.size())
+    {
+        wall_index.build(walls);
+    }
+
+    return wall_index.is_obstructed(a, b);
+}
+
+// Functions for Adding Walls and Nodes
 
 /**
- * Individual node on the graph
- * Stores position and Dijkstra's algorithm metrics
+ * Gets the position of a node as an SFML vector
+ * @param node graph node, or the id of a start/end point
+ * @return position
  */
-struct MapNode
+sf::Vector2f node_pos(NodeId node)
 {
-    sf::Vector2f pos;
-    list<MapNode*> neighbors;
-    double cost = 1000000;
-    bool visited = false;
-    MapNode* previous = nullptr;
-    string name;
-};
+    return query_node_position(school_graph, point_query, node);
+}
 
-// Variables for Walls and Nodes
-MapNode *start_node = nullptr, *end_node = nullptr;
-list<Wall> walls; // stores all walls
-list<MapNode> school_graph; // stores all nodes
-int total_num_nodes = 0;
+/**
+ * Checks whether an id stands for a start/end point rather than a graph node
+ * @param node
+ * @return boolean whether the id belongs to point_query
+ */
+bool is_point(NodeId node)
+{
+    return node != NO_NODE && node >= school_graph.node_count();
+}
 
-// Functions for Obstruction Checking
+/**
+ * Rebuilds the spatial indexes over nodes
+ * Must be called once the graph is loaded and after it changes
+ */
+void index_nodes()
+{
+    named_node_index.build(school_graph, [](NodeId node) { return school_graph.is_named(node); });
+    node_index.build(school_graph);
+}
 
 /**
- * Finds orientation of ordered triplet (p, q, r)
- * Helper function for do_intersect()
- * Source: https://www.geeksforgeeks.org/orientation-3-ordered-points/
- * @param p
- * @param q
- * @param r
- * @return orientation: 0 -> collinear, 1 -> CW, 2 -> CCW
+ * Finds the closest node that can be walked to in a straight line from a point
+ * Nodes removed by map edits are passed over
+ * @param point
+ * @param max_distance
+ * @return nearest reachable node, NO_NODE if none is within max_distance
  */
-int orientation(sf::Vector2f p, sf::Vector2f q, sf::Vector2f r)
+NodeId snap_to_node(sf::Vector2f point, double max_distance)
 {
-    float val = (q.y - p.y) * (r.x - q.x) - (q.x - p.x) * (r.y - q.y);
+    return node_index.nearest(school_graph, point.x, point.y, max_distance, [&](NodeId node) {
+        return (!map_edited || !map_edits.removed[node]) && !is_obstructed(point, node_pos(node));
+    });
+}
 
-    if (val == 0) return 0; // Collinear
+/**
+ * Weighs school_graph by every routing profile and points routing_graph at the chosen one
+ * Must be called once the graph is loaded and after it changes
+ */
+void weigh_profiles()
+{
+    profile_weights.build(school_graph);
+    routing_graph = profile_weights.view(school_graph, routing_profile);
+}
 
-    if (val > 0) return 1; // CW
+/**
+ * Links all nodes that can see each other, using every core
+ * Must be called once all nodes and walls are added and before searching;
+ * every pair is checked against every wall, wherever it appears in the file
+ * With reduce_graph set, the links no route between named nodes needs are dropped
+ */
+void finish_graph()
+{
+    wall_index.build(walls);
+    build_visibility_graph(school_storage, wall_index, worker_threads);
+    flag_edges(school_storage, areas);
+    if (reduce_graph)
+    {
+        reduce_visibility_graph(school_storage, start_node, end_node, worker_threads);
+    }
+    school_graph = school_storage.view();
+    weigh_profiles();
+}
+
+// Map Loading Functions
+
+const string MAP_PATH = "../mission.txt";
+const string BACKGROUND_PATH = "../blank_map.png"; // tiled into ../blank_map.png.tiles/ on first launch
+const size_t MAX_MAP_ERRORS_SHOWN = 20; // a file that is not a map at all would otherwise flood the console
 
-    return 2; // CCW
+/**
+ * Prints malformed lines of a map or site file
+ * @param path
+ * @param errors
+ */
+void print_map_errors(const string& path, const vector<MapTextError>& errors)
+{
+    for (size_t i = 0; i < errors.size() && i < MAX_MAP_ERRORS_SHOWN; i++)
+    {
+        cout << path << ":" << errors[i].line << ":" << errors[i].column << ": " << errors[i].message << endl;
+    }
+    if (errors.size() > MAX_MAP_ERRORS_SHOWN)
+    {
+        cout << path << ": " << errors.size() - MAX_MAP_ERRORS_SHOWN << " more malformed lines" << endl;
+    }
 }
 
 /**
- * Checks if q lies on line segment pr
- * Helper function for do_intersect()
- * Source: https://www.geeksforgeeks.org/check-if-two-given-line-segments-intersect/
- * @param p
- * @param q
- * @param r
- * @return boolean whether q lies on line segment pr
+ * Reads walls, areas and nodes from a map text file
+ * Nodes are not linked until finish_graph() is called
+ * Malformed lines are skipped and listed with print_map_errors()
+ * @param path
+ * @return boolean whether the file could be opened
  */
-bool on_segment(sf::Vector2f p, sf::Vector2f q, sf::Vector2f r)
+bool load_map_text(const string& path)
 {
-    return q.x <= max(p.x, r.x)
-        && q.x >= min(p.x, r.x)
-        && q.y <= max(p.y, r.y)
-        && q.y >= min(p.y, r.y);
+    vector<MapTextError> errors;
+    {
+        PROFILE_SCOPE(MapParse);
+        ifstream map_file = ifstream(path, ios::binary);
+        if (!map_file.is_open())
+        {
+            return false;
+        }
+        read_map_text(map_file, walls, areas, school_storage, start_node, end_node, errors);
+    }
+    print_map_errors(path, errors);
+    return true;
 }
 
 /**
- * Determines if line segments p1q1 and p2q2 intersect
- * Source: https://www.geeksforgeeks.org/check-if-two-given-line-segments-intersect/
- * @param p
- * @param q
- * @param r
- * @return boolean whether line segments p1q1 and p2q2 intersect
+ * Gets the path of the compiled version of a map
+ * Reduced graphs are saved separately from full ones
+ * @param map_path path of the map text
+ * @return path of the compiled map
  */
-bool do_intersect(sf::Vector2f p1, sf::Vector2f q1, sf::Vector2f p2, sf::Vector2f q2)
+string map_cache_path(const string& map_path)
 {
-    // Find the four orientations needed for general and special cases
-    int o1 = orientation(p1, q1, p2);
-    int o2 = orientation(p1, q1, q2);
-    int o3 = orientation(p2, q2, p1);
-    int o4 = orientation(p2, q2, q1);
+    return map_path + (reduce_graph ? ".reduced.bin" : ".bin");
+}
 
-    // General Case
-    if (o1 != o2 && o3 != o4) return true;
+/**
+ * Builds the graph from map text and saves it as a compiled map
+ * @param map_path path of the map text
+ * @param checksum checksum of the map text
+ * @return boolean whether the map text could be read
+ */
+bool compile_map(const string& map_path, uint64_t checksum)
+{
+    if (!load_map_text(map_path))
+    {
+        return false;
+    }
+    finish_graph();
 
-    // Special Cases
-    // p1 / q1 / p2 are collinear, p2 lies on p1q1
-    if (o1 == 0 && on_segment(p1, p2, q1)) return true;
+    if (!write_map_cache(map_cache_path(map_path), school_graph, walls, areas, start_node, end_node, checksum))
+    {
+        cout << "Unable to write compiled map " << map_cache_path(map_path) << endl;
+    }
+    return true;
+}
 
-    // p1 / q1 / q2 are collinear, q2 lies on p1q1
-    if (o2 == 0 && on_segment(p1, q2, q1)) return true;
+/**
+ * Loads a map, using its compiled version directly if it matches the text
+ * Falls back to parsing the text (and recompiling) if the compiled map is
+ * missing, damaged, or was built from different text
+ * @param map_path path of the map text
+ * @return boolean whether the map could be loaded
+ */
+bool load_map(const string& map_path)
+{
+    uint64_t checksum;
+    if (!checksum_file(map_path, checksum))
+    {
+        return false;
+    }
 
-    // p2 / q2 / p1 are collinear, p1 lies on p2q2
-    if (o3 == 0 && on_segment(p2, p1, q2)) return true;
+    // Use Compiled Map in Place
+    if (school_cache.open(map_cache_path(map_path), checksum))
+    {
+        school_graph = school_cache.graph;
+        walls.assign(school_cache.walls.begin(), school_cache.walls.end());
+        areas.assign(school_cache.areas.begin(), school_cache.areas.end());
+        wall_index.build(walls);
+        start_node = school_cache.start_node;
+        end_node = school_cache.end_node;
+        weigh_profiles();
+        return true;
+    }
 
-    // p2 / q2 / q1 are collinear, q1 lies on p2q2
-    if (o4 == 0 && on_segment(p2, q1, q2)) return true;
+    return compile_map(map_path, checksum);
+}
 
-    // Doesn't fall into other cases
-    return false;
+/**
+ * Gets the path of the route table for a map file
+ * @param map_path
+ * @return route table path
+ */
+string route_table_path(const string& map_path)
+{
+    return map_path + (reduce_graph ? ".reduced.routes" : ".routes");
 }
 
 /**
- * Checks whether a wall is in between two points
- * Helper function for is_obstructed() without wall parameter
- * @param a
- * @param b
- * @param wall
- * @return boolean whether the wall obstructs the line segment connecting the points
+ * Opens the route table saved for the loaded map, or computes and saves it
+ * @param map_path
  */
-bool is_obstructed(sf::Vector2f a, sf::Vector2f b, Wall wall)
+void load_route_table(const string& map_path)
 {
-    return do_intersect(a, b, wall.a, wall.b);
+    if (route_table.open(route_table_path(map_path), school_graph))
+    {
+        return;
+    }
+
+    build_route_table(route_table, school_graph, worker_threads);
+    if (!write_route_table(route_table_path(map_path), route_table, school_graph))
+    {
+        cout << "Unable to write route table " << route_table_path(map_path) << endl;
+    }
 }
 
+// Profiling
+
 /**
- * Checks whether two points are obstructed by an obstacle in the map
- * @param a
- * @param b
- * @return boolean whether the line segment connecting the points is obstructed by any wall
+ * Writes the profiling report if one was asked for
+ * @param map_path map that was loaded
  */
-bool is_obstructed(sf::Vector2f a, sf::Vector2f b)
+void write_profile(const string& map_path)
 {
-    list<Wall>::iterator iterator;
-    for (iterator = walls.begin(); iterator != walls.end(); ++iterator)
+    if (profile_path.empty())
     {
-        if (is_obstructed(a, b, *iterator))
-        {
-            return true;
-        }
+        return;
     }
-    return false;
+    ofstream profile_file = ofstream(profile_path);
+    if (!profile_file.is_open())
+    {
+        cout << "Unable to write profile " << profile_path << endl;
+        return;
+    }
+    write_profile_json(profile_file, map_path);
 }
 
-// Functions for Adding Walls and Nodes
+// Dijkstra Variables / Functions
 
 /**
- * Inputs new node with specified name into the pathable graph
- * Helper function for add_node() without name parameter
- * @param point the position to add to the graph
- * @return pointer to new node
+ * Resets all data from previous Dijkstra's runs
  */
-MapNode* add_node(sf::Vector2f point, string name)
+void reset()
 {
-    // Create Node
-    MapNode new_node = MapNode();
-    new_node.pos = point;
-    new_node.name = name;
+    search_state.reset(school_graph.node_count() + 2); // room for point ids
+    routes.clear();
+}
 
-    // Add Node to Graph
-    school_graph.push_back(new_node);
+/**
+ * Makes a map position the start or end of the route
+ * The position is linked to the nodes it can see for this route only
+ * @param point
+ * @param as_start boolean whether the point is the start rather than the end
+ * @return id standing for the point
+ */
+NodeId place_point(sf::Vector2f point, bool as_start)
+{
+    if (as_start)
+    {
+        set_query_start(school_graph, wall_index, areas, point_query, point);
+        return point_query.start_node;
+    }
+    set_query_end(school_graph, wall_index, areas, point_query, point);
+    return point_query.end_node;
+}
 
-    // Get Node Pointer
-    MapNode* new_node_pointer = &school_graph.back();
+/**
+ * Finds the shortest path between start and end node with search_strategy,
+ * weighing edges by routing_profile
+ * Updates path data in search_state, at least for every node on the path,
+ * and fills routes with alternatives between two nodes if they are wanted
+ */
+void find_path()
+{
+    routes.clear();
 
-    // Link All Nodes to New Node if No Obstructions
-    list<MapNode>::iterator iterator;
-    for (
-            iterator = school_graph.begin();
-            iterator != school_graph.end();
-            ++iterator
-        )
+    // Route Through Points That Are Not Nodes
+    if (is_point(start_node) || is_point(end_node))
     {
-        if (
-                &*iterator != new_node_pointer &&
-                !is_obstructed(point, iterator->pos)
-           )
+        if (!is_point(start_node))
+        {
+            set_query_start(school_graph, wall_index, areas, point_query, start_node);
+        }
+        if (!is_point(end_node))
         {
-            new_node_pointer->neighbors.push_back(&(*iterator));
-            iterator->neighbors.push_back(new_node_pointer);
+            set_query_end(school_graph, wall_index, areas, point_query, end_node);
         }
+        set_query_profile(point_query, routing_profile);
+        find_path_between_points(routing_graph, search_state, point_query);
+        return;
     }
 
-    total_num_nodes++;
-    return new_node_pointer;
+    // Route Between Two Nodes the Way Batch Queries Are Answered
+    RouteResult result;
+    answer_route_query(routing_graph, route_table, hierarchy, search_strategy, search_state, backward_search_state, route_path, RouteQuery{start_node, end_node}, result);
+    if (num_routes > 1)
+    {
+        find_alternative_routes(routing_graph, alternative_search, search_state, start_node, end_node, num_routes, routes);
+    }
 }
 
+// Runtime Map Changes
+
 /**
- * Inputs new node into the pathable graph
- * @param point the position to add to the graph
- * @return pointer to new node
+ * Copies the loaded map into map_edits before its first change
+ * Helper function for the runtime change functions
+ * A reduced graph cannot be edited: an edit would link pairs the reduction
+ * dropped, giving a graph that matches neither a reduced nor a full rebuild
+ * @return boolean whether the map can be edited
  */
-MapNode* add_node(sf::Vector2f point)
+bool start_map_edit()
 {
-    return add_node(point, " ");
+    if (reduce_graph)
+    {
+        cout << "Unable to edit a reduced graph; run without --reduce to edit the map" << endl;
+        return false;
+    }
+
+    // Point Ids Would Collide With New Nodes
+    if (is_point(start_node))
+    {
+        start_node = NO_NODE;
+    }
+    if (is_point(end_node))
+    {
+        end_node = NO_NODE;
+    }
+
+    if (!map_edited)
+    {
+        begin_editing(map_edits, school_graph, areas);
+        map_edited = true;
+    }
+    return true;
+}
+
+/**
+ * Points school_graph at the changed map and drops the current path
+ * Helper function for the runtime change functions
+ */
+void finish_map_edit()
+{
+    school_graph = finish_editing(map_edits);
+    weigh_profiles();
+    route_table.close(); // precomputed routes no longer match
+    hierarchy.clear();
+    map_changed = true;
+    index_nodes();
+    reset();
 }
 
 /**
- * Adds a wall between two points to the map
+ * Adds a wall to the loaded map, unlinking only the nodes it blocks
  * @param a
  * @param b
  */
-void add_wall(sf::Vector2f a, sf::Vector2f b)
+void insert_wall(sf::Vector2f a, sf::Vector2f b)
 {
+    if (!start_map_edit())
+    {
+        return;
+    }
     Wall wall;
     wall.a = a;
     wall.b = b;
-    walls.push_back(wall);
+    add_wall_edit(map_edits, walls, wall_index, wall);
+    finish_map_edit();
 }
 
-// Dijkstra Variables / Functions
+/**
+ * Removes a wall from the loaded map, linking only the nodes it blocked
+ * @param wall_id index of the wall in walls
+ */
+void delete_wall(size_t wall_id)
+{
+    if (!start_map_edit())
+    {
+        return;
+    }
+    remove_wall_edit(map_edits, walls, wall_index, wall_id);
+    finish_map_edit();
+}
 
 /**
- * Calculates distance between two points
- * @param a
- * @param b
- * @return distance
+ * Adds a node to the loaded map and links it to every node it can see
+ * @param point
+ * @param name
+ * @return id of new node, NO_NODE if the map cannot be edited
  */
-double distance(const MapNode& a, const MapNode& b)
+NodeId insert_node(sf::Vector2f point, string name)
 {
-    sf::Vector2f diff = b.pos - a.pos;
-    return hypot(diff.x, diff.y);
+    if (!start_map_edit())
+    {
+        return NO_NODE;
+    }
+    NodeId node = add_node_edit(map_edits, wall_index, point, name);
+    finish_map_edit();
+    return node;
 }
 
 /**
- * Resets all data from previous Dijkstra's runs
+ * Removes a node from the loaded map, unlinking it from its neighbors
+ * @param node
  */
-void reset()
+void delete_node(NodeId node)
 {
-    // Reset All Nodes
-    list<MapNode>::iterator map_iterator;
-    for (
-            map_iterator = school_graph.begin();
-            map_iterator != school_graph.end();
-            ++map_iterator
-        )
+    if (!start_map_edit())
     {
-        map_iterator->visited = false;
-        map_iterator->cost = 1000000;
-        map_iterator->previous = nullptr;
+        return;
+    }
+    remove_node_edit(map_edits, node);
+    finish_map_edit();
+    if (start_node == node)
+    {
+        start_node = NO_NODE;
+    }
+    if (end_node == node)
+    {
+        end_node = NO_NODE;
     }
 }
 
 /**
- * Uses Dijkstra's Algorithm to find the shortest path between start and end node
- * Updates path pointers on every node in graph
+ * Finds the wall closest to a point
+ * @param point
+ * @param max_distance
+ * @return index of the wall in walls, walls.size() if none is within max_distance
  */
-void find_path_dijkstra()
+size_t nearest_wall(sf::Vector2f point, double max_distance)
 {
-    reset();
-    list<MapNode>::iterator map_iterator;
-    int num_nodes = total_num_nodes;
-
-    start_node->cost = 0;
-
-    // Loop Until All Nodes are Visited
-    while (num_nodes > 0)
-    {
-        // Visit Unvisited Node with the Least Cost
-        MapNode* current_node = nullptr;
-        for (
-                map_iterator = school_graph.begin();
-                map_iterator != school_graph.end();
-                ++map_iterator
-            )
-        {
-            if (
-                    !map_iterator->visited &&
-                    (
-                        current_node == nullptr ||
-                        (map_iterator->cost < current_node->cost)
-                    )
-               )
+    size_t nearest = walls.size();
+    for (size_t i = 0; i < walls.size(); i++)
+    {
+        double distance = distance_to_segment(
+            sf::Vector2<double>(point.x, point.y),
+            sf::Vector2<double>(walls[i].a.x, walls[i].a.y),
+            sf::Vector2<double>(walls[i].b.x, walls[i].b.y)
+        );
+        if (distance <= max_distance)
+        {
+            max_distance = distance;
+            nearest = i;
+        }
+    }
+    return nearest;
+}
+
+// Headless Batch Queries
+
+/**
+ * Answers every query in a file without opening a window and prints a report
+ * Each line of the file holds the names of a start and end node;
+ * blank lines and lines starting with # are skipped
+ * @param queries_path
+ * @return boolean whether the query file could be opened
+ */
+bool run_batch(const string& queries_path)
+{
+    ifstream queries_file = ifstream(queries_path);
+    if (!queries_file.is_open())
+    {
+        return false;
+    }
+
+    // Read Queries
+    unordered_map<string_view, NodeId> lookup = build_name_lookup(school_graph);
+    vector<RouteQuery> queries;
+    vector<pair<string, string>> query_names;
+    string line;
+    int line_number = 0;
+    while (getline(queries_file, line))
+    {
+        line_number++;
+        istringstream line_stream;
+        line_stream.str(line);
+        string from, to;
+        if (!(line_stream >> from) || from[0] == '#') continue;
+
+        if (!(line_stream >> to))
+        {
+            cout << "Line " << line_number << ": expected a start and end node" << endl;
+            continue;
+        }
+        auto start = lookup.find(from);
+        auto end = lookup.find(to);
+        if (start == lookup.end() || end == lookup.end())
+        {
+            cout << "Line " << line_number << ": unknown node "
+                 << (start == lookup.end() ? from : to) << endl;
+            continue;
+        }
+        queries.push_back(RouteQuery{start->second, end->second});
+        query_names.emplace_back(from, to);
+    }
+
+    // Answer Queries
+    BatchReport report;
+    vector<RouteResult> results = run_route_batch(routing_graph, route_table, hierarchy, queries, search_strategy, num_routes, worker_threads, report);
+
+    // Per-Query Results, With the Alternatives' Lengths Last
+    cout << "# from\tto\tlength_ft\tpath_nodes\tnodes_expanded\tlatency_us" << (num_routes > 1 ? "\talternatives_ft" : "") << endl;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        cout << query_names[i].first << '\t' << query_names[i].second << '\t';
+        if (results[i].num_path_nodes > 0)
+        {
+            cout << fixed << setprecision(1) << results[i].length * FEET_PER_PIXEL;
+        }
+        else
+        {
+            cout << "unreachable";
+        }
+        cout << '\t' << results[i].num_path_nodes
+             << '\t' << results[i].nodes_expanded
+             << '\t' << fixed << setprecision(1) << results[i].latency * 1e6;
+        if (num_routes > 1)
+        {
+            cout << '\t';
+            for (size_t j = 0; j < results[i].alternative_lengths.size(); j++)
+            {
+                cout << (j == 0 ? "" : ",") << results[i].alternative_lengths[j] * FEET_PER_PIXEL;
+            }
+        }
+        cout << endl;
+    }
+
+    // Totals
+    cout << "# search " << search_strategy_name(search_strategy)
+         << (route_table.empty() ? "" : " with route table")
+         << (hierarchy.empty() ? "" : " with contraction hierarchy")
+         << (num_routes > 1 ? ", routes per query " + to_string(num_routes) : "")
+         << (routing_profile == RoutingProfile::Shortest ? "" : ", routing " + string(routing_profile_name(routing_profile)))
+         << ", queries " << report.num_queries
+         << ", threads " << report.num_threads
+         << ", wall time " << setprecision(3) << report.wall_time * 1e3 << " ms"
+         << ", throughput " << setprecision(0) << report.throughput << " queries/s"
+         << ", p50 " << setprecision(1) << report.p50_latency * 1e6 << " us"
+         << ", p99 " << report.p99_latency * 1e6 << " us"
+         << ", mean nodes expanded " << report.mean_nodes_expanded << endl;
+    return true;
+}
+
+// Distance Tables
+
+/**
+ * Reads node names from a file, whitespace separated; # starts a comment line
+ * Every node with a listed name is included, so a room or exit with several
+ * doors counts all of them
+ * @param names_path
+ * @param nodes gets the nodes named
+ * @return boolean whether the file could be opened
+ */
+bool read_node_names(const string& names_path, vector<NodeId>& nodes)
+{
+    ifstream names_file = ifstream(names_path);
+    if (!names_file.is_open())
+    {
+        return false;
+    }
+    unordered_set<string> names;
+    string line;
+    while (getline(names_file, line))
+    {
+        istringstream line_stream(line);
+        string name;
+        while (line_stream >> name && name[0] != '#')
+        {
+            names.insert(name);
+        }
+    }
+
+    unordered_set<string> found;
+    for (NodeId node = 0; node < school_graph.node_count(); node++)
+    {
+        string name(school_graph.name(node));
+        if (school_graph.is_named(node) && names.count(name))
+        {
+            nodes.push_back(node);
+            found.insert(name);
+        }
+    }
+    for (const string& name : names)
+    {
+        if (!found.count(name))
+        {
+            cout << names_path << ": unknown node " << name << endl;
+        }
+    }
+    return true;
+}
+
+/**
+ * Finds the distance from a set of roots to every node, or to some targets,
+ * in one search and writes it as CSV
+ * @param roots
+ * @param targets nodes the search may stop after, empty for every node
+ * @param csv_path file to write, or empty for standard output
+ * @return boolean whether the CSV could be written
+ */
+bool run_search_tree(const vector<NodeId>& roots, const vector<NodeId>& targets, const string& csv_path)
+{
+    SearchTree tree;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    grow_search_tree(routing_graph, search_state, roots, targets, tree);
+    double search_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (csv_path.empty())
+    {
+        write_search_tree_csv(cout, school_graph, tree, FEET_PER_PIXEL);
+        return true;
+    }
+
+    ofstream csv_file = ofstream(csv_path, ios::binary);
+    if (!csv_file.is_open())
+    {
+        return false;
+    }
+    write_search_tree_csv(csv_file, school_graph, tree, FEET_PER_PIXEL);
+    size_t targets_reached = 0;
+    for (NodeId target : targets)
+    {
+        targets_reached += tree.root[target] != NO_NODE;
+    }
+    cout << "Wrote " << csv_path << ": " << tree.settled.size() << " nodes from " << roots.size() << " roots";
+    if (!targets.empty())
+    {
+        cout << ", " << targets_reached << " of " << targets.size() << " targets reached";
+    }
+    cout << ", one search in " << fixed << setprecision(3) << search_time * 1e3 << " ms" << endl;
+    return true;
+}
+
+// Map Images
+
+/**
+ * Reads a map image and writes its nodes and obstacle outlines as map text
+ * next to it (map6.png gives map6.txt)
+ * @param image_path
+ * @param tolerance how far obstacle outlines may move when simplified, in pixels
+ * @return boolean whether the image was read and the map text written
+ */
+bool compile_map_image_file(const string& image_path, double tolerance)
+{
+    sf::Image image;
+    if (!image.loadFromFile(image_path))
+    {
+        cout << "Unable to open map image" << endl;
+        return false;
+    }
+    CompiledMapImage compiled;
+    chrono::steady_clock::time_point compile_start = chrono::steady_clock::now();
+    compile_map_image(image.getPixelsPtr(), image.getSize().x, image.getSize().y, tolerance, worker_threads, compiled);
+    double compile_seconds = chrono::duration<double>(chrono::steady_clock::now() - compile_start).count();
+
+    string text_path = filesystem::path(image_path).replace_extension(".txt").string();
+    ofstream text_file = ofstream(text_path, ios::binary);
+    if (!text_file.is_open())
+    {
+        cout << "Unable to write map file " << text_path << endl;
+        return false;
+    }
+    text_file << "# compiled from " << image_path << ", outline tolerance " << tolerance << "\n";
+    write_map_image_text(text_file, compiled);
+
+    double megapixels = (double) image.getSize().x * image.getSize().y / 1e6;
+    cout << "Compiled " << image_path << " into " << text_path << ": "
+         << compiled.nodes.size() << " nodes, "
+         << compiled.wall_count() << " walls ("
+         << compiled.outlines.size() << " outlines), "
+         << fixed << setprecision(1) << megapixels / compile_seconds << " megapixels/s" << endl;
+    write_profile(text_path);
+    return true;
+}
+
+// Route Server
+
+atomic<bool> server_stopping(false); // set by Ctrl-C while serving
+
+/**
+ * Signal handler that stops the route server
+ */
+void stop_server(int)
+{
+    server_stopping = true;
+}
+
+/**
+ * Serves routes on the loaded map over HTTP until Ctrl-C
+ * @param port
+ * @return boolean whether the port could be listened on
+ */
+bool run_server(uint16_t port)
+{
+    vector<MapGraph> profile_graphs;
+    for (size_t profile = 0; profile < NUM_ROUTING_PROFILES; profile++)
+    {
+        profile_graphs.push_back(profile_weights.view(school_graph, (RoutingProfile) profile));
+    }
+    RouteService service{routing_graph, route_table, hierarchy, profile_graphs, search_strategy, build_name_lookup(school_graph), FEET_PER_PIXEL};
+    signal(SIGINT, stop_server);
+    signal(SIGTERM, stop_server);
+    cout << "Serving routes on http://127.0.0.1:" << port << "/route?from=&to= with "
+         << worker_thread_count(worker_threads) << " workers, search " << search_strategy_name(search_strategy)
+         << (route_table.empty() ? "" : " with route table")
+         << (hierarchy.empty() ? "" : " with contraction hierarchy")
+         << ", routing " << routing_profile_name(routing_profile) << endl;
+
+    size_t requests_served = 0;
+    if (!run_route_server(service, port, worker_threads, server_stopping, requests_served))
+    {
+        return false;
+    }
+    cout << "Served " << requests_served << " requests" << endl;
+    return true;
+}
+
+// Multi-Floor Sites
+
+SiteMap site; // floors and portals of a site, loaded floor by floor as routes need them
+
+/**
+ * Reads a site file into site, without loading any floor
+ * @param site_path
+ * @return boolean whether the file could be opened
+ */
+bool load_site(const string& site_path)
+{
+    ifstream site_file = ifstream(site_path);
+    if (!site_file.is_open())
+    {
+        return false;
+    }
+    size_t slash = site_path.find_last_of("/\\");
+    string directory = slash == string::npos ? "" : site_path.substr(0, slash + 1);
+    vector<MapTextError> errors;
+    read_site_text(site_file, directory, site, errors);
+    print_map_errors(site_path, errors);
+    return true;
+}
+
+/**
+ * Loads a floor of the site, reporting a map that cannot be read or has malformed lines
+ * @param floor_id
+ * @return boolean whether the floor is usable
+ */
+bool load_floor(uint32_t floor_id)
+{
+    SiteFloor& floor = site.floors[floor_id];
+    bool was_loaded = floor.loaded;
+    bool usable = load_site_floor(site, floor_id, worker_threads);
+    if (!was_loaded)
+    {
+        if (!usable)
+        {
+            cout << "Unable to open map file " << floor.map_path << " of floor " << floor.name << endl;
+        }
+        print_map_errors(floor.map_path, floor.errors);
+    }
+    return usable;
+}
+
+/**
+ * Finds a node given as floor:name
+ * Loads the floor if it is not loaded yet
+ * @param text
+ * @param place set to the node
+ * @return boolean whether the floor and node exist
+ */
+bool find_site_place(const string& text, SitePlace& place)
+{
+    size_t colon = text.find(':');
+    if (colon == string::npos)
+    {
+        return false;
+    }
+    place.floor = site.find_floor(string_view(text).substr(0, colon));
+    if (place.floor == NO_FLOOR || !load_floor(place.floor))
+    {
+        return false;
+    }
+    const SiteFloor& floor = site.floors[place.floor];
+    auto node = floor.lookup.find(string_view(text).substr(colon + 1));
+    if (node == floor.lookup.end())
+    {
+        return false;
+    }
+    place.node = node->second;
+    return true;
+}
+
+/**
+ * Answers routes between floors of the site, one query at a time
+ * Each line of the query file names a start and end node as floor:name
+ * Prints one line per query, then totals and the floors that were loaded
+ * @param queries_path
+ * @return boolean whether the query file could be opened
+ */
+bool run_site_batch(const string& queries_path)
+{
+    typedef chrono::steady_clock Clock;
+    ifstream queries_file = ifstream(queries_path);
+    if (!queries_file.is_open())
+    {
+        return false;
+    }
+
+    // Read Queries
+    vector<pair<SitePlace, SitePlace>> queries;
+    vector<pair<string, string>> query_names;
+    string line;
+    int line_number = 0;
+    while (getline(queries_file, line))
+    {
+        line_number++;
+        istringstream line_stream;
+        line_stream.str(line);
+        string from, to;
+        if (!(line_stream >> from) || from[0] == '#') continue;
+
+        if (!(line_stream >> to))
+        {
+            cout << "Line " << line_number << ": expected a start and end node" << endl;
+            continue;
+        }
+        SitePlace start, end;
+        bool start_found = find_site_place(from, start);
+        if (!start_found || !find_site_place(to, end))
+        {
+            cout << "Line " << line_number << ": unknown node " << (start_found ? to : from) << endl;
+            continue;
+        }
+        queries.emplace_back(start, end);
+        query_names.emplace_back(from, to);
+    }
+    size_t floors_before_queries = site.loaded_floor_count();
+
+    // Answer Queries
+    cout << "# from\tto\tlength_ft\tpath_nodes\tnodes_expanded\tlatency_us\tfloors" << endl;
+    SiteSearch search;
+    SiteRoute route;
+    vector<double> latencies;
+    double total_nodes_expanded = 0;
+    Clock::time_point batch_start = Clock::now();
+    for (size_t i = 0; i < queries.size(); i++)
+    {
+        Clock::time_point query_start = Clock::now();
+        find_site_route(site, search, queries[i].first, queries[i].second, worker_threads, route);
+        latencies.push_back(chrono::duration<double>(Clock::now() - query_start).count());
+        total_nodes_expanded += route.nodes_expanded;
+
+        cout << query_names[i].first << '\t' << query_names[i].second << '\t';
+        if (!route.path.empty())
+        {
+            cout << fixed << setprecision(1) << route.length * FEET_PER_PIXEL;
+        }
+        else
+        {
+            cout << "unreachable";
+        }
+        cout << '\t' << route.path.size()
+             << '\t' << route.nodes_expanded
+             << '\t' << fixed << setprecision(1) << latencies.back() * 1e6 << '\t';
+        for (size_t j = 0; j < route.path.size(); j++)
+        {
+            if (j == 0 || route.path[j].floor != route.path[j - 1].floor)
             {
-                current_node = &*map_iterator;
+                cout << (j == 0 ? "" : ">") << site.floors[route.path[j].floor].name;
             }
         }
-        current_node->visited = true;
-        num_nodes--;
+        cout << endl;
+    }
+    double wall_time = chrono::duration<double>(Clock::now() - batch_start).count();
+
+    // Totals
+    sort(latencies.begin(), latencies.end());
+    cout << "# site, queries " << queries.size()
+         << ", wall time " << setprecision(3) << wall_time * 1e3 << " ms"
+         << ", p50 " << setprecision(1) << latency_percentile(latencies, 0.50) * 1e6 << " us"
+         << ", p99 " << latency_percentile(latencies, 0.99) * 1e6 << " us"
+         << ", mean nodes expanded " << (queries.empty() ? 0 : total_nodes_expanded / queries.size()) << endl;
+    cout << "# floors loaded " << site.loaded_floor_count() << " of " << site.floors.size()
+         << " (" << site.loaded_floor_count() - floors_before_queries << " by routes through portals):";
+    for (const SiteFloor& floor : site.floors)
+    {
+        if (floor.usable)
+        {
+            cout << " " << floor.name << " (" << floor.graph.node_count() << " nodes)";
+        }
+    }
+    cout << endl;
 
-        // Loop Through Neighboring Nodes
-        list<MapNode*>::iterator neighbor_iterator;
-        for (
-                neighbor_iterator = current_node->neighbors.begin();
-                neighbor_iterator != current_node->neighbors.end();
-                ++neighbor_iterator
-            )
+    // Portals Whose Node Is Missing From a Loaded Floor
+    for (const SitePortal& portal : site.portals)
+    {
+        for (int side = 0; side < 2; side++)
         {
-            MapNode* neighbor = *neighbor_iterator;
+            if (site.floors[portal.floors[side]].usable && portal.nodes[side] == NO_NODE)
+            {
+                cout << "# portal on line " << portal.line << ": floor "
+                     << site.floors[portal.floors[side]].name << " has no node " << portal.names[side] << endl;
+            }
+        }
+    }
+    return true;
+}
 
-            // Ignore if Neighbor is Already visited
-            if (neighbor->visited)
+// Wall Check
+
+const size_t WALL_CHECK_SEGMENTS = 100000;
+
+/**
+ * Compares wall_index.is_obstructed() with checking every wall by itself
+ * Segments are picked at random from a fixed seed: node pairs, short hops
+ * from nodes and wall ends, wall ends joined to each other, pieces lying
+ * along walls (overlapping them or not), since touching and collinear
+ * segments are where the two could differ, and segments from points near
+ * walls moved by fractions of a pixel, since integer coordinates round
+ * the same whether or not multiplies and subtracts are fused
+ * @return number of segments the two disagree on
+ */
+size_t check_walls()
+{
+    mt19937_64 random(1);
+    auto pick = [&](size_t count) { return (size_t) (random() % count); };
+    auto wall_end = [&]() {
+        const Wall& wall = walls[pick(walls.size())];
+        return random() % 2 ? wall.a : wall.b;
+    };
+    auto along = [&](const Wall& wall) {
+        const float FRACTIONS[] = {-0.5f, 0.0f, 0.25f, 0.5f, 1.0f, 1.5f};
+        float t = FRACTIONS[pick(6)];
+        return wall.a + (wall.b - wall.a) * t;
+    };
+    auto along_wall = [&]() {
+        return along(walls[pick(walls.size())]);
+    };
+    auto node_point = [&]() {
+        return node_pos(pick(school_graph.node_count()));
+    };
+    auto nearby = [&](sf::Vector2f point) {
+        return point + sf::Vector2f((float) pick(61) - 30, (float) pick(61) - 30);
+    };
+    uniform_real_distribution<float> fraction(-1.0f, 1.0f);
+    auto perturbed = [&](sf::Vector2f point) {
+        return point + sf::Vector2f(fraction(random), fraction(random));
+    };
+
+    size_t num_mismatches = 0, num_obstructed = 0;
+    for (size_t i = 0; i < WALL_CHECK_SEGMENTS; i++)
+    {
+        sf::Vector2f a, b;
+        switch (i % 7)
+        {
+            case 0:
+                a = node_point();
+                b = node_point();
+                break;
+            case 1:
+                a = node_point();
+                b = nearby(a);
+                break;
+            case 2:
+                a = wall_end();
+                b = random() % 2 ? wall_end() : nearby(a);
+                break;
+            case 3:
+            {
+                const Wall& wall = walls[pick(walls.size())];
+                a = along(wall);
+                b = random() % 2 ? along(wall) : nearby(a);
+                break;
+            }
+            case 4:
+                a = along_wall();
+                b = a;
+                break;
+            case 5:
+                a = node_point();
+                b = random() % 2 ? wall_end() : along_wall();
+                break;
+            default:
+            {
+                // Through a Wall End or Along a Wall's Line, Give or Take Rounding
+                const Wall& wall = walls[pick(walls.size())];
+                a = random() % 2 ? perturbed(node_point()) : wall.a + (wall.b - wall.a) * fraction(random);
+                b = a + ((random() % 2 ? wall.a : wall.b) - a) * (1.5f + fraction(random) / 2);
+                break;
+            }
+        }
+
+        bool expected = crosses_any_wall(walls, a, b);
+        num_obstructed += expected;
+        if (wall_index.is_obstructed(a, b) != expected)
+        {
+            if (num_mismatches++ < 10)
+            {
+                cout << "Mismatch: (" << a.x << ", " << a.y << ") to (" << b.x << ", " << b.y << ")"
+                     << ", expected " << (expected ? "obstructed" : "clear") << endl;
+            }
+        }
+    }
+    cout << "Checked " << WALL_CHECK_SEGMENTS << " segments against " << walls.size() << " walls"
+         << " (" << wall_kernel_name() << " kernel, " << num_obstructed << " obstructed): "
+         << num_mismatches << " mismatches" << endl;
+    return num_mismatches;
+}
+
+// Edit Check
+
+const size_t EDIT_CHECK_EDITS = 400;
+const size_t EDIT_CHECK_INTERVAL = 100; // edits between comparisons with a full rebuild
+
+/**
+ * Compares the graph of a map changed by runtime edits with building it from scratch
+ * Edits are picked at random from a fixed seed: walls added between points
+ * near nodes, walls removed, unnamed nodes added and nodes removed. Every
+ * EDIT_CHECK_INTERVAL edits the graph is rebuilt from the map's nodes,
+ * walls and areas, and every node not removed must have the same
+ * neighbors, with the same edge lengths and flags
+ * @return number of nodes whose edges differ, over every comparison
+ */
+size_t check_edits()
+{
+    mt19937_64 random(1);
+    auto pick = [&](size_t count) { return (size_t) (random() % count); };
+    auto near_node = [&]() {
+        return node_pos(pick(school_graph.node_count())) + sf::Vector2f((float) pick(61) - 30, (float) pick(61) - 30);
+    };
+
+    size_t num_mismatches = 0;
+    for (size_t edit = 1; edit <= EDIT_CHECK_EDITS; edit++)
+    {
+        switch (edit % 4)
+        {
+            case 0:
+            {
+                sf::Vector2f a = near_node(), b = near_node();
+                if (a != b)
+                {
+                    insert_wall(a, b);
+                }
+                break;
+            }
+            case 1:
+                if (!walls.empty())
+                {
+                    delete_wall(pick(walls.size()));
+                }
+                break;
+            case 2:
+                insert_node(near_node(), " ");
+                break;
+            default:
+                delete_node(pick(school_graph.node_count()));
+                break;
+        }
+        if (edit % EDIT_CHECK_INTERVAL != 0)
+        {
+            continue;
+        }
+
+        // Rebuild From Scratch
+        MapGraphStorage rebuilt;
+        for (NodeId node = 0; node < school_graph.node_count(); node++)
+        {
+            rebuilt.add_node(school_graph.x[node], school_graph.y[node], school_graph.name(node));
+        }
+        build_visibility_graph(rebuilt, wall_index, worker_threads);
+        flag_edges(rebuilt, areas);
+        MapGraph expected_graph = rebuilt.view();
+
+        // Removed Nodes Keep Their Ids Without Edges, so Only the Others Are Compared
+        for (NodeId node = 0; node < school_graph.node_count(); node++)
+        {
+            if (map_edits.removed[node])
             {
                 continue;
             }
+            vector<tuple<NodeId, float, EdgeFlags>> expected, found;
+            for (uint32_t edge = expected_graph.offsets[node]; edge < expected_graph.offsets[node + 1]; edge++)
+            {
+                if (!map_edits.removed[expected_graph.targets[edge]])
+                {
+                    expected.emplace_back(expected_graph.targets[edge], expected_graph.lengths[edge], expected_graph.flags[edge]);
+                }
+            }
+            for (uint32_t edge = school_graph.offsets[node]; edge < school_graph.offsets[node + 1]; edge++)
+            {
+                found.emplace_back(school_graph.targets[edge], school_graph.lengths[edge], school_graph.flags[edge]);
+            }
+            sort(expected.begin(), expected.end());
+            sort(found.begin(), found.end());
+            if (found != expected && num_mismatches++ < 10)
+            {
+                cout << "Mismatch after " << edit << " edits: node " << node << " has "
+                     << found.size() << " edges, expected " << expected.size() << endl;
+            }
+        }
+    }
+    cout << "Checked " << EDIT_CHECK_EDITS << " edits against " << EDIT_CHECK_EDITS / EDIT_CHECK_INTERVAL
+         << " rebuilds of " << school_graph.node_count() << " nodes: " << num_mismatches << " mismatches" << endl;
+    return num_mismatches;
+}
+
+// Contraction Hierarchy Check
 
-            // If the previously determined path to this neighbor is longer
-            // than going through the current node,
-            // update the path to the neighbor
-            double distance_through =
-                    current_node->cost + distance(*current_node, *neighbor);
+const size_t HIERARCHY_CHECK_QUERIES = 2000;
 
-            if (distance_through < neighbor->cost)
+/**
+ * Compares routes through the contraction hierarchy with plain Dijkstra
+ * Node pairs are picked at random from a fixed seed. A route matches if
+ * it has exactly the same length, counted along the unpacked path's graph
+ * edges, so a shortcut unpacked into anything but real edges shows up too
+ * @return number of pairs the two disagree on
+ */
+size_t check_hierarchy()
+{
+    typedef chrono::steady_clock Clock;
+    mt19937_64 random(1);
+    SearchState dijkstra_state, hierarchy_state, backward_state;
+    double dijkstra_seconds = 0, hierarchy_seconds = 0;
+    size_t num_mismatches = 0;
+    for (size_t i = 0; i < HIERARCHY_CHECK_QUERIES; i++)
+    {
+        NodeId from = random() % school_graph.node_count();
+        NodeId to = random() % school_graph.node_count();
+
+        Clock::time_point dijkstra_start = Clock::now();
+        find_path_dijkstra(school_graph, dijkstra_state, from, to);
+        Clock::time_point hierarchy_start = Clock::now();
+        find_path_hierarchy(hierarchy, school_graph, hierarchy_state, backward_state, from, to);
+        Clock::time_point hierarchy_end = Clock::now();
+        dijkstra_seconds += chrono::duration<double>(hierarchy_start - dijkstra_start).count();
+        hierarchy_seconds += chrono::duration<double>(hierarchy_end - hierarchy_start).count();
+
+        double expected = dijkstra_state.is_visited(to) ? dijkstra_state.get_cost(to) : UNREACHED_COST;
+        double found = hierarchy_state.is_visited(to) ? hierarchy_state.get_cost(to) : UNREACHED_COST;
+        if (found != expected)
+        {
+            if (num_mismatches++ < 10)
             {
-                neighbor->cost = distance_through;
-                neighbor->previous = current_node;
+                cout << "Mismatch: " << from << " to " << to << ", expected " << setprecision(10) << expected
+                     << ", found " << found << endl;
             }
         }
     }
+    cout << "Checked " << HIERARCHY_CHECK_QUERIES << " routes (" << hierarchy.num_shortcuts << " shortcuts): "
+         << num_mismatches << " mismatches" << endl;
+    cout << "Mean latency: dijkstra " << fixed << setprecision(1) << dijkstra_seconds * 1e6 / HIERARCHY_CHECK_QUERIES << " us"
+         << ", hierarchy " << hierarchy_seconds * 1e6 / HIERARCHY_CHECK_QUERIES << " us" << endl;
+    return num_mismatches;
 }
 
 // SFML Drawing Functions
 
 bool DEBUG_UI = false;
+const double HOVER_DISTANCE = 20; // how close the cursor must be to a named node to pick it
+const double SNAP_DISTANCE = 60; // how far a debug mode click may snap to a node
+const double WALL_PICK_DISTANCE = 10; // how close the cursor must be to a wall to delete it
+const double NODE_PICK_DISTANCE = 10; // how close the cursor must be to a node to delete it
+// (these are in screen pixels, so they are scaled by the zoom before use)
+const float MIN_VIEW_SCALE = 0.125f; // map pixels per screen pixel, zoomed all the way in
+const float ZOOM_STEP = 1.25f; // view size change per mouse wheel notch
+MapLayers map_layers; // batched map geometry, rebuilt when map_changed is set
+const sf::Color PATH_COLOR = sf::Color(154, 154, 255);
+const sf::Color ALTERNATIVE_COLORS[] = { // second, third, ... shortest routes, repeating after the last
+    sf::Color(255, 170, 70),
+    sf::Color(110, 210, 110),
+    sf::Color(235, 110, 200),
+    sf::Color(240, 220, 90)
+};
 
 /**
  * Draws a line with specified endpoints and thickness
@@ -332,43 +1280,10 @@ void draw_line(
     sf::Color color
 )
 {
-    sf::ConvexShape line = sf::ConvexShape();
-    line.setPointCount(4);
-
-    // Define Variables for Convenience
-    double x1 = pt1.x;
-    double y1 = pt1.y;
-    double x2 = pt2.x;
-    double y2 = pt2.y;
-
-    double theta = atan2(y2 - y1, x2 - x1);
-    double s = sin(theta);
-    double c = cos(theta);
-    double t = thickness / 2;
-
-    // Defining Line Corner Points
-    line.setPoint(0, sf::Vector2f(x1 + t*s, y1 - t*c));
-    line.setPoint(1, sf::Vector2f(x2 + t*s, y2 - t*c));
-    line.setPoint(2, sf::Vector2f(x2 - t*s, y2 + t*c));
-    line.setPoint(3, sf::Vector2f(x1 - t*s, y1 + t*c));
-
-    // Drawing Line
-    line.setFillColor(color);
+    PROFILE_SCOPE(DrawLine);
+    sf::VertexArray line = sf::VertexArray(sf::Triangles);
+    append_line(line, pt1, pt2, thickness, color);
     win.draw(line);
-
-    // Endpoint Circle 1
-    sf::CircleShape circle1 = sf::CircleShape();
-    circle1.setRadius(t);
-    circle1.setPosition(sf::Vector2f(x1 - t, y1 - t));
-    circle1.setFillColor(color);
-    win.draw(circle1);
-
-    // Endpoint Circle 2
-    sf::CircleShape circle2 = sf::CircleShape();
-    circle2.setRadius(t);
-    circle2.setPosition(sf::Vector2f(x2 - t, y2 - t));
-    circle2.setFillColor(color);
-    win.draw(circle2);
 }
 
 /**
@@ -377,41 +1292,24 @@ void draw_line(
  */
 void display_map(sf::RenderWindow& win)
 {
-    // Draw Obstacles if Debug Mode
-    if (DEBUG_UI)
+    PROFILE_SCOPE(DisplayMap);
+    sf::FloatRect area = view_area(win.getView());
+    // Rebuild Batches After the Map Changes
+    if (map_changed)
     {
-        list<Wall>::iterator obstacle_iterator;
-        for (
-                obstacle_iterator = walls.begin();
-                obstacle_iterator != walls.end();
-                ++obstacle_iterator
-            )
-        {
-            // Draw Obstacle Line
-            sf::Vertex line[2];
-            line[0] = sf::Vertex(obstacle_iterator->a, sf::Color::Red);
-            line[1] = sf::Vertex(obstacle_iterator->b, sf::Color::Red);
-            win.draw(line, 2, sf::Lines);
-        }
+        map_layers.build(school_graph, walls);
+        map_changed = false;
     }
 
-    // Draw Intermediate Nodes if Debug Mode and Endpoint Modes
-    list<MapNode>::iterator map_iterator;
-    for (
-            map_iterator = school_graph.begin();
-            map_iterator != school_graph.end();
-            ++map_iterator
-        )
+    // Draw Obstacles and Intermediate Nodes if Debug Mode
+    if (DEBUG_UI)
     {
-        if (map_iterator->name != " " || DEBUG_UI)
-        {
-            sf::CircleShape node_circle = sf::CircleShape();
-            node_circle.setRadius(5);
-            node_circle.setPosition(map_iterator->pos - sf::Vector2f(5, 5));
-            node_circle.setFillColor(sf::Color::White);
-            win.draw(node_circle);
-        }
+        map_layers.walls.draw(win, area);
+        map_layers.waypoint_nodes.draw(win, area);
     }
+
+    // Draw Endpoint Nodes
+    map_layers.named_nodes.draw(win, area);
 }
 
 /**
@@ -420,34 +1318,384 @@ void display_map(sf::RenderWindow& win)
  */
 void display_graph(sf::RenderWindow& win)
 {
-    // Loop for Every Node
-    list<MapNode>::iterator map_iterator;
-    for (
-            map_iterator = school_graph.begin();
-            map_iterator != school_graph.end();
-            ++map_iterator
-        )
+    PROFILE_SCOPE(DisplayGraph);
+    map_layers.edges.draw(win, view_area(win.getView()));
+}
+
+/**
+ * @param view
+ * @param win
+ * @return map pixels per screen pixel
+ */
+float view_scale(const sf::View& view, const sf::RenderWindow& win)
+{
+    return view.getSize().x / win.getSize().x;
+}
+
+/**
+ * Shows the whole map, centered in the window
+ * @param view
+ * @param win
+ * @param map_size
+ */
+void fit_view(sf::View& view, const sf::RenderWindow& win, sf::Vector2f map_size)
+{
+    float scale = max(map_size.x / win.getSize().x, map_size.y / win.getSize().y);
+    view.setCenter(map_size / 2.0f);
+    view.setSize(sf::Vector2f(win.getSize()) * scale);
+}
+
+/**
+ * Zooms the view, keeping the map point under the cursor in place
+ * @param view
+ * @param win
+ * @param cursor position in the window
+ * @param factor view size change, below 1 to zoom in
+ * @param max_scale most map pixels per screen pixel allowed
+ */
+void zoom_view(sf::View& view, const sf::RenderWindow& win, sf::Vector2i cursor, float factor, float max_scale)
+{
+    float scale = view_scale(view, win);
+    factor = clamp(scale * factor, MIN_VIEW_SCALE, max_scale) / scale;
+    sf::Vector2f before = win.mapPixelToCoords(cursor, view);
+    view.zoom(factor);
+    view.move(before - win.mapPixelToCoords(cursor, view));
+}
+
+int main(int argc, char* argv[]) {
+    // Read Command Line Options
+    string map_path = MAP_PATH;
+    string site_path;
+    string batch_path;
+    string background_path = BACKGROUND_PATH;
+    bool compile_only = false;
+    bool tile_only = false;
+    int serve_port = -1;
+    string image_path;
+    double outline_tolerance = DEFAULT_OUTLINE_TOLERANCE;
+    bool check_walls_only = false;
+    bool check_edits_only = false;
+    string nearest_path; // roots of a distance table, by name
+    string from_name; // single root of a distance table
+    string to_path; // targets of a distance table, by name
+    string csv_path;
+    bool check_hierarchy_only = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string option = argv[i];
+        if (option == "--compile")
+        {
+            compile_only = true;
+        }
+        else if (option == "--map" && i + 1 < argc)
+        {
+            map_path = argv[++i];
+        }
+        else if (option == "--site" && i + 1 < argc)
+        {
+            site_path = argv[++i];
+        }
+        else if (option == "--background" && i + 1 < argc)
+        {
+            background_path = argv[++i];
+        }
+        else if (option == "--serve" && i + 1 < argc)
+        {
+            serve_port = stoi(argv[++i]);
+        }
+        else if (option == "--from-image" && i + 1 < argc)
+        {
+            image_path = argv[++i];
+        }
+        else if (option == "--tolerance" && i + 1 < argc)
+        {
+            outline_tolerance = stod(argv[++i]);
+        }
+        else if (option == "--nearest" && i + 1 < argc)
+        {
+            nearest_path = argv[++i];
+        }
+        else if (option == "--from" && i + 1 < argc)
+        {
+            from_name = argv[++i];
+        }
+        else if (option == "--to" && i + 1 < argc)
+        {
+            to_path = argv[++i];
+        }
+        else if (option == "--csv" && i + 1 < argc)
+        {
+            csv_path = argv[++i];
+        }
+        else if (option == "--tile")
+        {
+            tile_only = true;
+        }
+        else if (option == "--batch" && i + 1 < argc)
+        {
+            batch_path = argv[++i];
+        }
+        else if (option == "--threads" && i + 1 < argc)
+        {
+            worker_threads = stoul(argv[++i]);
+        }
+        else if (option == "--profile" && i + 1 < argc)
+        {
+            profile_path = argv[++i];
+        }
+        else if (option == "--routes")
+        {
+            use_route_table = true;
+        }
+        else if (option == "--check-walls")
+        {
+            check_walls_only = true;
+        }
+        else if (option == "--check-edits")
+        {
+            check_edits_only = true;
+        }
+        else if (option == "--hierarchy")
+        {
+            use_hierarchy = true;
+        }
+        else if (option == "--check-hierarchy")
+        {
+            check_hierarchy_only = true;
+        }
+        else if (option == "--reduce")
+        {
+            reduce_graph = true;
+        }
+        else if (option == "--alternatives" && i + 1 < argc)
+        {
+            num_routes = max(1ul, stoul(argv[++i]));
+        }
+        else if (option == "--search" && i + 1 < argc && parse_search_strategy(argv[i + 1], search_strategy))
+        {
+            i++;
+        }
+        else if (option == "--routing" && i + 1 < argc && parse_routing_profile(argv[i + 1], routing_profile))
+        {
+            i++;
+        }
+        else
+        {
+            cout << "Usage: MissionMaps [--map file] [--threads n] [--search dijkstra|astar|bidirectional] [--routing shortest|accessible|indoor|night] [--alternatives k] [--routes] [--hierarchy] [--reduce] [--background image] [--profile report.json] [--compile | --tile | --batch queries | --serve port | --check-walls | --check-edits | --check-hierarchy]" << endl;
+            cout << "       MissionMaps [--map file] [--routing profile] --nearest exits.txt | --from node [--to rooms.txt] [--csv table.csv]" << endl;
+            cout << "       MissionMaps --from-image map.png [--tolerance pixels] [--threads n]" << endl;
+            cout << "       MissionMaps --site site.txt [--threads n] [--profile report.json] --compile | --batch queries" << endl;
+            return 1;
+        }
+    }
+
+    // Sites Are Only Routed in Batch, Floor by Floor
+    if (!site_path.empty())
+    {
+        if (!load_site(site_path))
+        {
+            cout << "Unable to open site file" << endl;
+            return 1;
+        }
+        if (compile_only)
+        {
+            for (uint32_t floor = 0; floor < site.floors.size(); floor++)
+            {
+                load_floor(floor);
+            }
+            cout << "Compiled " << site.loaded_floor_count() << " of " << site.floors.size() << " floors of " << site_path << endl;
+        }
+        else if (batch_path.empty())
+        {
+            cout << "--site needs --compile or --batch" << endl;
+            return 1;
+        }
+        else if (!run_site_batch(batch_path))
+        {
+            cout << "Unable to open query file" << endl;
+            return 1;
+        }
+        write_profile(site_path);
+        return 0;
+    }
+
+    // Turn a Map Image Into Map Text
+    if (!image_path.empty())
     {
-        sf::Vertex node_vertex = sf::Vertex(map_iterator->pos, sf::Color::Yellow);
+        return compile_map_image_file(image_path, outline_tolerance) ? 0 : 1;
+    }
 
-        // Loop for Every Neighboring Node
-        list<MapNode*>::iterator neighbor_iterator;
-        for (
-                neighbor_iterator = map_iterator->neighbors.begin();
-                neighbor_iterator != map_iterator->neighbors.end();
-                ++neighbor_iterator
-            )
+    // Cut the Background Into Tiles Without Opening a Window
+    if (tile_only)
+    {
+        uint64_t checksum;
+        TilePyramid pyramid;
+        if (!checksum_file(background_path, checksum) || !build_tile_pyramid(background_path, checksum, pyramid))
         {
-            // Draw Line from Node to Neighboring Node
-            sf::Vertex line[2];
-            line[0] = sf::Vertex((*neighbor_iterator)->pos, sf::Color::Yellow);
-            line[1] = node_vertex;
-            win.draw(line, 2, sf::Lines);
+            cout << "Unable to tile background image" << endl;
+            return 1;
         }
+        cout << "Tiled " << background_path << ": "
+             << pyramid.width << "x" << pyramid.height << " pixels, "
+             << pyramid.levels << " levels" << endl;
+        write_profile(map_path);
+        return 0;
+    }
+
+    // Compile Map Without Opening a Window
+    if (compile_only)
+    {
+        uint64_t checksum;
+        if (!checksum_file(map_path, checksum) || !compile_map(map_path, checksum))
+        {
+            cout << "Unable to open map file" << endl;
+            return 1;
+        }
+        cout << "Compiled " << map_path << ": "
+             << school_graph.node_count() << " nodes, "
+             << school_graph.edge_count() / 2 << " edges, "
+             << walls.size() << " walls" << endl;
+        if (use_route_table)
+        {
+            load_route_table(map_path);
+            cout << "Route table: " << route_table.places.size() << " places" << endl;
+        }
+        write_profile(map_path);
+        return 0;
+    }
+
+    // Compare the Wall Index With Checking Every Wall
+    if (check_walls_only)
+    {
+        if (!load_map(map_path))
+        {
+            cout << "Unable to open map file" << endl;
+            return 1;
+        }
+        return check_walls() == 0 ? 0 : 1;
+    }
+
+    // Compare Runtime Edits With Rebuilding the Graph
+    if (check_edits_only)
+    {
+        if (reduce_graph)
+        {
+            cout << "Unable to edit a reduced graph; run without --reduce" << endl;
+            return 1;
+        }
+        if (!load_map(map_path))
+        {
+            cout << "Unable to open map file" << endl;
+            return 1;
+        }
+        return check_edits() == 0 ? 0 : 1;
+    }
+
+    // Compare the Contraction Hierarchy With Plain Dijkstra
+    if (check_hierarchy_only)
+    {
+        if (!load_map(map_path))
+        {
+            cout << "Unable to open map file" << endl;
+            return 1;
+        }
+        build_contraction_hierarchy(hierarchy, school_graph);
+        size_t num_mismatches = check_hierarchy();
+        write_profile(map_path);
+        return num_mismatches == 0 ? 0 : 1;
+    }
+
+    // Answer Queries Over HTTP Without Opening a Window
+    if (serve_port >= 0)
+    {
+        if (!load_map(map_path))
+        {
+            cout << "Unable to open map file" << endl;
+            return 1;
+        }
+        if (use_route_table)
+        {
+            load_route_table(map_path);
+        }
+        if (use_hierarchy)
+        {
+            build_contraction_hierarchy(hierarchy, school_graph);
+        }
+        if (!run_server(serve_port))
+        {
+            cout << "Unable to listen on port " << serve_port << endl;
+            return 1;
+        }
+        write_profile(map_path);
+        return 0;
+    }
+
+    // Distance Tables From Several Roots or to Several Targets in One Search
+    if (!nearest_path.empty() || !from_name.empty())
+    {
+        if (!load_map(map_path))
+        {
+            cout << "Unable to open map file" << endl;
+            return 1;
+        }
+        vector<NodeId> roots, targets;
+        if (!nearest_path.empty() && !read_node_names(nearest_path, roots))
+        {
+            cout << "Unable to open node list " << nearest_path << endl;
+            return 1;
+        }
+        for (NodeId node = 0; node < school_graph.node_count() && !from_name.empty(); node++)
+        {
+            if (school_graph.name(node) == from_name)
+            {
+                roots.push_back(node);
+                break;
+            }
+        }
+        if (!to_path.empty() && !read_node_names(to_path, targets))
+        {
+            cout << "Unable to open node list " << to_path << endl;
+            return 1;
+        }
+        if (roots.empty())
+        {
+            cout << "No known node to start from" << endl;
+            return 1;
+        }
+        if (!run_search_tree(roots, targets, csv_path))
+        {
+            cout << "Unable to write " << csv_path << endl;
+            return 1;
+        }
+        write_profile(map_path);
+        return 0;
+    }
+
+    // Answer Queries Without Opening a Window
+    if (!batch_path.empty())
+    {
+        if (!load_map(map_path))
+        {
+            cout << "Unable to open map file" << endl;
+            return 1;
+        }
+        if (use_route_table)
+        {
+            load_route_table(map_path);
+        }
+        if (use_hierarchy)
+        {
+            build_contraction_hierarchy(hierarchy, school_graph);
+        }
+        if (!run_batch(batch_path))
+        {
+            cout << "Unable to open query file" << endl;
+            return 1;
+        }
+        write_profile(map_path);
+        return 0;
     }
-}
 
-int main() {
     // Load Files
     sf::Image icon = sf::Image();
     if (!icon.loadFromFile("../icon.png"))
@@ -456,13 +1704,15 @@ int main() {
         return 1;
     }
 
-    sf::Texture background_image = sf::Texture();
-    if (!background_image.loadFromFile("../blank_map.png"))
+    // Background Is Drawn From Tiles, Cut From the Image Once and Reused After
+    TilePyramid pyramid;
+    if (!load_tile_pyramid(background_path, pyramid))
     {
         cout << "Unable to open background image" << endl;
         return 1;
     }
-    sf::Sprite background = sf::Sprite(background_image);
+    unique_ptr<TileStreamer> background = make_unique<TileStreamer>(pyramid);
+    sf::Vector2f map_size(pyramid.width, pyramid.height);
 
     sf::Font ARIAL;
     if (!ARIAL.loadFromFile("../arial.ttf"))
@@ -471,16 +1721,26 @@ int main() {
         return 1;
     }
 
-    ifstream map_file = ifstream("../mission.txt");
-    if (!map_file.is_open())
+    if (!load_map(map_path))
     {
         cout << "Unable to open map file" << endl;
         return 1;
     }
+    if (use_route_table)
+    {
+        load_route_table(map_path);
+    }
+    if (use_hierarchy)
+    {
+        build_contraction_hierarchy(hierarchy, school_graph);
+    }
+    index_nodes();
 
-    // Create Window
+    // Create Window, as Big as the Map Unless the Screen Is Smaller
+    sf::VideoMode desktop = sf::VideoMode::getDesktopMode();
+    float window_fit = min({1.0f, desktop.width * 0.9f / map_size.x, desktop.height * 0.9f / map_size.y});
     sf::RenderWindow window(
-            sf::VideoMode(1418, 1221),
+            sf::VideoMode(max(1u, (unsigned) (map_size.x * window_fit)), max(1u, (unsigned) (map_size.y * window_fit))),
             "Mission Maps"
     );
     window.setIcon(
@@ -491,60 +1751,10 @@ int main() {
     window.setActive();
     window.setFramerateLimit(30);
 
-    // Load Map from File
-    string line;
-    while (getline(map_file, line))
-    {
-        // Ignore Short Lines
-        if (line.length() < 3) continue;
-
-        // Get Command
-        char cmd = line[0];
-        line.erase(0, 2);
-
-        // Create String Stream
-        istringstream line_stream;
-        line_stream.str(line);
-        float x, y, x2, y2;
-        string name;
-
-        // Do Things Depending on Command
-        switch (cmd)
-        {
-            case '#': // Comment
-                break;
-            case 'o': // Line Obstacle
-                line_stream >> x >> y >> x2 >> y2;
-                add_wall(sf::Vector2f(x, y), sf::Vector2f(x2, y2));
-                break;
-            case 'b': // Box Obstacle
-                line_stream >> x >> y >> x2 >> y2;
-                add_wall(sf::Vector2f(x, y), sf::Vector2f(x2, y));
-                add_wall(sf::Vector2f(x2, y), sf::Vector2f(x2, y2));
-                add_wall(sf::Vector2f(x, y), sf::Vector2f(x, y2));
-                add_wall(sf::Vector2f(x, y2), sf::Vector2f(x2, y2));
-                break;
-            case 'n': // Normal Node
-                line_stream >> x >> y;
-                add_node(sf::Vector2f(x, y));
-                break;
-            case 'N': // Normal Named Node
-                line_stream >> x >> y >> name;
-                add_node(sf::Vector2f(x, y), name);
-                break;
-            case 's': // Start Node
-                line_stream >> x >> y;
-                start_node = add_node(sf::Vector2f(x, y));
-                break;
-            case 'e': // End Node
-                line_stream >> x >> y;
-                end_node = add_node(sf::Vector2f(x, y));
-                break;
-            default: // Unknown Command
-                cout << "UNKNOWN CMD: " << cmd << " (" << line << ")" << endl;
-        }
-    }
-    map_file.close();
+    // The Map Pans and Zooms; Text Stays Put in Window Pixels
+    sf::View map_view;
+    fit_view(map_view, window, map_size);
+    sf::View ui_view(sf::FloatRect(0, 0, window.getSize().x, window.getSize().y));
 
     // Debug Mode Indicator
     sf::Text debug_indicator;
@@ -558,42 +1768,45 @@ int main() {
     // Variables
     sf::Clock clock;
     double path_time = 0;
-    MapNode* nearest_node = nullptr;
+    NodeId nearest_node = NO_NODE;
     bool shift_down = false;
+    sf::Vector2f mouse_pos; // in map pixels
+    sf::Vector2i mouse_pixel; // in window pixels
+    bool panning = false;
+    sf::Vector2f wall_start; // where the wall being drawn in debug mode begins
+    bool drawing_wall = false;
 
     // Loop Until Program Ends
     while (window.isOpen())
     {
         // Set Background Based on UI Mode
         window.clear(sf::Color::Black);
-        if (DEBUG_UI)
-        {
-            window.draw(debug_indicator);
-        }
-        else
+        window.setView(map_view);
+        if (!DEBUG_UI)
         {
-            window.draw(background);
+            PROFILE_SCOPE(DisplayBackground);
+            background->draw(window);
         }
 
         // Display Map
         display_map(window);
 
         // Draw Start Node
-        if (start_node != nullptr)
+        if (start_node != NO_NODE)
         {
             sf::CircleShape start_circle = sf::CircleShape();
             start_circle.setRadius(8);
-            start_circle.setPosition(start_node->pos - sf::Vector2f(8, 8));
+            start_circle.setPosition(node_pos(start_node) - sf::Vector2f(8, 8));
             start_circle.setFillColor(sf::Color::Red);
             window.draw(start_circle);
         }
 
         // Draw End Node
-        if (end_node != nullptr)
+        if (end_node != NO_NODE)
         {
             sf::CircleShape end_circle = sf::CircleShape();
             end_circle.setRadius(8);
-            end_circle.setPosition(end_node->pos - sf::Vector2f(8, 8));
+            end_circle.setPosition(node_pos(end_node) - sf::Vector2f(8, 8));
             end_circle.setFillColor(sf::Color::Green);
             window.draw(end_circle);
         }
@@ -623,6 +1836,60 @@ int main() {
                     {
                         shift_down = true;
                     }
+
+                    // Pan With Arrow Keys, Home Shows the Whole Map
+                    else if (event.key.code == sf::Keyboard::Left || event.key.code == sf::Keyboard::Right)
+                    {
+                        map_view.move((event.key.code == sf::Keyboard::Left ? -0.1f : 0.1f) * map_view.getSize().x, 0);
+                    }
+                    else if (event.key.code == sf::Keyboard::Up || event.key.code == sf::Keyboard::Down)
+                    {
+                        map_view.move(0, (event.key.code == sf::Keyboard::Up ? -0.1f : 0.1f) * map_view.getSize().y);
+                    }
+                    else if (event.key.code == sf::Keyboard::Home)
+                    {
+                        fit_view(map_view, window, map_size);
+                    }
+
+                    // Switch to the Next Routing Profile and Find the Route Again
+                    else if (event.key.code == sf::Keyboard::Tab)
+                    {
+                        routing_profile = (RoutingProfile) (((size_t) routing_profile + 1) % NUM_ROUTING_PROFILES);
+                        routing_graph = profile_weights.view(school_graph, routing_profile);
+                        if (start_node != NO_NODE && end_node != NO_NODE)
+                        {
+                            clock.restart();
+                            find_path();
+                            path_time = clock.getElapsedTime().asMicroseconds() / 1000.0;
+                        }
+                    }
+
+                    // Remove the Wall Under the Cursor in Debug Mode, or the Node With Left Shift
+                    else if (event.key.code == sf::Keyboard::Delete && DEBUG_UI && shift_down)
+                    {
+                        NodeId node = node_index.nearest(school_graph, mouse_pos.x, mouse_pos.y, NODE_PICK_DISTANCE * view_scale(map_view, window), [](NodeId node) {
+                            return !map_edited || !map_edits.removed[node];
+                        });
+                        if (node != NO_NODE)
+                        {
+                            delete_node(node);
+                            nearest_node = NO_NODE;
+                        }
+                    }
+                    else if (event.key.code == sf::Keyboard::Delete && DEBUG_UI)
+                    {
+                        size_t wall_id = nearest_wall(mouse_pos, WALL_PICK_DISTANCE * view_scale(map_view, window));
+                        if (wall_id < walls.size())
+                        {
+                            delete_wall(wall_id);
+                        }
+                    }
+
+                    // Add an Unnamed Node Under the Cursor in Debug Mode
+                    else if (event.key.code == sf::Keyboard::Insert && DEBUG_UI)
+                    {
+                        insert_node(mouse_pos, " ");
+                    }
                     break;
                 case sf::Event::KeyReleased:
                     // Update Shift State Variable
@@ -641,6 +1908,18 @@ int main() {
                     // Set Start/End Node
                     if (event.mouseButton.button == sf::Mouse::Left)
                     {
+                        // Away From Named Nodes, Snap to Any Node in Debug Mode
+                        // and Route From/To the Clicked Point Otherwise
+                        sf::Vector2f click = window.mapPixelToCoords(sf::Vector2i(event.mouseButton.x, event.mouseButton.y), map_view);
+                        if (nearest_node == NO_NODE && DEBUG_UI)
+                        {
+                            nearest_node = snap_to_node(click, SNAP_DISTANCE * view_scale(map_view, window));
+                        }
+                        else if (nearest_node == NO_NODE)
+                        {
+                            nearest_node = place_point(click, shift_down);
+                        }
+
                         if (shift_down)
                         {
                             set_start = true;
@@ -650,57 +1929,108 @@ int main() {
                             set_end = true;
                         }
                     }
+
+                    // Start Drawing a Wall in Debug Mode
+                    else if (event.mouseButton.button == sf::Mouse::Right && DEBUG_UI)
+                    {
+                        wall_start = window.mapPixelToCoords(sf::Vector2i(event.mouseButton.x, event.mouseButton.y), map_view);
+                        drawing_wall = true;
+                    }
+
+                    // Drag the Map With the Middle Button
+                    else if (event.mouseButton.button == sf::Mouse::Middle)
+                    {
+                        panning = true;
+                    }
                     break;
-                case sf::Event::MouseMoved:
-                    // Find the Nearest Node to Mouse Cursor
-                    float min_dist = 100000; // Arbitrary Large Number
-                    list<MapNode>::iterator map_iterator;
-                    for (
-                            map_iterator = school_graph.begin();
-                            map_iterator != school_graph.end();
-                            ++map_iterator
-                        )
+                case sf::Event::MouseButtonReleased:
+                    // Add the Drawn Wall
+                    if (event.mouseButton.button == sf::Mouse::Right && drawing_wall)
                     {
-                        if (map_iterator->name != " ")
+                        sf::Vector2f wall_end = window.mapPixelToCoords(sf::Vector2i(event.mouseButton.x, event.mouseButton.y), map_view);
+                        if (wall_end != wall_start)
                         {
-                            float dist = hypot(
-                                    map_iterator->pos.x - event.mouseMove.x,
-                                    map_iterator->pos.y - event.mouseMove.y
-                                    );
-                            if (dist < min_dist)
-                            {
-                                min_dist = dist;
-                                nearest_node = &*map_iterator;
-                            }
+                            insert_wall(wall_start, wall_end);
                         }
+                        drawing_wall = false;
+                    }
+                    else if (event.mouseButton.button == sf::Mouse::Middle)
+                    {
+                        panning = false;
+                    }
+                    break;
+                case sf::Event::MouseMoved:
+                {
+                    // Keep the Map Point That Was Under the Cursor Under It While Dragging
+                    sf::Vector2i pixel(event.mouseMove.x, event.mouseMove.y);
+                    if (panning)
+                    {
+                        map_view.move(window.mapPixelToCoords(mouse_pixel, map_view) - window.mapPixelToCoords(pixel, map_view));
                     }
+                    mouse_pixel = pixel;
+                    mouse_pos = window.mapPixelToCoords(pixel, map_view);
 
-                    // Ignore if Nearest Node is too Far
-                    if (min_dist > 20)
+                    // Find the Nearest Named Node Within Reach of Mouse Cursor
+                    nearest_node = named_node_index.nearest(school_graph, mouse_pos.x, mouse_pos.y, HOVER_DISTANCE * view_scale(map_view, window));
+                    break;
+                }
+                case sf::Event::MouseWheelScrolled:
+                    // Zoom Around the Cursor
+                    if (event.mouseWheelScroll.wheel == sf::Mouse::VerticalWheel)
                     {
-                        nearest_node = nullptr;
+                        float max_scale = 2 * max(map_size.x / window.getSize().x, map_size.y / window.getSize().y);
+                        sf::Vector2i pixel(event.mouseWheelScroll.x, event.mouseWheelScroll.y);
+                        zoom_view(map_view, window, pixel, pow(ZOOM_STEP, -event.mouseWheelScroll.delta), max_scale);
+                        mouse_pos = window.mapPixelToCoords(mouse_pixel, map_view);
                     }
                     break;
+                case sf::Event::Resized:
+                {
+                    // Show More or Less of the Map at the Same Zoom
+                    float scale = map_view.getSize().x / ui_view.getSize().x;
+                    map_view.setSize(event.size.width * scale, event.size.height * scale);
+                    ui_view.reset(sf::FloatRect(0, 0, event.size.width, event.size.height));
+                    debug_indicator.setPosition(event.size.width - 140.0f, 10);
+                    break;
+                }
             }
         }
 
+        // Draw the Rest With the View Events Left
+        window.setView(map_view);
+
         // Display Path if it Exists
-        if (end_node != nullptr && end_node->previous != nullptr)
+        if (end_node != NO_NODE && search_state.get_previous(end_node) != NO_NODE)
         {
-            // Draw Path
-            double path_length = 0;
-            MapNode* curr = end_node;
-            while (curr != start_node)
+            // Draw Path in One Batch, Over Any Alternatives
+            double route_ft = route_length(routing_graph, search_state, end_node, route_path, [](NodeId from, NodeId to) {
+                return query_link_length(school_graph, point_query, from, to);
+            }) * FEET_PER_PIXEL;
             {
-                draw_line(
-                    window,
-                    curr->pos,
-                    curr->previous->pos,
-                    7,
-                    sf::Color(154, 154, 255)
-                );
-                path_length += distance(*curr, *(curr->previous));
-                curr = curr->previous;
+                PROFILE_SCOPE(DrawLine);
+                sf::VertexArray path_triangles = sf::VertexArray(sf::Triangles);
+                for (size_t route = routes.size(); route-- > 1;)
+                {
+                    sf::Color color = ALTERNATIVE_COLORS[(route - 1) % size(ALTERNATIVE_COLORS)];
+                    for (size_t i = 1; i < routes[route].path.size(); i++)
+                    {
+                        append_line(path_triangles, node_pos(routes[route].path[i]), node_pos(routes[route].path[i - 1]), 7, color);
+                    }
+                }
+                NodeId curr = end_node;
+                while (curr != start_node)
+                {
+                    NodeId previous = search_state.get_previous(curr);
+                    append_line(
+                        path_triangles,
+                        node_pos(curr),
+                        node_pos(previous),
+                        7,
+                        PATH_COLOR
+                    );
+                    curr = previous;
+                }
+                window.draw(path_triangles);
             }
 
             // Create String Stream for Path Information
@@ -713,8 +2043,21 @@ int main() {
                       << endl
                       << "Path Length: "
                       << setprecision(1)
-                      << path_length * 0.6
+                      << route_ft
                       << " ft";
+            if (routing_profile != RoutingProfile::Shortest)
+            {
+                path_text << " (" << routing_profile_name(routing_profile) << ")";
+            }
+            for (size_t route = 1; route < routes.size(); route++)
+            {
+                double alternative_ft = path_length(routing_graph, routes[route].path) * FEET_PER_PIXEL;
+                path_text << endl
+                          << "Alternative " << route << ": "
+                          << alternative_ft
+                          << " ft (+" << setprecision(0) << 100 * (alternative_ft / route_ft - 1) << "%)"
+                          << setprecision(1);
+            }
 
             // Path Information Text
             sf::Text text;
@@ -722,7 +2065,9 @@ int main() {
             text.setString(path_text.str());
             text.setCharacterSize(24);
             text.setFillColor(sf::Color::White);
+            window.setView(ui_view);
             window.draw(text);
+            window.setView(map_view);
         }
 
         // Display Node Connections if Debug Mode
@@ -731,13 +2076,19 @@ int main() {
             display_graph(window);
         }
 
+        // Draw Wall Being Added
+        if (drawing_wall)
+        {
+            draw_line(window, wall_start, mouse_pos, 2, sf::Color::Red);
+        }
+
         // Deal With Mouse Hover Node
-        if (nearest_node != nullptr)
+        if (nearest_node != NO_NODE)
         {
             // Make Node Circle Larger
             sf::CircleShape node_circle = sf::CircleShape();
             node_circle.setRadius(10);
-            node_circle.setPosition(nearest_node->pos - sf::Vector2f(10, 10));
+            node_circle.setPosition(node_pos(nearest_node) - sf::Vector2f(10, 10));
             node_circle.setFillColor(sf::Color(100, 100, 100));
             window.draw(node_circle);
 
@@ -755,17 +2106,34 @@ int main() {
             }
 
             // Find Path from Start Node to End Node
-            if (set_start)
+            // (the search stops at the end node, so a new end needs a new search)
+            if (set_start || (set_end && start_node != NO_NODE))
             {
                 clock.restart();
-                find_path_dijkstra();
+                find_path();
                 path_time = clock.getElapsedTime().asMicroseconds() / 1000.0;
             }
+
+            // A Clicked Point is Not Something to Hover Over
+            if (is_point(nearest_node))
+            {
+                nearest_node = NO_NODE;
+            }
+        }
+
+        // Debug Mode Indicator Over Everything
+        if (DEBUG_UI)
+        {
+            window.setView(ui_view);
+            window.draw(debug_indicator);
         }
 
         // Update Window Display
         window.display();
     }
 
+    // Stop the Tile Loader First, So Its Counts Reach the Profile
+    background.reset();
+    write_profile(map_path);
     return 0;
 }
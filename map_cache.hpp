@@ -0,0 +1,432 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <memory>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "geometry.hpp"
+#include "map_graph.hpp"
+#include "profiling.hpp"
+
+/**
+ * Compiled map file format
+ * A fixed header followed by 8-byte aligned sections holding the arrays of a
+ * MapGraph (plus the walls) exactly as they sit in memory, so a loaded file
+ * is used in place. Numbers are stored in the byte order of the machine that
+ * wrote the file. Bump the version whenever the layout or the meaning of the
+ * graph changes, so old files are rebuilt instead of misread
+ */
+const char MAP_CACHE_MAGIC[8] = {'M', 'M', 'A', 'P', 'S', 'B', 'I', 'N'};
+const uint32_t MAP_CACHE_VERSION = 2;
+
+struct MapCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t source_checksum; // checksum_bytes() of the map text this was built from
+    uint64_t file_size;
+
+    uint32_t num_nodes;
+    uint32_t num_edges;
+    uint32_t num_walls;
+    uint32_t num_areas;
+    uint32_t name_bytes;
+    NodeId start_node;
+    NodeId end_node;
+
+    // Byte Offsets of Sections From the Start of the File
+    uint64_t x_section;
+    uint64_t y_section;
+    uint64_t name_offsets_section;
+    uint64_t name_text_section;
+    uint64_t walls_section;
+    uint64_t offsets_section;
+    uint64_t targets_section;
+    uint64_t weights_section;
+    uint64_t flags_section;
+    uint64_t areas_section;
+};
+
+/**
+ * 64-bit FNV-1a hash
+ * @param data
+ * @param size
+ * @param hash hash of preceding data, to hash in pieces
+ * @return hash
+ */
+inline uint64_t checksum_bytes(const char* data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ (unsigned char) data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Hashes a whole file with checksum_bytes()
+ * @param path
+ * @param checksum set to the hash of the file
+ * @return boolean whether the file could be read
+ */
+inline bool checksum_file(const std::string& path, uint64_t& checksum)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    checksum = checksum_bytes(nullptr, 0);
+    std::vector<char> chunk(1 << 16);
+    while (file.read(chunk.data(), chunk.size()) || file.gcount() > 0)
+    {
+        checksum = checksum_bytes(chunk.data(), file.gcount(), checksum);
+    }
+    return true;
+}
+
+/**
+ * Read-only memory mapping of a whole file
+ * Systems without mmap read the file into a single buffer instead
+ */
+class MappedFile
+{
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    /**
+     * Maps a file, replacing any file mapped before
+     * @param path
+     * @return boolean whether the file could be mapped
+     */
+    bool open(const std::string& path)
+    {
+        close();
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open())
+        {
+            return false;
+        }
+        mapped_size = file.tellg();
+        buffer.reset(new uint64_t[mapped_size / sizeof(uint64_t) + 1]);
+        file.seekg(0);
+        if (!file.read((char*) buffer.get(), mapped_size))
+        {
+            close();
+            return false;
+        }
+        mapped_data = (const char*) buffer.get();
+#else
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+        {
+            return false;
+        }
+        struct stat info;
+        if (fstat(descriptor, &info) != 0 || info.st_size == 0)
+        {
+            ::close(descriptor);
+            return false;
+        }
+        void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        ::close(descriptor);
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+        mapped_data = (const char*) mapping;
+        mapped_size = info.st_size;
+#endif
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        buffer.reset();
+#else
+        if (mapped_data != nullptr)
+        {
+            munmap((void*) mapped_data, mapped_size);
+        }
+#endif
+        mapped_data = nullptr;
+        mapped_size = 0;
+    }
+
+    const char* data() const
+    {
+        return mapped_data;
+    }
+
+    size_t size() const
+    {
+        return mapped_size;
+    }
+
+private:
+    const char* mapped_data = nullptr;
+    size_t mapped_size = 0;
+#ifdef _WIN32
+    std::unique_ptr<uint64_t[]> buffer;
+#endif
+};
+
+/**
+ * Compiled map opened from disk
+ * graph and walls point into the mapped file and stay valid while this is open
+ */
+struct MapCache
+{
+    MappedFile file;
+    MapGraph graph;
+    ArrayView<Wall> walls;
+    ArrayView<MapArea> areas;
+    NodeId start_node = NO_NODE;
+    NodeId end_node = NO_NODE;
+
+    /**
+     * Maps a compiled map file and checks that it can be used
+     * @param path
+     * @param source_checksum checksum of the current map text
+     * @return boolean whether the file exists, is intact, and was built from that text
+     */
+    bool open(const std::string& path, uint64_t source_checksum)
+    {
+        PROFILE_SCOPE(MapCacheOpen);
+        if (!file.open(path))
+        {
+            return false;
+        }
+
+        // Check Header
+        MapCacheHeader header;
+        if (file.size() < sizeof(header))
+        {
+            file.close();
+            return false;
+        }
+        memcpy(&header, file.data(), sizeof(header));
+        if (
+                memcmp(header.magic, MAP_CACHE_MAGIC, sizeof(MAP_CACHE_MAGIC)) != 0 ||
+                header.version != MAP_CACHE_VERSION ||
+                header.header_size != sizeof(header) ||
+                header.source_checksum != source_checksum ||
+                header.file_size != file.size()
+           )
+        {
+            file.close();
+            return false;
+        }
+
+        // Check Every Section Fits in the File
+        bool fits =
+                fits_in_file(header.x_section, header.num_nodes, sizeof(float)) &&
+                fits_in_file(header.y_section, header.num_nodes, sizeof(float)) &&
+                fits_in_file(header.name_offsets_section, header.num_nodes + 1ULL, sizeof(uint32_t)) &&
+                fits_in_file(header.name_text_section, header.name_bytes, sizeof(char)) &&
+                fits_in_file(header.walls_section, header.num_walls, sizeof(Wall)) &&
+                fits_in_file(header.offsets_section, header.num_nodes + 1ULL, sizeof(uint32_t)) &&
+                fits_in_file(header.targets_section, header.num_edges, sizeof(NodeId)) &&
+                fits_in_file(header.weights_section, header.num_edges, sizeof(float)) &&
+                fits_in_file(header.flags_section, header.num_edges, sizeof(EdgeFlags)) &&
+                fits_in_file(header.areas_section, header.num_areas, sizeof(MapArea));
+        if (!fits)
+        {
+            file.close();
+            return false;
+        }
+
+        // Point Graph Into File
+        graph.x = section<float>(header.x_section, header.num_nodes);
+        graph.y = section<float>(header.y_section, header.num_nodes);
+        graph.name_offsets = section<uint32_t>(header.name_offsets_section, header.num_nodes + 1);
+        graph.name_text = section<char>(header.name_text_section, header.name_bytes);
+        graph.offsets = section<uint32_t>(header.offsets_section, header.num_nodes + 1);
+        graph.targets = section<NodeId>(header.targets_section, header.num_edges);
+        graph.weights = section<float>(header.weights_section, header.num_edges);
+        graph.lengths = graph.weights;
+        graph.flags = section<EdgeFlags>(header.flags_section, header.num_edges);
+        walls = section<Wall>(header.walls_section, header.num_walls);
+        areas = section<MapArea>(header.areas_section, header.num_areas);
+        start_node = header.start_node;
+        end_node = header.end_node;
+
+        // Check Every Offset and Node Id, So a Damaged File Is Rebuilt Rather Than Read Out of Bounds
+        if (!indexes_in_bounds(header))
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        file.close();
+        graph = MapGraph();
+        walls = ArrayView<Wall>();
+        areas = ArrayView<MapArea>();
+    }
+
+private:
+    /**
+     * @param header header of the mapped file, whose sections graph points into
+     * @return boolean whether the offsets start at 0, never decrease and end
+     *         at the counts, and every node id is a node or NO_NODE where allowed
+     */
+    bool indexes_in_bounds(const MapCacheHeader& header) const
+    {
+        NodeId num_nodes = header.num_nodes;
+        if (
+                graph.name_offsets[0] != 0 ||
+                graph.name_offsets[num_nodes] != header.name_bytes ||
+                graph.offsets[0] != 0 ||
+                graph.offsets[num_nodes] != header.num_edges
+           )
+        {
+            return false;
+        }
+        for (NodeId node = 0; node < num_nodes; node++)
+        {
+            if (graph.name_offsets[node] > graph.name_offsets[node + 1] || graph.offsets[node] > graph.offsets[node + 1])
+            {
+                return false;
+            }
+        }
+        for (uint32_t edge = 0; edge < header.num_edges; edge++)
+        {
+            if (graph.targets[edge] >= num_nodes)
+            {
+                return false;
+            }
+        }
+        return (start_node == NO_NODE || start_node < num_nodes) && (end_node == NO_NODE || end_node < num_nodes);
+    }
+
+    bool fits_in_file(uint64_t offset, uint64_t count, uint64_t item_size) const
+    {
+        return offset % 8 == 0 && offset <= file.size() && count * item_size <= file.size() - offset;
+    }
+
+    template <class T>
+    ArrayView<T> section(uint64_t offset, uint64_t count) const
+    {
+        return ArrayView<T>((const T*) (file.data() + offset), count);
+    }
+};
+
+/**
+ * Writes one section of a compiled map, padded to 8 bytes
+ * Helper function for write_map_cache()
+ * @param out
+ * @param data
+ * @param bytes
+ * @return byte offset of the section
+ */
+inline uint64_t write_map_cache_section(std::ofstream& out, const void* data, uint64_t bytes)
+{
+    uint64_t offset = out.tellp();
+    out.write((const char*) data, bytes);
+    const char zeros[8] = {};
+    out.write(zeros, (8 - bytes % 8) % 8);
+    return offset;
+}
+
+/**
+ * Writes a compiled map file
+ * The file is written next to its final path and then renamed over it, so a
+ * reader never sees a half-written file
+ * @param path
+ * @param graph finished graph
+ * @param walls all walls of the map
+ * @param areas all areas of the map
+ * @param start_node start node given by the map, or NO_NODE
+ * @param end_node end node given by the map, or NO_NODE
+ * @param source_checksum checksum of the map text the graph was built from
+ * @return boolean whether the file was written
+ */
+inline bool write_map_cache(
+    const std::string& path,
+    const MapGraph& graph,
+    const std::vector<Wall>& walls,
+    const std::vector<MapArea>& areas,
+    NodeId start_node,
+    NodeId end_node,
+    uint64_t source_checksum
+)
+{
+    std::string temporary_path = path + ".tmp";
+    std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        return false;
+    }
+
+    // Reserve Header Space
+    MapCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    out.write((const char*) &header, sizeof(header));
+
+    // Sections
+    header.x_section = write_map_cache_section(out, graph.x.begin(), graph.x.size() * sizeof(float));
+    header.y_section = write_map_cache_section(out, graph.y.begin(), graph.y.size() * sizeof(float));
+    header.name_offsets_section = write_map_cache_section(out, graph.name_offsets.begin(), graph.name_offsets.size() * sizeof(uint32_t));
+    header.name_text_section = write_map_cache_section(out, graph.name_text.begin(), graph.name_text.size());
+    header.walls_section = write_map_cache_section(out, walls.data(), walls.size() * sizeof(Wall));
+    header.offsets_section = write_map_cache_section(out, graph.offsets.begin(), graph.offsets.size() * sizeof(uint32_t));
+    header.targets_section = write_map_cache_section(out, graph.targets.begin(), graph.targets.size() * sizeof(NodeId));
+    header.weights_section = write_map_cache_section(out, graph.weights.begin(), graph.weights.size() * sizeof(float));
+    header.flags_section = write_map_cache_section(out, graph.flags.begin(), graph.flags.size() * sizeof(EdgeFlags));
+    header.areas_section = write_map_cache_section(out, areas.data(), areas.size() * sizeof(MapArea));
+
+    // Fill In Header
+    memcpy(header.magic, MAP_CACHE_MAGIC, sizeof(MAP_CACHE_MAGIC));
+    header.version = MAP_CACHE_VERSION;
+    header.header_size = sizeof(header);
+    header.source_checksum = source_checksum;
+    header.file_size = out.tellp();
+    header.num_nodes = graph.node_count();
+    header.num_edges = graph.edge_count();
+    header.num_walls = walls.size();
+    header.num_areas = areas.size();
+    header.name_bytes = graph.name_text.size();
+    header.start_node = start_node;
+    header.end_node = end_node;
+    out.seekp(0);
+    out.write((const char*) &header, sizeof(header));
+    out.close();
+    if (!out)
+    {
+        std::remove(temporary_path.c_str());
+        return false;
+    }
+
+    // Replace Old File
+#ifdef _WIN32
+    std::remove(path.c_str());
+#endif
+    return std::rename(temporary_path.c_str(), path.c_str()) == 0;
+}
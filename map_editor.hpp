@@ -0,0 +1,284 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "geometry.hpp"
+#include "map_graph.hpp"
+#include "node_index.hpp"
+#include "wall_index.hpp"
+
+/**
+ * Padding around wall shadows, as a fraction of the map size
+ * Only has to cover rounding in the shadow polygon, since every node pair
+ * found through a shadow is checked exactly afterwards
+ */
+const double SHADOW_PADDING = 1e-6;
+
+/**
+ * Edge of an editable map, kept in its node's neighbor list
+ */
+struct EditedEdge
+{
+    NodeId target;
+    float length;
+    EdgeFlags flags;
+};
+
+inline bool operator<(const EditedEdge& edge, NodeId node)
+{
+    return edge.target < node;
+}
+
+/**
+ * Map whose walls and nodes can change at runtime without rebuilding its graph
+ * While editing, each node keeps its edges in a list sorted by neighbor id,
+ * with each edge's length and flags worked out when it is linked; the
+ * lists are copied back into CSR form by finish_editing(). A wall change
+ * only revisits the node pairs whose segment crosses that wall, found by
+ * looking up the wall's shadow from each node in a grid over the nodes, so
+ * the graph always holds exactly the edges build_visibility_graph() would
+ * give it. Removed nodes keep their ids but lose their name and every edge
+ */
+struct EditableMap
+{
+    MapGraphStorage storage;
+    std::vector<std::vector<EditedEdge>> neighbors;
+    std::vector<bool> removed;
+    NodeGrid node_grid;
+    std::vector<MapArea> areas; // flag new edges as build_visibility_graph() and its caller would
+};
+
+/**
+ * Copies a graph into an editable map
+ * @param map
+ * @param graph
+ * @param areas areas of the map, whose flags go to the edges crossing them
+ */
+inline void begin_editing(EditableMap& map, const MapGraph& graph, const std::vector<MapArea>& areas)
+{
+    map.storage = MapGraphStorage();
+    map.areas = areas;
+    map.neighbors.assign(graph.node_count(), std::vector<EditedEdge>());
+    map.removed.assign(graph.node_count(), false);
+    for (NodeId node = 0; node < graph.node_count(); node++)
+    {
+        map.storage.add_node(graph.x[node], graph.y[node], graph.name(node));
+        std::vector<EditedEdge>& list = map.neighbors[node];
+        for (uint32_t edge = graph.offsets[node]; edge < graph.offsets[node + 1]; edge++)
+        {
+            list.push_back(EditedEdge{graph.targets[edge], graph.lengths[edge], graph.flags[edge]});
+        }
+        std::sort(list.begin(), list.end(), [](const EditedEdge& a, const EditedEdge& b) {
+            return a.target < b.target;
+        });
+    }
+    map.node_grid.build(graph);
+}
+
+/**
+ * Packs the neighbor lists of an editable map into its CSR arrays
+ * Only copies them: nothing about an edge is worked out again
+ * @param map
+ * @return graph pointing at the map's storage, valid until the next edit
+ */
+inline MapGraph finish_editing(EditableMap& map)
+{
+    MapGraphStorage& storage = map.storage;
+    NodeId num_nodes = storage.node_count();
+    storage.offsets.assign(num_nodes + 1, 0);
+    for (NodeId node = 0; node < num_nodes; node++)
+    {
+        storage.offsets[node + 1] = storage.offsets[node] + map.neighbors[node].size();
+    }
+    storage.targets.resize(storage.offsets[num_nodes]);
+    storage.weights.resize(storage.offsets[num_nodes]);
+    storage.flags.resize(storage.offsets[num_nodes]);
+    for (NodeId node = 0; node < num_nodes; node++)
+    {
+        uint32_t slot = storage.offsets[node];
+        for (const EditedEdge& edge : map.neighbors[node])
+        {
+            storage.targets[slot] = edge.target;
+            storage.weights[slot] = edge.length;
+            storage.flags[slot++] = edge.flags;
+        }
+    }
+    return storage.view();
+}
+
+/**
+ * Checks whether two nodes of an editable map are linked
+ * @param map
+ * @param a
+ * @param b
+ * @return boolean whether the edge exists
+ */
+inline bool has_edge(const EditableMap& map, NodeId a, NodeId b)
+{
+    auto entry = std::lower_bound(map.neighbors[a].begin(), map.neighbors[a].end(), b);
+    return entry != map.neighbors[a].end() && entry->target == b;
+}
+
+/**
+ * Links two nodes of an editable map, keeping both neighbor lists sorted
+ * The edge's length and flags are worked out as build_visibility_graph()
+ * and flag_edges() would, each way separately
+ * @param map
+ * @param a
+ * @param b
+ */
+inline void link_nodes(EditableMap& map, NodeId a, NodeId b)
+{
+    const MapGraphStorage& storage = map.storage;
+    float length = std::hypot(storage.x[a] - storage.x[b], storage.y[a] - storage.y[b]);
+    EdgeFlags a_flags = crossed_area_flags(map.areas, storage.x[a], storage.y[a], storage.x[b], storage.y[b]);
+    EdgeFlags b_flags = crossed_area_flags(map.areas, storage.x[b], storage.y[b], storage.x[a], storage.y[a]);
+    std::vector<EditedEdge>& a_list = map.neighbors[a];
+    std::vector<EditedEdge>& b_list = map.neighbors[b];
+    a_list.insert(std::lower_bound(a_list.begin(), a_list.end(), b), EditedEdge{b, length, a_flags});
+    b_list.insert(std::lower_bound(b_list.begin(), b_list.end(), a), EditedEdge{a, length, b_flags});
+}
+
+/**
+ * Unlinks two nodes of an editable map if they are linked
+ * @param map
+ * @param a
+ * @param b
+ */
+inline void unlink_nodes(EditableMap& map, NodeId a, NodeId b)
+{
+    std::vector<EditedEdge>& a_list = map.neighbors[a];
+    std::vector<EditedEdge>& b_list = map.neighbors[b];
+    auto a_entry = std::lower_bound(a_list.begin(), a_list.end(), b);
+    if (a_entry != a_list.end() && a_entry->target == b)
+    {
+        a_list.erase(a_entry);
+        b_list.erase(std::lower_bound(b_list.begin(), b_list.end(), a));
+    }
+}
+
+/**
+ * Calls visit(a, b) for every pair of nodes a < b whose segment touches a wall
+ * Helper function for add_wall_edit() and remove_wall_edit()
+ * Costs one shadow lookup per node plus the nodes in the shadows, rather
+ * than a check of every pair
+ * @param map
+ * @param wall
+ * @param visit
+ */
+template <class Visit>
+void for_each_pair_across(const EditableMap& map, const Wall& wall, Visit visit)
+{
+    const MapGraphStorage& storage = map.storage;
+    const NodeGrid& grid = map.node_grid;
+    double padding = SHADOW_PADDING * std::max({1.0, grid.max_x - grid.min_x, grid.max_y - grid.min_y});
+    for (NodeId a = 0; a < storage.node_count(); a++)
+    {
+        if (map.removed[a])
+        {
+            continue;
+        }
+        sf::Vector2f a_point(storage.x[a], storage.y[a]);
+        ConvexPolygon shadow = wall_shadow(a_point, wall, grid.min_x, grid.min_y, grid.max_x, grid.max_y, padding);
+        grid.for_each_in_polygon(shadow, [&](NodeId b) {
+            if (b > a && do_intersect(a_point, sf::Vector2f(storage.x[b], storage.y[b]), wall.a, wall.b))
+            {
+                visit(a, b);
+            }
+        });
+    }
+}
+
+/**
+ * Adds a wall and unlinks every pair of nodes it blocks
+ * @param map
+ * @param walls all walls of the map, gets the new wall
+ * @param wall_index index over walls, rebuilt
+ * @param wall
+ */
+inline void add_wall_edit(EditableMap& map, std::vector<Wall>& walls, WallGrid& wall_index, const Wall& wall)
+{
+    walls.push_back(wall);
+    wall_index.build(walls);
+    for_each_pair_across(map, wall, [&](NodeId a, NodeId b) {
+        unlink_nodes(map, a, b);
+    });
+}
+
+/**
+ * Removes a wall and links every pair of nodes that can now see each other
+ * @param map
+ * @param walls all walls of the map, loses the wall
+ * @param wall_index index over walls, rebuilt
+ * @param wall_id index of the wall in walls
+ */
+inline void remove_wall_edit(EditableMap& map, std::vector<Wall>& walls, WallGrid& wall_index, size_t wall_id)
+{
+    Wall wall = walls[wall_id];
+    walls.erase(walls.begin() + wall_id);
+    wall_index.build(walls);
+
+    const MapGraphStorage& storage = map.storage;
+    for_each_pair_across(map, wall, [&](NodeId a, NodeId b) {
+        sf::Vector2f a_point(storage.x[a], storage.y[a]);
+        sf::Vector2f b_point(storage.x[b], storage.y[b]);
+        if (!has_edge(map, a, b) && !wall_index.is_obstructed(a_point, b_point))
+        {
+            link_nodes(map, a, b);
+        }
+    });
+}
+
+/**
+ * Adds a node and links it to every node it can see
+ * @param map
+ * @param wall_index index over every wall of the map
+ * @param point
+ * @param name
+ * @return id of the new node
+ */
+inline NodeId add_node_edit(EditableMap& map, const WallGrid& wall_index, sf::Vector2f point, std::string_view name)
+{
+    NodeId node = map.storage.add_node(point.x, point.y, name);
+    map.neighbors.emplace_back();
+    map.removed.push_back(false);
+
+    // New Node Has the Highest Id, so Every Link Goes at the End of Its Lists
+    for (NodeId other = 0; other < node; other++)
+    {
+        sf::Vector2f other_point(map.storage.x[other], map.storage.y[other]);
+        if (!map.removed[other] && !wall_index.is_obstructed(point, other_point))
+        {
+            link_nodes(map, node, other);
+        }
+    }
+    map.node_grid.insert(node, point.x, point.y);
+    return node;
+}
+
+/**
+ * Removes a node by unlinking it from all of its neighbors
+ * The id stays taken, by an unnamed node with no edges
+ * @param map
+ * @param node
+ */
+inline void remove_node_edit(EditableMap& map, NodeId node)
+{
+    if (map.removed[node])
+    {
+        return;
+    }
+    for (const EditedEdge& edge : map.neighbors[node])
+    {
+        std::vector<EditedEdge>& other_list = map.neighbors[edge.target];
+        other_list.erase(std::lower_bound(other_list.begin(), other_list.end(), node));
+    }
+    map.neighbors[node].clear();
+    map.removed[node] = true;
+    map.node_grid.remove(node, map.storage.x[node], map.storage.y[node]);
+    map.storage.rename_node(node, " ");
+}
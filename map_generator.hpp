@@ -0,0 +1,246 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Kinds of synthetic maps
+ */
+enum class MapLayout
+{
+    Campus, // buildings on a grid of streets
+    Clutter, // boxes of random size anywhere
+    Corridors // long walls with doorways, like hallways
+};
+
+/**
+ * @param layout
+ * @return name used on the command line and in reports
+ */
+inline const char* map_layout_name(MapLayout layout)
+{
+    switch (layout)
+    {
+        case MapLayout::Campus:
+            return "campus";
+        case MapLayout::Clutter:
+            return "clutter";
+        default:
+            return "corridors";
+    }
+}
+
+/**
+ * Reads a layout name
+ * @param name
+ * @param layout set to the named layout
+ * @return boolean whether the name was recognized
+ */
+inline bool parse_map_layout(std::string_view name, MapLayout& layout)
+{
+    for (MapLayout option : {MapLayout::Campus, MapLayout::Clutter, MapLayout::Corridors})
+    {
+        if (name == map_layout_name(option))
+        {
+            layout = option;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Settings of a synthetic map
+ * The same settings always give the same map text, on any platform
+ */
+struct MapGeneratorSettings
+{
+    MapLayout layout = MapLayout::Campus;
+    size_t num_nodes = 1000;
+    double box_density = 0.3; // share of the map covered by obstacles, 0 to 1
+    double named_share = 0.4; // share of nodes that get a name
+    uint64_t seed = 1;
+};
+
+/**
+ * Map width and height per square root of the node count, in pixels
+ * Keeps about as many nodes per area as mission.txt at every size
+ */
+const int GENERATED_MAP_SCALE = 60;
+
+/**
+ * Size of the cells used to keep generated nodes out of obstacles, in pixels
+ */
+const int GENERATED_MAP_CELL = 8;
+
+/**
+ * Random numbers that do not depend on the standard library's distributions
+ * (whose output differs between implementations)
+ */
+struct MapGeneratorRandom
+{
+    std::mt19937_64 engine;
+
+    explicit MapGeneratorRandom(uint64_t seed) : engine(seed) {}
+
+    /**
+     * @param low
+     * @param high
+     * @return integer in [low, high]
+     */
+    int between(int low, int high)
+    {
+        return low + (int) (engine() % (uint64_t) (high - low + 1));
+    }
+
+    /**
+     * @param chance
+     * @return boolean true with the given chance
+     */
+    bool chance(double chance)
+    {
+        return (engine() >> 11) * (1.0 / 9007199254740992.0) < chance;
+    }
+};
+
+/**
+ * Cells of a generated map that nodes must stay out of
+ * Helper for generate_map_text()
+ */
+struct BlockedCells
+{
+    int columns = 0;
+    int rows = 0;
+    std::vector<uint8_t> cells;
+
+    BlockedCells(int width, int height)
+        : columns(width / GENERATED_MAP_CELL + 1), rows(height / GENERATED_MAP_CELL + 1), cells((size_t) columns * rows, 0) {}
+
+    /**
+     * Blocks every cell touching a rectangle grown by a margin
+     */
+    void block(int x1, int y1, int x2, int y2)
+    {
+        const int MARGIN = 3;
+        int first_column = std::max(0, (std::min(x1, x2) - MARGIN) / GENERATED_MAP_CELL);
+        int last_column = std::min(columns - 1, (std::max(x1, x2) + MARGIN) / GENERATED_MAP_CELL);
+        int first_row = std::max(0, (std::min(y1, y2) - MARGIN) / GENERATED_MAP_CELL);
+        int last_row = std::min(rows - 1, (std::max(y1, y2) + MARGIN) / GENERATED_MAP_CELL);
+        for (int row = first_row; row <= last_row; row++)
+        {
+            std::fill(cells.begin() + (size_t) row * columns + first_column, cells.begin() + (size_t) row * columns + last_column + 1, 1);
+        }
+    }
+
+    bool is_blocked(int x, int y) const
+    {
+        return cells[(size_t) (y / GENERATED_MAP_CELL) * columns + x / GENERATED_MAP_CELL] != 0;
+    }
+};
+
+/**
+ * Generates a map in the map text format
+ * Obstacles are laid out first, then nodes are scattered over the space
+ * left free. Very dense maps may end up with fewer nodes than asked for
+ * @param settings
+ * @return map text
+ */
+inline std::string generate_map_text(const MapGeneratorSettings& settings)
+{
+    MapGeneratorRandom random(settings.seed);
+    int side = (int) std::ceil(GENERATED_MAP_SCALE * std::sqrt((double) std::max<size_t>(settings.num_nodes, 1)));
+    BlockedCells blocked(side, side);
+    std::ostringstream text;
+    text << "# Generated map: layout " << map_layout_name(settings.layout)
+         << ", nodes " << settings.num_nodes
+         << ", box density " << settings.box_density
+         << ", seed " << settings.seed << "\n";
+
+    auto add_box = [&](int x1, int y1, int x2, int y2) {
+        text << "b " << x1 << ' ' << y1 << ' ' << x2 << ' ' << y2 << "\n";
+        blocked.block(x1, y1, x2, y2);
+    };
+    auto add_line = [&](int x1, int y1, int x2, int y2) {
+        text << "o " << x1 << ' ' << y1 << ' ' << x2 << ' ' << y2 << "\n";
+        blocked.block(x1, y1, x2, y2);
+    };
+
+    // Obstacles
+    if (settings.layout == MapLayout::Campus)
+    {
+        // One Building per Block Where Chance Allows, Streets Between
+        const int BLOCK = 240, STREET = 60;
+        double building_share = 0.45; // of a block, on average
+        double build_chance = std::min(1.0, settings.box_density / building_share);
+        for (int block_y = 0; block_y + BLOCK <= side; block_y += BLOCK)
+        {
+            for (int block_x = 0; block_x + BLOCK <= side; block_x += BLOCK)
+            {
+                if (random.chance(build_chance))
+                {
+                    int x1 = block_x + STREET / 2 + random.between(0, 20);
+                    int y1 = block_y + STREET / 2 + random.between(0, 20);
+                    int x2 = block_x + BLOCK - STREET / 2 - random.between(0, 20);
+                    int y2 = block_y + BLOCK - STREET / 2 - random.between(0, 20);
+                    add_box(x1, y1, x2, y2);
+                }
+            }
+        }
+    }
+    else if (settings.layout == MapLayout::Clutter)
+    {
+        // Random Boxes Until Their Total Area Reaches the Density
+        double covered = 0, target = settings.box_density * side * side;
+        while (covered < target)
+        {
+            int width = random.between(20, 120), height = random.between(20, 120);
+            int x1 = random.between(0, std::max(0, side - width));
+            int y1 = random.between(0, std::max(0, side - height));
+            add_box(x1, y1, x1 + width, y1 + height);
+            covered += (double) width * height;
+        }
+    }
+    else
+    {
+        // Hallway Walls With Doorways; Denser Maps Have Longer Solid Stretches
+        const int HALLWAY = 120;
+        int max_solid = 100 + (int) (800 * settings.box_density);
+        for (int y = HALLWAY; y < side; y += HALLWAY)
+        {
+            int x = random.between(0, 80);
+            while (x < side)
+            {
+                int end = std::min(side, x + random.between(100, std::max(100, max_solid)));
+                add_line(x, y, end, y);
+                x = end + random.between(30, 80);
+            }
+        }
+    }
+
+    // Nodes in Free Space
+    size_t placed = 0;
+    for (size_t attempt = 0; placed < settings.num_nodes && attempt < 100 * settings.num_nodes + 100; attempt++)
+    {
+        int x = random.between(0, side - 1), y = random.between(0, side - 1);
+        if (blocked.is_blocked(x, y))
+        {
+            continue;
+        }
+        if (random.chance(settings.named_share))
+        {
+            text << "N " << x << ' ' << y << " P" << placed << "\n";
+        }
+        else
+        {
+            text << "n " << x << ' ' << y << "\n";
+        }
+        placed++;
+    }
+    return text.str();
+}
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/**
+ * Index of a node in a MapGraph
+ */
+typedef uint32_t NodeId;
+
+/**
+ * Placeholder for "no node" (unset start/end, start of a path)
+ */
+const NodeId NO_NODE = UINT32_MAX;
+
+/**
+ * What an edge passes through, as bits; routing profiles avoid or prefer edges by them
+ */
+typedef uint8_t EdgeFlags;
+const EdgeFlags EDGE_STAIRS = 1 << 0;
+const EdgeFlags EDGE_OUTDOOR = 1 << 1;
+const EdgeFlags EDGE_CLOSED_AT_NIGHT = 1 << 2;
+
+/**
+ * Names of the edge flags in map text, by bit
+ */
+const char* const EDGE_FLAG_NAMES[] = {"stairs", "outdoor", "closed-at-night"};
+
+/**
+ * @param name
+ * @param flag set to the flag of that name
+ * @return boolean whether the name is known
+ */
+inline bool parse_edge_flag(std::string_view name, EdgeFlags& flag)
+{
+    for (size_t bit = 0; bit < std::size(EDGE_FLAG_NAMES); bit++)
+    {
+        if (name == EDGE_FLAG_NAMES[bit])
+        {
+            flag = (EdgeFlags) (1 << bit);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Box of the map whose flags go to every edge crossing it (a stairwell, a courtyard)
+ */
+struct MapArea
+{
+    float min_x;
+    float min_y;
+    float max_x;
+    float max_y;
+    EdgeFlags flags;
+};
+
+/**
+ * Finds the flags of every area a segment crosses or touches
+ * Each area clips the segment's parameter range one side at a time
+ * @param areas
+ * @param x1
+ * @param y1
+ * @param x2
+ * @param y2
+ * @return flags of all those areas together
+ */
+inline EdgeFlags crossed_area_flags(const std::vector<MapArea>& areas, float x1, float y1, float x2, float y2)
+{
+    EdgeFlags flags = 0;
+    double dx = (double) x2 - x1, dy = (double) y2 - y1;
+    for (const MapArea& area : areas)
+    {
+        if ((flags | area.flags) == flags)
+        {
+            continue;
+        }
+        double enter = 0, leave = 1;
+        double directions[4] = {-dx, dx, -dy, dy};
+        double gaps[4] = {(double) x1 - area.min_x, (double) area.max_x - x1, (double) y1 - area.min_y, (double) area.max_y - y1};
+        for (int side = 0; side < 4 && enter <= leave; side++)
+        {
+            if (directions[side] == 0)
+            {
+                leave = gaps[side] < 0 ? -1 : leave;
+            }
+            else if (directions[side] < 0)
+            {
+                enter = std::max(enter, gaps[side] / directions[side]);
+            }
+            else
+            {
+                leave = std::min(leave, gaps[side] / directions[side]);
+            }
+        }
+        if (enter <= leave)
+        {
+            flags |= area.flags;
+        }
+    }
+    return flags;
+}
+
+/**
+ * Read-only view of a contiguous array owned by something else
+ * (a std::vector in MapGraphStorage, or a memory-mapped cache file)
+ */
+template <class T>
+struct ArrayView
+{
+    const T* items = nullptr;
+    size_t count = 0;
+
+    ArrayView() {}
+    ArrayView(const T* items, size_t count) : items(items), count(count) {}
+    ArrayView(const std::vector<T>& vector) : items(vector.data()), count(vector.size()) {}
+
+    const T& operator[](size_t i) const
+    {
+        return items[i];
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    const T* begin() const
+    {
+        return items;
+    }
+
+    const T* end() const
+    {
+        return items + count;
+    }
+};
+
+/**
+ * Pathable graph stored in contiguous arrays
+ * Node data is kept as a struct of arrays, and adjacency is kept in
+ * compressed sparse row form: the neighbors of node i are
+ * targets[offsets[i]] ... targets[offsets[i + 1] - 1], and weights holds the
+ * matching edge lengths, so a search never touches node positions
+ * The graph only points at its arrays, so it can sit directly on top of a
+ * memory-mapped cache file as well as on a MapGraphStorage
+ */
+struct MapGraph
+{
+    // Node Data
+    ArrayView<float> x;
+    ArrayView<float> y;
+    ArrayView<uint32_t> name_offsets; // name i is name_text[name_offsets[i]] ... name_text[name_offsets[i + 1] - 1]
+    ArrayView<char> name_text;
+
+    // Adjacency
+    ArrayView<uint32_t> offsets;
+    ArrayView<NodeId> targets;
+    ArrayView<float> weights; // what searches minimize; the lengths unless a routing profile's costs are swapped in
+    ArrayView<float> lengths; // edge lengths in pixels
+    ArrayView<EdgeFlags> flags; // what each edge passes through
+
+    size_t node_count() const
+    {
+        return x.size();
+    }
+
+    size_t edge_count() const
+    {
+        return targets.size();
+    }
+
+    /**
+     * @param node
+     * @return name of the node, " " for unnamed nodes
+     */
+    std::string_view name(NodeId node) const
+    {
+        return std::string_view(
+            name_text.begin() + name_offsets[node],
+            name_offsets[node + 1] - name_offsets[node]
+        );
+    }
+
+    /**
+     * @param node
+     * @return boolean whether the node has a name worth showing to the user
+     */
+    bool is_named(NodeId node) const
+    {
+        return name(node) != " ";
+    }
+
+    /**
+     * @return boolean whether search costs are plain edge lengths
+     */
+    bool weighs_lengths() const
+    {
+        return weights.begin() == lengths.begin();
+    }
+};
+
+/**
+ * Owns the arrays of a graph built in memory
+ */
+struct MapGraphStorage
+{
+    // Node Data
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<uint32_t> name_offsets = std::vector<uint32_t>(1, 0);
+    std::vector<char> name_text;
+
+    // Adjacency
+    std::vector<uint32_t> offsets;
+    std::vector<NodeId> targets;
+    std::vector<float> weights; // edge lengths
+    std::vector<EdgeFlags> flags;
+
+    size_t node_count() const
+    {
+        return x.size();
+    }
+
+    /**
+     * Appends a node without any connections
+     * @param node_x
+     * @param node_y
+     * @param name
+     * @return id of the new node
+     */
+    NodeId add_node(float node_x, float node_y, std::string_view name)
+    {
+        x.push_back(node_x);
+        y.push_back(node_y);
+        name_text.insert(name_text.end(), name.begin(), name.end());
+        name_offsets.push_back(name_text.size());
+        return x.size() - 1;
+    }
+
+    /**
+     * Replaces the name of a node
+     * Names are packed back to back, so this moves every later name
+     * @param node
+     * @param name
+     */
+    void rename_node(NodeId node, std::string_view name)
+    {
+        uint32_t old_length = name_offsets[node + 1] - name_offsets[node];
+        name_text.erase(name_text.begin() + name_offsets[node], name_text.begin() + name_offsets[node + 1]);
+        name_text.insert(name_text.begin() + name_offsets[node], name.begin(), name.end());
+        for (size_t i = node + 1; i < name_offsets.size(); i++)
+        {
+            name_offsets[i] = name_offsets[i] - old_length + name.size();
+        }
+    }
+
+    /**
+     * @return graph pointing at this storage, valid until the storage changes
+     */
+    MapGraph view() const
+    {
+        MapGraph graph;
+        graph.x = x;
+        graph.y = y;
+        graph.name_offsets = name_offsets;
+        graph.name_text = name_text;
+        graph.offsets = offsets;
+        graph.targets = targets;
+        graph.weights = weights;
+        graph.lengths = weights;
+        graph.flags = flags;
+        return graph;
+    }
+};
+
+/**
+ * Calculates the straight line distance between two nodes
+ * @param graph
+ * @param a
+ * @param b
+ * @return distance
+ */
+inline double node_distance(const MapGraph& graph, NodeId a, NodeId b)
+{
+    return std::hypot(graph.x[b] - graph.x[a], graph.y[b] - graph.y[a]);
+}
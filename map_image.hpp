@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+
+#include "geometry.hpp"
+#include "parallel.hpp"
+#include "profiling.hpp"
+
+/**
+ * Rows of a map image a worker classifies at a time
+ */
+const size_t MAP_IMAGE_BAND_ROWS = 64;
+
+/**
+ * How far simplifying may move an obstacle outline, in pixels, unless asked otherwise
+ * Enough to turn the staircase of a diagonal wall back into one straight wall
+ */
+const double DEFAULT_OUTLINE_TOLERANCE = 1.0;
+
+/**
+ * Node drawn into a map image as a single pixel
+ */
+struct MapImageNode
+{
+    uint32_t x;
+    uint32_t y;
+    bool named; // red pixel; blue pixels are unnamed nodes
+};
+
+/**
+ * Nodes and obstacle outlines read from a map image
+ */
+struct CompiledMapImage
+{
+    std::vector<MapImageNode> nodes; // by column, then row
+    std::vector<std::vector<sf::Vector2f>> outlines; // closed polygons around obstacles and their holes
+
+    /**
+     * @return number of o lines write_map_image_text() gives
+     */
+    size_t wall_count() const
+    {
+        size_t count = 0;
+        for (const std::vector<sf::Vector2f>& outline : outlines)
+        {
+            count += outline.size() > 2 ? outline.size() : 1;
+        }
+        return count;
+    }
+};
+
+/**
+ * Pixel colors of map images (RGBA bytes):
+ * pure green (or 254 green) is obstacle, pure red a named node, pure blue an unnamed node
+ */
+inline bool is_obstacle_pixel(const uint8_t* pixel)
+{
+    return pixel[0] == 0 && pixel[1] >= 254 && pixel[2] == 0;
+}
+
+inline bool is_named_node_pixel(const uint8_t* pixel)
+{
+    return pixel[0] == 255 && pixel[1] == 0 && pixel[2] == 0;
+}
+
+inline bool is_unnamed_node_pixel(const uint8_t* pixel)
+{
+    return pixel[0] == 0 && pixel[1] == 0 && pixel[2] == 255;
+}
+
+/**
+ * Simplifies a closed outline with the Douglas-Peucker algorithm
+ * The outline is split at its first corner and the corner farthest from
+ * it, and each half keeps only the corners needed to stay within tolerance
+ * @param outline corners of a closed polygon, replaced by the kept corners
+ * @param tolerance how far the outline may move, in pixels; 0 keeps every corner
+ */
+inline void simplify_outline(std::vector<sf::Vector2f>& outline, double tolerance)
+{
+    size_t num_corners = outline.size();
+    if (tolerance <= 0 || num_corners < 4)
+    {
+        return;
+    }
+    auto corner = [&](size_t i) { return sf::Vector2<double>(outline[i % num_corners].x, outline[i % num_corners].y); };
+    size_t farthest = 1;
+    for (size_t i = 2; i < num_corners; i++)
+    {
+        if (std::hypot(outline[i].x - outline[0].x, outline[i].y - outline[0].y) > std::hypot(outline[farthest].x - outline[0].x, outline[farthest].y - outline[0].y))
+        {
+            farthest = i;
+        }
+    }
+
+    // Keep the Corner Farthest From Each Span's Chord Until All Are Close Enough
+    std::vector<char> keep(num_corners, 0);
+    keep[0] = keep[farthest] = 1;
+    std::vector<std::pair<size_t, size_t>> spans = {{0, farthest}, {farthest, num_corners}};
+    while (!spans.empty())
+    {
+        auto [first, last] = spans.back();
+        spans.pop_back();
+        double worst_distance = tolerance;
+        size_t worst = first;
+        for (size_t i = first + 1; i < last; i++)
+        {
+            double distance = distance_to_segment(corner(i), corner(first), corner(last));
+            if (distance > worst_distance)
+            {
+                worst_distance = distance;
+                worst = i;
+            }
+        }
+        if (worst != first)
+        {
+            keep[worst] = 1;
+            spans.emplace_back(first, worst);
+            spans.emplace_back(worst, last);
+        }
+    }
+
+    size_t num_kept = 0;
+    for (size_t i = 0; i < num_corners; i++)
+    {
+        if (keep[i])
+        {
+            outline[num_kept++] = outline[i];
+        }
+    }
+    outline.resize(num_kept);
+}
+
+/**
+ * Reads nodes and obstacle outlines out of a map image
+ * Rows are classified in bands across worker threads. Each obstacle region
+ * is then traced along its pixel edges, keeping the obstacle on the right
+ * and turning left first at corners where two obstacle pixels only touch
+ * diagonally, so those count as one obstacle with no gap between them.
+ * The outlines (holes included) are simplified across threads. Outlines
+ * lie on the pixel edges, half a pixel outside the obstacle pixels, since
+ * a node at (x, y) is the pixel at column x and row y
+ * @param pixels RGBA, row by row
+ * @param width
+ * @param height
+ * @param tolerance passed to simplify_outline()
+ * @param num_threads worker threads, 0 for one per core
+ * @param compiled filled with the nodes and outlines
+ */
+inline void compile_map_image(
+    const uint8_t* pixels,
+    uint32_t width,
+    uint32_t height,
+    double tolerance,
+    unsigned num_threads,
+    CompiledMapImage& compiled
+)
+{
+    PROFILE_SCOPE(MapImageCompile);
+    compiled.nodes.clear();
+    compiled.outlines.clear();
+
+    // Classify Pixels, Noting Obstacle Pixels With Free Space Above (Every Outline Has One)
+    const uint8_t OBSTACLE = 1; // higher bits mark the edges of a pixel already traced, by direction
+    std::vector<uint8_t> mask((size_t) width * height, 0);
+    size_t num_bands = (height + MAP_IMAGE_BAND_ROWS - 1) / MAP_IMAGE_BAND_ROWS;
+    std::vector<std::vector<MapImageNode>> band_nodes(num_bands);
+    std::vector<std::vector<size_t>> band_starts(num_bands);
+    parallel_for(num_bands, 1, num_threads, [&](unsigned, size_t first, size_t last) {
+        for (size_t band = first; band < last; band++)
+        {
+            for (size_t y = band * MAP_IMAGE_BAND_ROWS; y < std::min<size_t>(height, (band + 1) * MAP_IMAGE_BAND_ROWS); y++)
+            {
+                for (size_t x = 0; x < width; x++)
+                {
+                    size_t index = y * width + x;
+                    const uint8_t* pixel = pixels + index * 4;
+                    if (is_obstacle_pixel(pixel))
+                    {
+                        mask[index] = OBSTACLE;
+                        if (y == 0 || !is_obstacle_pixel(pixel - (size_t) width * 4))
+                        {
+                            band_starts[band].push_back(index);
+                        }
+                    }
+                    else if (is_named_node_pixel(pixel) || is_unnamed_node_pixel(pixel))
+                    {
+                        band_nodes[band].push_back(MapImageNode{(uint32_t) x, (uint32_t) y, is_named_node_pixel(pixel)});
+                    }
+                }
+            }
+        }
+    });
+    for (const std::vector<MapImageNode>& nodes : band_nodes)
+    {
+        compiled.nodes.insert(compiled.nodes.end(), nodes.begin(), nodes.end());
+    }
+    std::sort(compiled.nodes.begin(), compiled.nodes.end(), [](const MapImageNode& a, const MapImageNode& b) {
+        return a.x != b.x ? a.x < b.x : a.y < b.y;
+    });
+
+    // Walk Each Outline Once, From the Top Edge It Was Found By
+    // Directions are east, south, west, north; the pixel on the right of an
+    // edge leaving corner (x, y) is at (x, y) + right, the one on the left at (x, y) + left
+    const int64_t step_x[4] = {1, 0, -1, 0}, step_y[4] = {0, 1, 0, -1};
+    const int64_t right_x[4] = {0, -1, -1, 0}, right_y[4] = {0, 0, -1, -1};
+    const int64_t left_x[4] = {0, 0, -1, -1}, left_y[4] = {-1, 0, 0, -1};
+    auto is_obstacle = [&](int64_t x, int64_t y) {
+        return x >= 0 && y >= 0 && x < width && y < height && (mask[y * width + x] & OBSTACLE);
+    };
+    auto is_outline_edge = [&](int64_t x, int64_t y, int direction) {
+        return is_obstacle(x + right_x[direction], y + right_y[direction]) && !is_obstacle(x + left_x[direction], y + left_y[direction]);
+    };
+    for (const std::vector<size_t>& starts : band_starts)
+    {
+        for (size_t start : starts)
+        {
+            if (mask[start] & (OBSTACLE << 1))
+            {
+                continue;
+            }
+            int64_t start_x = start % width, start_y = start / width;
+            int64_t x = start_x, y = start_y;
+            int direction = 0;
+            std::vector<sf::Vector2f> outline;
+            do
+            {
+                mask[(y + right_y[direction]) * width + x + right_x[direction]] |= OBSTACLE << (1 + direction);
+                x += step_x[direction];
+                y += step_y[direction];
+                int next = direction;
+                for (int turn : {3, 0, 1})
+                {
+                    if (is_outline_edge(x, y, (direction + turn) % 4))
+                    {
+                        next = (direction + turn) % 4;
+                        break;
+                    }
+                }
+                if (next != direction)
+                {
+                    outline.emplace_back(x - 0.5f, y - 0.5f);
+                }
+                direction = next;
+            } while (x != start_x || y != start_y || direction != 0);
+            compiled.outlines.push_back(std::move(outline));
+        }
+    }
+
+    // Simplify Outlines
+    parallel_for(compiled.outlines.size(), 16, num_threads, [&](unsigned, size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+        {
+            simplify_outline(compiled.outlines[i], tolerance);
+        }
+    });
+}
+
+/**
+ * Writes a compiled map image in the map text format read_map_text() reads
+ * Named nodes get the placeholder name NA, to be renamed by hand
+ * @param out
+ * @param compiled
+ */
+inline void write_map_image_text(std::ostream& out, const CompiledMapImage& compiled)
+{
+    for (const MapImageNode& node : compiled.nodes)
+    {
+        out << (node.named ? "N " : "n ") << node.x << ' ' << node.y << (node.named ? " NA\n" : "\n");
+    }
+    for (const std::vector<sf::Vector2f>& outline : compiled.outlines)
+    {
+        // Outlines Simplified Down to Two Corners Are a Single Wall
+        size_t num_walls = outline.size() > 2 ? outline.size() : 1;
+        for (size_t i = 0; i < num_walls; i++)
+        {
+            sf::Vector2f a = outline[i], b = outline[(i + 1) % outline.size()];
+            char line[128];
+            int length = std::snprintf(line, sizeof(line), "o %.9g %.9g %.9g %.9g\n", a.x, a.y, b.x, b.y);
+            out.write(line, length);
+        }
+    }
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <SFML/Graphics.hpp>
+
+#include "geometry.hpp"
+#include "map_graph.hpp"
+
+/**
+ * Number of sides of the polygons that stand in for circles
+ */
+const int CIRCLE_SEGMENTS = 16;
+
+/**
+ * Adds a filled circle to a triangle batch
+ * @param triangles vertex array of sf::Triangles
+ * @param center
+ * @param radius
+ * @param color
+ */
+inline void append_circle(sf::VertexArray& triangles, sf::Vector2f center, float radius, sf::Color color)
+{
+    const double TAU = 6.283185307179586;
+    sf::Vector2f previous = center + sf::Vector2f(radius, 0);
+    for (int i = 1; i <= CIRCLE_SEGMENTS; i++)
+    {
+        double angle = TAU * i / CIRCLE_SEGMENTS;
+        sf::Vector2f next = center + sf::Vector2f(radius * std::cos(angle), radius * std::sin(angle));
+        triangles.append(sf::Vertex(center, color));
+        triangles.append(sf::Vertex(previous, color));
+        triangles.append(sf::Vertex(next, color));
+        previous = next;
+    }
+}
+
+/**
+ * Adds a thick line with round ends to a triangle batch
+ * @param triangles vertex array of sf::Triangles
+ * @param pt1 first endpoint
+ * @param pt2 second endpoint
+ * @param thickness line thickness
+ * @param color line color
+ */
+inline void append_line(sf::VertexArray& triangles, sf::Vector2f pt1, sf::Vector2f pt2, double thickness, sf::Color color)
+{
+    double theta = std::atan2(pt2.y - pt1.y, pt2.x - pt1.x);
+    double t = thickness / 2;
+    sf::Vector2f side((float) (t * std::sin(theta)), (float) (-t * std::cos(theta)));
+
+    // Line Body
+    sf::Vertex corners[4] = {
+        sf::Vertex(pt1 + side, color),
+        sf::Vertex(pt2 + side, color),
+        sf::Vertex(pt2 - side, color),
+        sf::Vertex(pt1 - side, color)
+    };
+    triangles.append(corners[0]);
+    triangles.append(corners[1]);
+    triangles.append(corners[2]);
+    triangles.append(corners[0]);
+    triangles.append(corners[2]);
+    triangles.append(corners[3]);
+
+    // Round Ends
+    append_circle(triangles, pt1, t, color);
+    append_circle(triangles, pt2, t, color);
+}
+
+/**
+ * @param view
+ * @return part of the map the view shows
+ */
+inline sf::FloatRect view_area(const sf::View& view)
+{
+    return sf::FloatRect(view.getCenter() - view.getSize() / 2.0f, view.getSize());
+}
+
+/**
+ * Side of the squares a CulledLayer groups its primitives by, in map pixels
+ */
+const float LAYER_CHUNK_SIZE = 256;
+
+/**
+ * Vertex array split into chunks by position, so only chunks in view are drawn
+ * Each primitive goes in the chunk of the point it is added at, and each
+ * chunk remembers the bounds of everything in it, so a primitive reaching
+ * into the view from a chunk outside it is still drawn
+ */
+struct CulledLayer
+{
+    sf::PrimitiveType type;
+    std::vector<sf::VertexArray> chunks;
+    std::vector<sf::FloatRect> chunk_bounds; // filled in by finish()
+    std::unordered_map<uint64_t, size_t> chunk_of_cell;
+
+    explicit CulledLayer(sf::PrimitiveType type) : type(type) {}
+
+    void clear()
+    {
+        chunks.clear();
+        chunk_bounds.clear();
+        chunk_of_cell.clear();
+    }
+
+    /**
+     * @param point
+     * @return vertex array of the chunk the point lies in, to append a primitive to
+     */
+    sf::VertexArray& chunk_at(sf::Vector2f point)
+    {
+        uint32_t column = (uint32_t) (int32_t) std::floor(point.x / LAYER_CHUNK_SIZE);
+        uint32_t row = (uint32_t) (int32_t) std::floor(point.y / LAYER_CHUNK_SIZE);
+        auto [cell, added] = chunk_of_cell.emplace((uint64_t) column << 32 | row, chunks.size());
+        if (added)
+        {
+            chunks.emplace_back(type);
+        }
+        return chunks[cell->second];
+    }
+
+    /**
+     * Measures every chunk; call once all primitives are added
+     */
+    void finish()
+    {
+        chunk_bounds.clear();
+        for (const sf::VertexArray& chunk : chunks)
+        {
+            float min_x = chunk[0].position.x, max_x = min_x;
+            float min_y = chunk[0].position.y, max_y = min_y;
+            for (size_t i = 1; i < chunk.getVertexCount(); i++)
+            {
+                min_x = std::min(min_x, chunk[i].position.x);
+                max_x = std::max(max_x, chunk[i].position.x);
+                min_y = std::min(min_y, chunk[i].position.y);
+                max_y = std::max(max_y, chunk[i].position.y);
+            }
+            chunk_bounds.emplace_back(min_x, min_y, max_x - min_x, max_y - min_y);
+        }
+    }
+
+    /**
+     * Draws the chunks that reach into an area
+     * @param window
+     * @param area visible part of the map
+     */
+    void draw(sf::RenderWindow& window, const sf::FloatRect& area) const
+    {
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            // Grow Bounds by a Pixel, So Flat Chunks (One Straight Line) Still Intersect
+            sf::FloatRect bounds(chunk_bounds[i].left - 1, chunk_bounds[i].top - 1, chunk_bounds[i].width + 2, chunk_bounds[i].height + 2);
+            if (bounds.intersects(area))
+            {
+                window.draw(chunks[i]);
+            }
+        }
+    }
+};
+
+/**
+ * Parts of the map that only change with the map, batched for drawing
+ * Each layer is split into a few chunks by position, so a frame takes one
+ * draw call per chunk in view however big the map is. Rebuild after the map changes
+ */
+struct MapLayers
+{
+    CulledLayer walls = CulledLayer(sf::Lines);
+    CulledLayer edges = CulledLayer(sf::Lines); // each connection once
+    CulledLayer named_nodes = CulledLayer(sf::Triangles);
+    CulledLayer waypoint_nodes = CulledLayer(sf::Triangles); // unnamed nodes, shown in debug mode
+
+    /**
+     * @param graph
+     * @param map_walls
+     */
+    void build(const MapGraph& graph, const std::vector<Wall>& map_walls)
+    {
+        walls.clear();
+        for (const Wall& wall : map_walls)
+        {
+            sf::VertexArray& chunk = walls.chunk_at(wall.a);
+            chunk.append(sf::Vertex(wall.a, sf::Color::Red));
+            chunk.append(sf::Vertex(wall.b, sf::Color::Red));
+        }
+
+        edges.clear();
+        named_nodes.clear();
+        waypoint_nodes.clear();
+        for (NodeId node = 0; node < graph.node_count(); node++)
+        {
+            sf::Vector2f position(graph.x[node], graph.y[node]);
+            CulledLayer& nodes = graph.is_named(node) ? named_nodes : waypoint_nodes;
+            append_circle(nodes.chunk_at(position), position, 5, sf::Color::White);
+
+            for (uint32_t edge = graph.offsets[node]; edge < graph.offsets[node + 1]; edge++)
+            {
+                NodeId neighbor = graph.targets[edge];
+                if (neighbor > node)
+                {
+                    sf::VertexArray& chunk = edges.chunk_at(position);
+                    chunk.append(sf::Vertex(position, sf::Color::Yellow));
+                    chunk.append(sf::Vertex(sf::Vector2f(graph.x[neighbor], graph.y[neighbor]), sf::Color::Yellow));
+                }
+            }
+        }
+
+        walls.finish();
+        edges.finish();
+        named_nodes.finish();
+        waypoint_nodes.finish();
+    }
+};
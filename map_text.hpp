@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "geometry.hpp"
+#include "map_graph.hpp"
+
+/**
+ * Problem with one line of map text
+ * The line is skipped; the rest of the map is still read
+ */
+struct MapTextError
+{
+    size_t line = 0; // counted from 1
+    size_t column = 0; // counted from 1
+    std::string message;
+};
+
+/**
+ * Bytes read from the stream at a time
+ * A line longer than this still gets read whole, by growing the buffer
+ */
+const size_t MAP_TEXT_CHUNK_SIZE = 1 << 16;
+
+/**
+ * Reading position within one line of map text
+ * Helper for read_map_line()
+ */
+struct MapLineCursor
+{
+    const char* line_start;
+    const char* position;
+    const char* line_end;
+
+    size_t column() const
+    {
+        return position - line_start + 1;
+    }
+
+    static bool is_space(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    void skip_spaces()
+    {
+        while (position < line_end && is_space(*position))
+        {
+            position++;
+        }
+    }
+
+    /**
+     * Reads the next word, up to a space or the end of the line
+     * @return word, empty at the end of the line
+     */
+    std::string_view read_word()
+    {
+        skip_spaces();
+        const char* word_start = position;
+        while (position < line_end && !is_space(*position))
+        {
+            position++;
+        }
+        return std::string_view(word_start, position - word_start);
+    }
+
+    /**
+     * Reads the next word as a number
+     * On failure the cursor is left at the start of the word
+     * @param value set to the number
+     * @return boolean whether the whole word was a finite number
+     */
+    bool read_number(float& value)
+    {
+        skip_spaces();
+        const char* first = position;
+        const char* number_start = first < line_end && *first == '+' ? first + 1 : first;
+        auto [number_end, error] = std::from_chars(number_start, line_end, value);
+        if (error != std::errc() || (number_end < line_end && !is_space(*number_end)) || !std::isfinite(value))
+        {
+            position = first;
+            return false;
+        }
+        position = number_end;
+        return true;
+    }
+};
+
+/**
+ * Reads one line of map text (without its newline) into walls and graph
+ * Helper for read_map_text()
+ * @param first start of the line
+ * @param last end of the line
+ * @param line_number counted from 1, for errors
+ * @param walls
+ * @param areas
+ * @param graph
+ * @param start_node
+ * @param end_node
+ * @param errors gets a problem if the line is malformed
+ */
+inline void read_map_line(
+    const char* first,
+    const char* last,
+    size_t line_number,
+    std::vector<Wall>& walls,
+    std::vector<MapArea>& areas,
+    MapGraphStorage& graph,
+    NodeId& start_node,
+    NodeId& end_node,
+    std::vector<MapTextError>& errors
+)
+{
+    MapLineCursor cursor{first, first, last};
+    auto fail = [&](const char* message) {
+        errors.push_back(MapTextError{line_number, cursor.column(), message});
+    };
+    auto add_wall = [&](sf::Vector2f a, sf::Vector2f b) {
+        Wall wall;
+        wall.a = a;
+        wall.b = b;
+        walls.push_back(wall);
+    };
+
+    // Ignore Blank Lines and Comments
+    cursor.skip_spaces();
+    if (cursor.position == last || *cursor.position == '#')
+    {
+        return;
+    }
+
+    // Get Command
+    const char* command_start = cursor.position;
+    std::string_view command = cursor.read_word();
+    if (command.size() != 1 || std::string_view("obanNse").find(command[0]) == std::string_view::npos)
+    {
+        cursor.position = command_start;
+        fail("unknown command");
+        return;
+    }
+
+    // Read Coordinates
+    float numbers[4];
+    int num_numbers = command[0] == 'o' || command[0] == 'b' || command[0] == 'a' ? 4 : 2;
+    for (int i = 0; i < num_numbers; i++)
+    {
+        if (!cursor.read_number(numbers[i]))
+        {
+            fail(cursor.position == last ? "expected a number before the end of the line" : "expected a number");
+            return;
+        }
+    }
+    float x = numbers[0], y = numbers[1], x2 = numbers[2], y2 = numbers[3];
+
+    // Read Name (Left Empty if Missing, as Some Maps Have It)
+    std::string_view name = " ";
+    if (command[0] == 'N')
+    {
+        name = cursor.read_word();
+    }
+
+    // Read Area Flags, At Least One
+    EdgeFlags flags = 0;
+    while (command[0] == 'a')
+    {
+        const char* flag_start = cursor.position;
+        std::string_view flag_name = cursor.read_word();
+        EdgeFlags flag;
+        if (flag_name.empty() && flags != 0)
+        {
+            break;
+        }
+        if (!parse_edge_flag(flag_name, flag))
+        {
+            cursor.position = flag_start;
+            cursor.skip_spaces();
+            fail(flag_name.empty() ? "expected an area flag before the end of the line" : "unknown area flag");
+            return;
+        }
+        flags |= flag;
+    }
+    cursor.skip_spaces();
+    if (cursor.position != last)
+    {
+        fail("unexpected text after the last field");
+        return;
+    }
+
+    // Do Things Depending on Command
+    switch (command[0])
+    {
+        case 'o': // Line Obstacle
+            add_wall(sf::Vector2f(x, y), sf::Vector2f(x2, y2));
+            break;
+        case 'b': // Box Obstacle
+            add_wall(sf::Vector2f(x, y), sf::Vector2f(x2, y));
+            add_wall(sf::Vector2f(x2, y), sf::Vector2f(x2, y2));
+            add_wall(sf::Vector2f(x, y), sf::Vector2f(x, y2));
+            add_wall(sf::Vector2f(x, y2), sf::Vector2f(x2, y2));
+            break;
+        case 'a': // Area, Given by Two Opposite Corners
+            areas.push_back(MapArea{std::min(x, x2), std::min(y, y2), std::max(x, x2), std::max(y, y2), flags});
+            break;
+        case 'n': // Normal Node
+        case 'N': // Normal Named Node
+            graph.add_node(x, y, name);
+            break;
+        case 's': // Start Node
+            start_node = graph.add_node(x, y, name);
+            break;
+        case 'e': // End Node
+            end_node = graph.add_node(x, y, name);
+            break;
+    }
+}
+
+/**
+ * Reads walls and nodes in the map text format
+ * One item per line, fields separated by spaces:
+ *   o x1 y1 x2 y2   line obstacle
+ *   b x1 y1 x2 y2   box obstacle, given by two opposite corners
+ *   a x1 y1 x2 y2 flag...   area whose flags (stairs, outdoor,
+ *                   closed-at-night) go to every edge crossing it
+ *   n x y           unnamed node
+ *   N x y name      named node (the name may be missing)
+ *   s x y / e x y   start / end node
+ *   # ...           comment
+ * The stream is read in chunks and lines are parsed where they lie in the
+ * chunk, so maps of any size are read without a copy per line. Malformed
+ * lines are skipped and reported in errors
+ * Nodes are added without any connections
+ * @param map_file
+ * @param walls gets every wall
+ * @param areas gets every area
+ * @param graph gets every node
+ * @param start_node set if the map has a start node
+ * @param end_node set if the map has an end node
+ * @param errors gets a problem for every malformed line
+ */
+inline void read_map_text(
+    std::istream& map_file,
+    std::vector<Wall>& walls,
+    std::vector<MapArea>& areas,
+    MapGraphStorage& graph,
+    NodeId& start_node,
+    NodeId& end_node,
+    std::vector<MapTextError>& errors
+)
+{
+    std::vector<char> buffer(MAP_TEXT_CHUNK_SIZE);
+    size_t kept = 0; // bytes of an unfinished line at the front of buffer
+    size_t line_number = 1;
+    while (true)
+    {
+        // Fill the Buffer After the Unfinished Line, Growing It if the Line Fills It
+        if (kept == buffer.size())
+        {
+            buffer.resize(buffer.size() * 2);
+        }
+        map_file.read(buffer.data() + kept, buffer.size() - kept);
+        size_t num_read = map_file.gcount();
+        const char* line_start = buffer.data();
+        const char* filled_end = buffer.data() + kept + num_read;
+
+        // Last Line May Not End in a Newline
+        if (num_read == 0)
+        {
+            if (kept > 0)
+            {
+                read_map_line(line_start, filled_end, line_number, walls, areas, graph, start_node, end_node, errors);
+            }
+            return;
+        }
+
+        // Read Every Whole Line
+        const char* newline;
+        while ((newline = (const char*) std::memchr(line_start, '\n', filled_end - line_start)) != nullptr)
+        {
+            read_map_line(line_start, newline, line_number, walls, areas, graph, start_node, end_node, errors);
+            line_number++;
+            line_start = newline + 1;
+        }
+        kept = filled_end - line_start;
+        std::memmove(buffer.data(), line_start, kept);
+    }
+}
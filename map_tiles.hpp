@@ -0,0 +1,452 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <SFML/Graphics.hpp>
+
+#include "map_cache.hpp"
+#include "map_render.hpp"
+#include "profiling.hpp"
+
+/**
+ * Width and height of a background tile in pixels (edge tiles may be smaller)
+ */
+const unsigned MAP_TILE_SIZE = 512;
+
+/**
+ * Version of the tile pyramid layout, bumped whenever it changes
+ */
+const uint32_t MAP_TILE_VERSION = 1;
+
+/**
+ * Tiles kept as textures at once, besides the top level
+ * Enough for a full screen of tiles at two neighboring levels
+ */
+const size_t MAX_RESIDENT_TILES = 96;
+
+/**
+ * Tiles turned into textures per frame, so a burst of finished loads
+ * cannot stall a frame
+ */
+const size_t MAX_TILE_UPLOADS_PER_FRAME = 4;
+
+/**
+ * Background image cut into tiles at several levels of detail
+ * Level 0 is the image itself; each level above halves the resolution,
+ * and the top level fits in a single tile. Tiles are stored as
+ * <image>.tiles/<level>_<column>_<row>.png next to an index file that
+ * records the image size and checksum
+ */
+struct TilePyramid
+{
+    std::string directory; // with a trailing slash
+    unsigned width = 0; // of level 0
+    unsigned height = 0;
+    unsigned levels = 0;
+
+    unsigned level_width(unsigned level) const
+    {
+        return std::max(1u, (width + (1u << level) - 1) >> level);
+    }
+
+    unsigned level_height(unsigned level) const
+    {
+        return std::max(1u, (height + (1u << level) - 1) >> level);
+    }
+
+    unsigned columns(unsigned level) const
+    {
+        return (level_width(level) + MAP_TILE_SIZE - 1) / MAP_TILE_SIZE;
+    }
+
+    unsigned rows(unsigned level) const
+    {
+        return (level_height(level) + MAP_TILE_SIZE - 1) / MAP_TILE_SIZE;
+    }
+
+    unsigned top_level() const
+    {
+        return levels - 1;
+    }
+
+    std::string tile_path(unsigned level, unsigned column, unsigned row) const
+    {
+        return directory + std::to_string(level) + "_" + std::to_string(column) + "_" + std::to_string(row) + ".png";
+    }
+
+    std::string index_path() const
+    {
+        return directory + "index.txt";
+    }
+};
+
+/**
+ * @param image_path
+ * @return directory holding the image's tiles
+ */
+inline std::string tile_directory(const std::string& image_path)
+{
+    return image_path + ".tiles/";
+}
+
+/**
+ * Opens the tile pyramid of an image, if one was built from the image as it is now
+ * @param image_path
+ * @param checksum checksum_file() of the image
+ * @param pyramid filled in from the index
+ * @return boolean whether the pyramid exists and matches the image
+ */
+inline bool open_tile_pyramid(const std::string& image_path, uint64_t checksum, TilePyramid& pyramid)
+{
+    pyramid.directory = tile_directory(image_path);
+    std::ifstream index(pyramid.index_path());
+    uint32_t version = 0;
+    uint64_t source_checksum = 0;
+    unsigned tile_size = 0;
+    if (!(index >> version >> source_checksum >> tile_size >> pyramid.width >> pyramid.height >> pyramid.levels))
+    {
+        return false;
+    }
+    return version == MAP_TILE_VERSION && source_checksum == checksum && tile_size == MAP_TILE_SIZE && pyramid.levels > 0;
+}
+
+/**
+ * Halves an image, averaging each 2x2 block of pixels
+ * Helper for build_tile_pyramid()
+ * @param image
+ * @return image of half the size, rounded up
+ */
+inline sf::Image halve_image(const sf::Image& image)
+{
+    unsigned width = image.getSize().x, height = image.getSize().y;
+    unsigned half_width = std::max(1u, (width + 1) / 2), half_height = std::max(1u, (height + 1) / 2);
+    const sf::Uint8* pixels = image.getPixelsPtr();
+    std::vector<sf::Uint8> half((size_t) half_width * half_height * 4);
+    for (unsigned y = 0; y < half_height; y++)
+    {
+        for (unsigned x = 0; x < half_width; x++)
+        {
+            // Odd Edges Average the Pixels They Have
+            unsigned x1 = std::min(2 * x + 1, width - 1), y1 = std::min(2 * y + 1, height - 1);
+            for (int channel = 0; channel < 4; channel++)
+            {
+                unsigned sum = pixels[((size_t) 2 * y * width + 2 * x) * 4 + channel]
+                             + pixels[((size_t) 2 * y * width + x1) * 4 + channel]
+                             + pixels[((size_t) y1 * width + 2 * x) * 4 + channel]
+                             + pixels[((size_t) y1 * width + x1) * 4 + channel];
+                half[((size_t) y * half_width + x) * 4 + channel] = (sf::Uint8) ((sum + 2) / 4);
+            }
+        }
+    }
+    sf::Image result;
+    result.create(half_width, half_height, half.data());
+    return result;
+}
+
+/**
+ * Cuts an image into a tile pyramid and writes it next to the image
+ * Needs the whole image in memory once; do it offline (--tile) for very
+ * large scans, so the program itself only ever loads single tiles
+ * @param image_path
+ * @param checksum checksum_file() of the image
+ * @param pyramid filled in with the new pyramid
+ * @return boolean whether the image could be read and every tile written
+ */
+inline bool build_tile_pyramid(const std::string& image_path, uint64_t checksum, TilePyramid& pyramid)
+{
+    PROFILE_SCOPE(TilePyramidBuild);
+    sf::Image level_image;
+    if (!level_image.loadFromFile(image_path))
+    {
+        return false;
+    }
+    pyramid.directory = tile_directory(image_path);
+    pyramid.width = level_image.getSize().x;
+    pyramid.height = level_image.getSize().y;
+    pyramid.levels = 1;
+    while (pyramid.columns(pyramid.levels - 1) > 1 || pyramid.rows(pyramid.levels - 1) > 1)
+    {
+        pyramid.levels++;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(pyramid.directory, error);
+
+    // Cut Each Level Into Tiles, Then Halve It for the Next
+    for (unsigned level = 0; level < pyramid.levels; level++)
+    {
+        for (unsigned row = 0; row < pyramid.rows(level); row++)
+        {
+            for (unsigned column = 0; column < pyramid.columns(level); column++)
+            {
+                unsigned left = column * MAP_TILE_SIZE, top = row * MAP_TILE_SIZE;
+                unsigned tile_width = std::min(MAP_TILE_SIZE, level_image.getSize().x - left);
+                unsigned tile_height = std::min(MAP_TILE_SIZE, level_image.getSize().y - top);
+                sf::Image tile;
+                tile.create(tile_width, tile_height);
+                tile.copy(level_image, 0, 0, sf::IntRect(left, top, tile_width, tile_height));
+                if (!tile.saveToFile(pyramid.tile_path(level, column, row)))
+                {
+                    return false;
+                }
+            }
+        }
+        if (level + 1 < pyramid.levels)
+        {
+            level_image = halve_image(level_image);
+        }
+    }
+
+    // Index Goes Last, So a Half-Written Pyramid Is Never Used
+    std::ofstream index(pyramid.index_path(), std::ios::trunc);
+    index << MAP_TILE_VERSION << " " << checksum << " " << MAP_TILE_SIZE << " "
+          << pyramid.width << " " << pyramid.height << " " << pyramid.levels << "\n";
+    return (bool) index;
+}
+
+/**
+ * Opens the tile pyramid of an image, building it first if it is missing or out of date
+ * @param image_path
+ * @param pyramid
+ * @return boolean whether the pyramid can be used
+ */
+inline bool load_tile_pyramid(const std::string& image_path, TilePyramid& pyramid)
+{
+    uint64_t checksum;
+    if (!checksum_file(image_path, checksum))
+    {
+        return false;
+    }
+    return open_tile_pyramid(image_path, checksum, pyramid) || build_tile_pyramid(image_path, checksum, pyramid);
+}
+
+/**
+ * Level of detail to draw at
+ * @param pyramid
+ * @param map_pixels_per_screen_pixel how far the view is zoomed out (1 shows the image at its own size)
+ * @return finest level whose pixels are no larger than a screen pixel
+ */
+inline unsigned tile_level_for_scale(const TilePyramid& pyramid, double map_pixels_per_screen_pixel)
+{
+    double level = std::floor(std::log2(std::max(map_pixels_per_screen_pixel, 1.0)));
+    return (unsigned) std::min<double>(level, pyramid.top_level());
+}
+
+/**
+ * Tiles of a level that overlap an area of the map
+ * @param pyramid
+ * @param level
+ * @param area in map (level 0) pixels
+ * @param first set to the first column and row
+ * @param last set to one past the last column and row
+ */
+inline void visible_tiles(const TilePyramid& pyramid, unsigned level, const sf::FloatRect& area, sf::Vector2u& first, sf::Vector2u& last)
+{
+    double tile_span = (double) MAP_TILE_SIZE * (1u << level);
+    auto clamp_tile = [&](double position, unsigned count) {
+        return (unsigned) std::clamp(std::floor(position / tile_span), 0.0, (double) count);
+    };
+    first = sf::Vector2u(clamp_tile(area.left, pyramid.columns(level)), clamp_tile(area.top, pyramid.rows(level)));
+    last = sf::Vector2u(clamp_tile(area.left + area.width + tile_span, pyramid.columns(level)),
+                        clamp_tile(area.top + area.height + tile_span, pyramid.rows(level)));
+}
+
+/**
+ * Draws a tile pyramid, loading the tiles the view needs in the background
+ * A worker thread decodes tile files; the drawing thread turns them into
+ * textures a few per frame and drops the least recently drawn ones past
+ * MAX_RESIDENT_TILES. The top level is always loaded and drawn first, so
+ * tiles still loading show up blurry instead of missing
+ */
+class TileStreamer
+{
+public:
+    explicit TileStreamer(const TilePyramid& pyramid) : pyramid(pyramid)
+    {
+        top_texture.loadFromFile(pyramid.tile_path(pyramid.top_level(), 0, 0));
+        top_texture.setSmooth(true);
+        loader = std::thread([this]() { load_tiles(); });
+    }
+
+    TileStreamer(const TileStreamer&) = delete;
+    TileStreamer& operator=(const TileStreamer&) = delete;
+
+    ~TileStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake_loader.notify_one();
+        loader.join();
+    }
+
+    /**
+     * Draws the part of the background in the window's current view
+     * @param window
+     */
+    void draw(sf::RenderWindow& window)
+    {
+        frame++;
+        const sf::View& view = window.getView();
+        sf::FloatRect area = view_area(view);
+        unsigned level = tile_level_for_scale(pyramid, view.getSize().x / window.getSize().x);
+
+        // Top Level Under Everything
+        draw_tile(window, top_texture, pyramid.top_level(), 0, 0);
+
+        // Draw Loaded Tiles, Asking for the Rest
+        std::vector<uint64_t> wanted;
+        if (level < pyramid.top_level())
+        {
+            sf::Vector2u first, last;
+            visible_tiles(pyramid, level, area, first, last);
+            for (unsigned row = first.y; row < last.y; row++)
+            {
+                for (unsigned column = first.x; column < last.x; column++)
+                {
+                    uint64_t key = tile_key(level, column, row);
+                    auto tile = resident.find(key);
+                    if (tile == resident.end())
+                    {
+                        wanted.push_back(key);
+                        continue;
+                    }
+                    tile->second.last_drawn = frame;
+                    draw_tile(window, tile->second.texture, level, column, row);
+                }
+            }
+        }
+
+        // Trade Requests for Finished Tiles
+        std::vector<std::pair<uint64_t, sf::Image>> finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            wanted.erase(std::remove_if(wanted.begin(), wanted.end(), [&](uint64_t key) { return loading.count(key) > 0; }), wanted.end());
+            std::reverse(wanted.begin(), wanted.end()); // loader takes from the back, so the top left loads first
+            this->wanted = std::move(wanted);
+            size_t num_taken = std::min(ready.size(), MAX_TILE_UPLOADS_PER_FRAME);
+            for (size_t i = 0; i < num_taken; i++)
+            {
+                loading.erase(ready[i].first);
+            }
+            finished.assign(std::make_move_iterator(ready.begin()), std::make_move_iterator(ready.begin() + num_taken));
+            ready.erase(ready.begin(), ready.begin() + num_taken);
+        }
+        wake_loader.notify_one();
+
+        // Upload Finished Tiles; They Show From the Next Frame On
+        for (auto& [key, image] : finished)
+        {
+            ResidentTile& tile = resident[key];
+            tile.texture.loadFromImage(image);
+            tile.texture.setSmooth(true);
+            tile.last_drawn = frame;
+        }
+        evict();
+    }
+
+    size_t resident_tile_count() const
+    {
+        return resident.size();
+    }
+
+private:
+    struct ResidentTile
+    {
+        sf::Texture texture;
+        uint64_t last_drawn = 0; // frame number
+    };
+
+    static uint64_t tile_key(unsigned level, unsigned column, unsigned row)
+    {
+        return (uint64_t) level << 48 | (uint64_t) column << 24 | row;
+    }
+
+    void draw_tile(sf::RenderWindow& window, const sf::Texture& texture, unsigned level, unsigned column, unsigned row)
+    {
+        float scale = (float) (1u << level);
+        sf::Sprite sprite(texture);
+        sprite.setPosition(column * MAP_TILE_SIZE * scale, row * MAP_TILE_SIZE * scale);
+        sprite.setScale(scale, scale);
+        window.draw(sprite);
+    }
+
+    /**
+     * Drops the least recently drawn tiles past MAX_RESIDENT_TILES
+     */
+    void evict()
+    {
+        if (resident.size() <= MAX_RESIDENT_TILES)
+        {
+            return;
+        }
+        std::vector<std::pair<uint64_t, uint64_t>> by_age; // (last drawn, key)
+        for (const auto& [key, tile] : resident)
+        {
+            by_age.emplace_back(tile.last_drawn, key);
+        }
+        size_t num_dropped = resident.size() - MAX_RESIDENT_TILES;
+        std::nth_element(by_age.begin(), by_age.begin() + num_dropped, by_age.end());
+        for (size_t i = 0; i < num_dropped; i++)
+        {
+            resident.erase(by_age[i].second);
+        }
+    }
+
+    /**
+     * Loader thread: decodes the most recently wanted tile until stopped
+     */
+    void load_tiles()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            wake_loader.wait(lock, [&]() { return stopping || !wanted.empty(); });
+            if (stopping)
+            {
+                return;
+            }
+            uint64_t key = wanted.back();
+            wanted.pop_back();
+            loading.insert(key);
+            lock.unlock();
+
+            // Decode Without Holding the Lock
+            unsigned level = key >> 48, column = (key >> 24) & 0xFFFFFF, row = key & 0xFFFFFF;
+            sf::Image image;
+            bool loaded = image.loadFromFile(pyramid.tile_path(level, column, row));
+            PROFILE_COUNT(TileLoads, 1);
+
+            lock.lock();
+            if (loaded)
+            {
+                ready.emplace_back(key, std::move(image));
+            }
+        }
+    }
+
+    TilePyramid pyramid;
+    sf::Texture top_texture;
+    std::unordered_map<uint64_t, ResidentTile> resident; // drawing thread only
+    uint64_t frame = 0;
+
+    // Shared With the Loader Thread
+    std::mutex mutex;
+    std::condition_variable wake_loader;
+    std::vector<uint64_t> wanted; // tiles the last frame needed, taken from the back
+    std::unordered_set<uint64_t> loading; // taken by the loader and not yet uploaded (or unreadable)
+    std::vector<std::pair<uint64_t, sf::Image>> ready; // decoded, waiting for upload
+    bool stopping = false;
+    std::thread loader;
+};
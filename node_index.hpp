@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "geometry.hpp"
+#include "map_graph.hpp"
+
+/**
+ * Uniform grid over node positions, used to find the nodes inside a region
+ * Cells are sized from the nodes present at build(); nodes inserted later
+ * outside that area go into the nearest edge cell, and the outer columns and
+ * rows stretch out to infinity in queries, so no node is ever missed
+ */
+struct NodeGrid
+{
+    double origin_x = 0;
+    double origin_y = 0;
+    double cell_size = 1;
+    int columns = 1;
+    int rows = 1;
+    std::vector<std::vector<NodeId>> cells = std::vector<std::vector<NodeId>>(1);
+
+    // Bounding Box of Every Node Inserted, Empty While min_x > max_x
+    double min_x = std::numeric_limits<double>::infinity();
+    double min_y = std::numeric_limits<double>::infinity();
+    double max_x = -std::numeric_limits<double>::infinity();
+    double max_y = -std::numeric_limits<double>::infinity();
+
+    /**
+     * Rebuilds the grid from every node of a graph
+     * @param graph
+     */
+    void build(const MapGraph& graph)
+    {
+        build(graph, [](NodeId) { return true; });
+    }
+
+    /**
+     * Rebuilds the grid from some of the nodes of a graph
+     * @param graph
+     * @param keep called as keep(node), returning whether to index the node
+     */
+    template <class Keep>
+    void build(const MapGraph& graph, Keep keep)
+    {
+        size_t num_kept = 0;
+        double low_x = 0, low_y = 0, high_x = 0, high_y = 0;
+        for (NodeId node = 0; node < graph.node_count(); node++)
+        {
+            if (!keep(node))
+            {
+                continue;
+            }
+            low_x = num_kept == 0 ? graph.x[node] : std::min<double>(low_x, graph.x[node]);
+            low_y = num_kept == 0 ? graph.y[node] : std::min<double>(low_y, graph.y[node]);
+            high_x = num_kept == 0 ? graph.x[node] : std::max<double>(high_x, graph.x[node]);
+            high_y = num_kept == 0 ? graph.y[node] : std::max<double>(high_y, graph.y[node]);
+            num_kept++;
+        }
+        double width = std::max(high_x - low_x, 1.0);
+        double height = std::max(high_y - low_y, 1.0);
+
+        // Size Cells for About One Node Each, With at Most 1024 Cells per Side
+        cell_size = std::sqrt(width * height / std::max<size_t>(num_kept, 1));
+        cell_size = std::max(cell_size, std::max(width, height) / 1024);
+        origin_x = low_x;
+        origin_y = low_y;
+        columns = (int) (width / cell_size) + 1;
+        rows = (int) (height / cell_size) + 1;
+        cells.assign((size_t) columns * rows, std::vector<NodeId>());
+
+        min_x = min_y = std::numeric_limits<double>::infinity();
+        max_x = max_y = -std::numeric_limits<double>::infinity();
+        for (NodeId node = 0; node < graph.node_count(); node++)
+        {
+            if (keep(node))
+            {
+                insert(node, graph.x[node], graph.y[node]);
+            }
+        }
+    }
+
+    /**
+     * Adds a node
+     * @param node
+     * @param x
+     * @param y
+     */
+    void insert(NodeId node, float x, float y)
+    {
+        cells[cell_of(x, y)].push_back(node);
+        min_x = std::min<double>(min_x, x);
+        min_y = std::min<double>(min_y, y);
+        max_x = std::max<double>(max_x, x);
+        max_y = std::max<double>(max_y, y);
+    }
+
+    /**
+     * Takes out a node, leaving the bounding box as it was
+     * @param node
+     * @param x position it was inserted at
+     * @param y
+     */
+    void remove(NodeId node, float x, float y)
+    {
+        std::vector<NodeId>& cell = cells[cell_of(x, y)];
+        cell.erase(std::remove(cell.begin(), cell.end(), node), cell.end());
+    }
+
+    /**
+     * Calls visit(node) once for every node in the cells a convex polygon covers
+     * The caller still has to test each node against the exact region
+     * @param polygon
+     * @param visit
+     */
+    template <class Visit>
+    void for_each_in_polygon(const ConvexPolygon& polygon, Visit visit) const
+    {
+        if (polygon.empty())
+        {
+            return;
+        }
+
+        double polygon_min_x = polygon[0].x, polygon_max_x = polygon[0].x;
+        for (const sf::Vector2<double>& vertex : polygon)
+        {
+            polygon_min_x = std::min(polygon_min_x, vertex.x);
+            polygon_max_x = std::max(polygon_max_x, vertex.x);
+        }
+
+        int first_column = column_of(polygon_min_x);
+        int last_column = column_of(polygon_max_x);
+        for (int column = first_column; column <= last_column; column++)
+        {
+            // Edge Columns Reach Out to Infinity
+            double strip_start = column == 0 ? -std::numeric_limits<double>::infinity() : origin_x + column * cell_size;
+            double strip_end = column == columns - 1 ? std::numeric_limits<double>::infinity() : origin_x + (column + 1) * cell_size;
+
+            // Height of the Polygon Within This Column
+            double low = std::numeric_limits<double>::infinity();
+            double high = -std::numeric_limits<double>::infinity();
+            for (size_t i = 0; i < polygon.size(); i++)
+            {
+                sf::Vector2<double> p = polygon[i];
+                sf::Vector2<double> q = polygon[(i + 1) % polygon.size()];
+                if (q.x < p.x)
+                {
+                    std::swap(p, q);
+                }
+                double x0 = std::max(p.x, strip_start);
+                double x1 = std::min(q.x, strip_end);
+                if (x0 > x1)
+                {
+                    continue;
+                }
+                double y0 = p.y, y1 = q.y;
+                if (q.x > p.x)
+                {
+                    y0 = p.y + (q.y - p.y) * (x0 - p.x) / (q.x - p.x);
+                    y1 = p.y + (q.y - p.y) * (x1 - p.x) / (q.x - p.x);
+                }
+                low = std::min({low, y0, y1});
+                high = std::max({high, y0, y1});
+            }
+            if (low > high)
+            {
+                continue;
+            }
+
+            for (int row = row_of(low); row <= row_of(high); row++)
+            {
+                for (NodeId node : cells[(size_t) row * columns + column])
+                {
+                    visit(node);
+                }
+            }
+        }
+    }
+
+    /**
+     * Finds the closest node to a point
+     * @param graph graph holding the node positions
+     * @param x
+     * @param y
+     * @param max_distance only nodes at most this far away are considered
+     * @return nearest node, NO_NODE if none is close enough
+     */
+    NodeId nearest(const MapGraph& graph, double x, double y, double max_distance) const
+    {
+        return nearest(graph, x, y, max_distance, [](NodeId) { return true; });
+    }
+
+    /**
+     * Finds the closest node to a point that passes a check
+     * Candidates are tried nearest first, so an expensive check runs as few
+     * times as possible
+     * @param graph graph holding the node positions
+     * @param x
+     * @param y
+     * @param max_distance only nodes at most this far away are considered
+     * @param accept called as accept(node), returning whether the node may be picked
+     * @return nearest accepted node, NO_NODE if none is close enough
+     */
+    template <class Accept>
+    NodeId nearest(const MapGraph& graph, double x, double y, double max_distance, Accept accept) const
+    {
+        thread_local std::vector<std::pair<double, NodeId>> candidates;
+        candidates.clear();
+        for (int row = row_of(y - max_distance); row <= row_of(y + max_distance); row++)
+        {
+            for (int column = column_of(x - max_distance); column <= column_of(x + max_distance); column++)
+            {
+                for (NodeId node : cells[(size_t) row * columns + column])
+                {
+                    double distance = std::hypot(graph.x[node] - x, graph.y[node] - y);
+                    if (distance <= max_distance)
+                    {
+                        candidates.emplace_back(distance, node);
+                    }
+                }
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end());
+        for (const std::pair<double, NodeId>& candidate : candidates)
+        {
+            if (accept(candidate.second))
+            {
+                return candidate.second;
+            }
+        }
+        return NO_NODE;
+    }
+
+private:
+    int column_of(double x) const
+    {
+        double column = std::floor((x - origin_x) / cell_size);
+        return (int) std::clamp(column, 0.0, columns - 1.0);
+    }
+
+    int row_of(double y) const
+    {
+        double row = std::floor((y - origin_y) / cell_size);
+        return (int) std::clamp(row, 0.0, rows - 1.0);
+    }
+
+    size_t cell_of(double x, double y) const
+    {
+        return (size_t) row_of(y) * columns + column_of(x);
+    }
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+ * Picks a worker count
+ * @param requested number of threads asked for, 0 for one per core
+ * @return number of threads to use
+ */
+inline unsigned worker_thread_count(unsigned requested)
+{
+    if (requested > 0)
+    {
+        return requested;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**
+ * Number of threads parallel_for() will use, for sizing per-thread buffers up front
+ * @param count
+ * @param block_size
+ * @param num_threads
+ * @return thread count
+ */
+inline unsigned parallel_for_threads(size_t count, size_t block_size, unsigned num_threads)
+{
+    size_t num_blocks = (count + block_size - 1) / block_size;
+    return (unsigned) std::min<size_t>(worker_thread_count(num_threads), std::max<size_t>(num_blocks, 1));
+}
+
+/**
+ * Splits [0, count) into blocks and hands them to worker threads as they free up
+ * The calling thread works as thread 0. Which thread gets which block
+ * varies between runs, so work should write its results by index (or into
+ * per-thread buffers merged afterwards) to stay deterministic
+ * @param count number of items
+ * @param block_size number of items claimed at a time
+ * @param num_threads number of threads, 0 for one per core
+ * @param work called as work(thread_id, first, last) for each block
+ * @return number of threads used
+ */
+template <class Work>
+unsigned parallel_for(size_t count, size_t block_size, unsigned num_threads, Work work)
+{
+    num_threads = parallel_for_threads(count, block_size, num_threads);
+
+    std::atomic<size_t> next_item(0);
+    auto worker = [&](unsigned thread_id) {
+        while (true)
+        {
+            size_t first = next_item.fetch_add(block_size);
+            if (first >= count)
+            {
+                break;
+            }
+            work(thread_id, first, std::min(first + block_size, count));
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned thread_id = 1; thread_id < num_threads; thread_id++)
+    {
+        threads.emplace_back(worker, thread_id);
+    }
+    worker(0);
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    return num_threads;
+}
@@ -0,0 +1,673 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "map_graph.hpp"
+#include "profiling.hpp"
+
+/**
+ * Cost of a node that has not been reached by the current search
+ */
+const double UNREACHED_COST = 1000000;
+
+/**
+ * Entry in Dijkstra's priority queue
+ * Entries are never updated in place, so a node may appear more than once;
+ * only the first time it is popped counts, later copies are skipped
+ */
+typedef std::pair<double, NodeId> QueueEntry;
+
+/**
+ * Min-heap of queue entries, ordered as a std::priority_queue with
+ * std::greater would be, but kept in a SearchState so its storage is
+ * reused by the next search instead of allocated again
+ */
+class SearchQueue
+{
+public:
+    bool empty() const
+    {
+        return entries.empty();
+    }
+
+    const QueueEntry& top() const
+    {
+        return entries.front();
+    }
+
+    void push(QueueEntry entry)
+    {
+        entries.push_back(entry);
+        std::push_heap(entries.begin(), entries.end(), std::greater<QueueEntry>());
+    }
+
+    void pop()
+    {
+        std::pop_heap(entries.begin(), entries.end(), std::greater<QueueEntry>());
+        entries.pop_back();
+    }
+
+    void clear()
+    {
+        entries.clear();
+    }
+
+private:
+    std::vector<QueueEntry> entries;
+};
+
+/**
+ * Per-query Dijkstra data (cost, visited, previous) kept apart from the graph
+ * Every node carries the round it was last written in, so starting a new
+ * search only bumps the round instead of clearing every array
+ * Costs are sums of float edge weights kept in a double, which is exact for
+ * map-sized distances, so the order edges are added in never changes the
+ * result and every search strategy reports the same bits for the same path
+ */
+struct SearchState
+{
+    std::vector<double> cost;
+    std::vector<NodeId> previous;
+    std::vector<uint32_t> reached_round;
+    std::vector<uint32_t> visited_round;
+    SearchQueue queue; // nodes waiting to be settled, emptied by reset()
+    uint32_t round = 0;
+    uint32_t nodes_expanded = 0; // nodes settled by the last search
+    uint32_t edges_relaxed = 0; // edges that lowered a node's cost in the last search
+    uint32_t heap_pushes = 0;
+    uint32_t heap_pops = 0;
+
+    /**
+     * Forgets the previous search
+     * Arrays only ever grow, so searches of slightly different sizes
+     * (with or without a query's extra points) share them
+     * @param num_nodes number of node ids in the search to come
+     */
+    void reset(size_t num_nodes)
+    {
+        if (cost.size() < num_nodes)
+        {
+            cost.assign(num_nodes, UNREACHED_COST);
+            previous.assign(num_nodes, NO_NODE);
+            reached_round.assign(num_nodes, 0);
+            visited_round.assign(num_nodes, 0);
+            round = 0;
+        }
+
+        // Rounds Wrapped Around, Old Marks Would Look Current
+        if (++round == 0)
+        {
+            std::fill(reached_round.begin(), reached_round.end(), 0);
+            std::fill(visited_round.begin(), visited_round.end(), 0);
+            round = 1;
+        }
+        queue.clear();
+        nodes_expanded = 0;
+        edges_relaxed = 0;
+        heap_pushes = 0;
+        heap_pops = 0;
+    }
+
+    bool is_reached(NodeId node) const
+    {
+        return reached_round[node] == round;
+    }
+
+    bool is_visited(NodeId node) const
+    {
+        return visited_round[node] == round;
+    }
+
+    double get_cost(NodeId node) const
+    {
+        return is_reached(node) ? cost[node] : UNREACHED_COST;
+    }
+
+    NodeId get_previous(NodeId node) const
+    {
+        return is_reached(node) ? previous[node] : NO_NODE;
+    }
+
+    void set(NodeId node, double new_cost, NodeId new_previous)
+    {
+        cost[node] = new_cost;
+        previous[node] = new_previous;
+        reached_round[node] = round;
+    }
+
+    void visit(NodeId node)
+    {
+        visited_round[node] = round;
+    }
+};
+
+/**
+ * Adds the tallies of a finished search to the profile
+ * @param state
+ */
+inline void profile_search(const SearchState& state)
+{
+    PROFILE_COUNT(NodesExpanded, state.nodes_expanded);
+    PROFILE_COUNT(EdgeRelaxations, state.edges_relaxed);
+    PROFILE_COUNT(HeapPushes, state.heap_pushes);
+    PROFILE_COUNT(HeapPops, state.heap_pops);
+}
+
+/**
+ * Uses Dijkstra's Algorithm to find the shortest path between two nodes
+ * Fills cost and previous for every node settled before the end node
+ * Besides the graph's edges, the search can follow edges that are not
+ * stored in it, leading to or from ids past the graph's last node, so a
+ * single query can add nodes without changing the shared graph
+ * @param graph graph to search
+ * @param state search data, reset by this function
+ * @param start_node
+ * @param end_node node to stop at, or NO_NODE to settle every node
+ * @param num_ids number of node ids in the search, at least graph.node_count()
+ * @param extra_edges called as extra_edges(node, relax) when a node is
+ *        settled, calling relax(neighbor, weight) for every extra edge out of it
+ */
+template <class ExtraEdges>
+void find_path_dijkstra(
+    const MapGraph& graph,
+    SearchState& state,
+    NodeId start_node,
+    NodeId end_node,
+    size_t num_ids,
+    ExtraEdges extra_edges
+)
+{
+    state.reset(num_ids);
+    SearchQueue& queue = state.queue;
+
+    state.set(start_node, 0, NO_NODE);
+    queue.push(QueueEntry(0, start_node));
+    state.heap_pushes++;
+
+    // Loop Until End Node is Settled or No Reachable Nodes Remain
+    while (!queue.empty())
+    {
+        // Visit Unvisited Node with the Least Cost
+        NodeId current_node = queue.top().second;
+        queue.pop();
+        state.heap_pops++;
+        if (state.is_visited(current_node))
+        {
+            continue;
+        }
+        state.visit(current_node);
+        state.nodes_expanded++;
+
+        // Stop Early Once the End Node's Path is Final
+        if (current_node == end_node)
+        {
+            break;
+        }
+
+        // If the previously determined path to a neighbor is longer
+        // than going through the current node,
+        // update the path to the neighbor
+        double current_cost = state.cost[current_node];
+        auto relax = [&](NodeId neighbor, float weight) {
+            // Ignore if Neighbor is Already visited
+            if (state.is_visited(neighbor))
+            {
+                return;
+            }
+
+            double distance_through = current_cost + weight;
+            if (distance_through < state.get_cost(neighbor))
+            {
+                state.set(neighbor, distance_through, current_node);
+                queue.push(QueueEntry(distance_through, neighbor));
+                state.edges_relaxed++;
+                state.heap_pushes++;
+            }
+        };
+
+        // Loop Through Neighboring Nodes
+        if (current_node < graph.node_count())
+        {
+            for (uint32_t edge = graph.offsets[current_node]; edge < graph.offsets[current_node + 1]; edge++)
+            {
+                relax(graph.targets[edge], graph.weights[edge]);
+            }
+        }
+        extra_edges(current_node, relax);
+    }
+    profile_search(state);
+}
+
+/**
+ * Uses Dijkstra's Algorithm to find the shortest path between two nodes
+ * Fills cost and previous for every node settled before the end node
+ * @param graph graph to search
+ * @param state search data, reset by this function
+ * @param start_node
+ * @param end_node node to stop at, or NO_NODE to settle the whole graph
+ */
+inline void find_path_dijkstra(
+    const MapGraph& graph,
+    SearchState& state,
+    NodeId start_node,
+    NodeId end_node
+)
+{
+    find_path_dijkstra(graph, state, start_node, end_node, graph.node_count(), [](NodeId, auto&) {});
+}
+
+/**
+ * Scale applied to straight line distances used as A* estimates
+ * Keeps every estimate a little below the true remaining distance, so float
+ * rounding in edge weights can never make the estimate overshoot
+ */
+const double ESTIMATE_SCALE = 1 - 1e-6;
+
+/**
+ * Estimates the remaining distance between two nodes for A*
+ * Edge weights are straight line distances, so this never overestimates
+ * @param graph
+ * @param from
+ * @param to
+ * @return estimated distance
+ */
+inline double estimate_distance(const MapGraph& graph, NodeId from, NodeId to)
+{
+    double dx = (double) graph.x[to] - graph.x[from];
+    double dy = (double) graph.y[to] - graph.y[from];
+    return ESTIMATE_SCALE * std::sqrt(dx * dx + dy * dy);
+}
+
+/**
+ * Uses A* to find the shortest path between two nodes
+ * Like find_path_dijkstra(), but nodes are visited in order of cost plus
+ * straight line distance to the end node, so nodes heading away from the end
+ * are rarely settled
+ * @param graph graph to search
+ * @param state search data, reset by this function
+ * @param start_node
+ * @param end_node
+ */
+inline void find_path_astar(
+    const MapGraph& graph,
+    SearchState& state,
+    NodeId start_node,
+    NodeId end_node
+)
+{
+    state.reset(graph.node_count());
+    SearchQueue& queue = state.queue;
+
+    state.set(start_node, 0, NO_NODE);
+    queue.push(QueueEntry(estimate_distance(graph, start_node, end_node), start_node));
+    state.heap_pushes++;
+
+    // Loop Until End Node is Settled or No Reachable Nodes Remain
+    while (!queue.empty())
+    {
+        // Visit Unvisited Node with the Least Cost Plus Estimate
+        NodeId current_node = queue.top().second;
+        queue.pop();
+        state.heap_pops++;
+        if (state.is_visited(current_node))
+        {
+            continue;
+        }
+        state.visit(current_node);
+        state.nodes_expanded++;
+
+        if (current_node == end_node)
+        {
+            break;
+        }
+
+        // Update Paths to Unvisited Neighbors
+        double current_cost = state.cost[current_node];
+        for (uint32_t edge = graph.offsets[current_node]; edge < graph.offsets[current_node + 1]; edge++)
+        {
+            NodeId neighbor = graph.targets[edge];
+            if (state.is_visited(neighbor))
+            {
+                continue;
+            }
+
+            double distance_through = current_cost + graph.weights[edge];
+            if (distance_through < state.get_cost(neighbor))
+            {
+                state.set(neighbor, distance_through, current_node);
+                queue.push(QueueEntry(distance_through + estimate_distance(graph, neighbor, end_node), neighbor));
+                state.edges_relaxed++;
+                state.heap_pushes++;
+            }
+        }
+    }
+    profile_search(state);
+}
+
+/**
+ * Finds the weight of the edge between two neighboring nodes
+ * @param graph
+ * @param from
+ * @param to
+ * @return edge weight
+ */
+inline float edge_weight(const MapGraph& graph, NodeId from, NodeId to)
+{
+    for (uint32_t edge = graph.offsets[from]; edge < graph.offsets[from + 1]; edge++)
+    {
+        if (graph.targets[edge] == to)
+        {
+            return graph.weights[edge];
+        }
+    }
+    return (float) UNREACHED_COST;
+}
+
+/**
+ * Finds the length of the edge between two neighboring nodes, which is
+ * its weight unless a routing profile weighs edges otherwise
+ * @param graph
+ * @param from
+ * @param to
+ * @return edge length in pixels
+ */
+inline float edge_length(const MapGraph& graph, NodeId from, NodeId to)
+{
+    for (uint32_t edge = graph.offsets[from]; edge < graph.offsets[from + 1]; edge++)
+    {
+        if (graph.targets[edge] == to)
+        {
+            return graph.lengths[edge];
+        }
+    }
+    return (float) UNREACHED_COST;
+}
+
+/**
+ * Measures the path a search found, front to back as the search added it up
+ * @param graph graph that was searched
+ * @param state search data holding the path
+ * @param end_node visited end of the path
+ * @param path set to the nodes of the path, end to start; kept by the
+ *        caller so measuring allocates nothing once it is big enough
+ * @param extra_edge_length called as extra_edge_length(from, to) for the
+ *        length of each edge of the path that is not stored in the graph
+ * @return path length in pixels
+ */
+template <class ExtraEdgeLength>
+double route_length(const MapGraph& graph, const SearchState& state, NodeId end_node, std::vector<NodeId>& path, ExtraEdgeLength extra_edge_length)
+{
+    path.clear();
+    for (NodeId node = end_node; node != NO_NODE; node = state.get_previous(node))
+    {
+        path.push_back(node);
+    }
+    double length = 0;
+    for (size_t i = path.size() - 1; i > 0; i--)
+    {
+        NodeId from = path[i], to = path[i - 1];
+        bool on_graph = from < graph.node_count() && to < graph.node_count();
+        length += on_graph ? edge_length(graph, from, to) : extra_edge_length(from, to);
+    }
+    return length;
+}
+
+/**
+ * Measures the path a search found along the graph's own edges
+ * Under the plain lengths this is just the end node's cost
+ * @param graph graph that was searched
+ * @param state search data holding the path
+ * @param end_node visited end of the path
+ * @param path set to the nodes of the path, end to start
+ * @return path length in pixels
+ */
+inline double route_length(const MapGraph& graph, const SearchState& state, NodeId end_node, std::vector<NodeId>& path)
+{
+    if (graph.weighs_lengths())
+    {
+        path.clear();
+        for (NodeId node = end_node; node != NO_NODE; node = state.get_previous(node))
+        {
+            path.push_back(node);
+        }
+        return state.get_cost(end_node);
+    }
+    return route_length(graph, state, end_node, path, [](NodeId, NodeId) { return UNREACHED_COST; });
+}
+
+/**
+ * @param graph
+ * @param path nodes from the start to the end
+ * @return path length in pixels
+ */
+inline double path_length(const MapGraph& graph, const std::vector<NodeId>& path)
+{
+    double length = 0;
+    for (size_t i = 1; i < path.size(); i++)
+    {
+        length += edge_length(graph, path[i - 1], path[i]);
+    }
+    return length;
+}
+
+/**
+ * Writes a path found some other way into a search state
+ * The state ends up as find_path_dijkstra() would leave it along the path:
+ * every path node visited, with its previous node and cost from the start
+ * @param graph
+ * @param state search data, already reset
+ * @param path nodes of the path from the end back to the start
+ */
+inline void set_path(const MapGraph& graph, SearchState& state, const std::vector<NodeId>& path)
+{
+    // Add Up Costs Front to Back, in the Same Order the Search Does
+    double cost = 0;
+    NodeId previous = NO_NODE;
+    for (auto node = path.rbegin(); node != path.rend(); ++node)
+    {
+        if (previous != NO_NODE)
+        {
+            cost += edge_weight(graph, previous, *node);
+        }
+        state.set(*node, cost, previous);
+        state.visit(*node);
+        previous = *node;
+    }
+}
+
+/**
+ * Uses bidirectional A* to find the shortest path between two nodes
+ * One search grows from each end. Both use the average of the two straight
+ * line estimates as their potential (forward: half of distance to end minus
+ * distance to start, backward: its negative), which keeps the two searches
+ * consistent with each other so they can stop as soon as the best meeting
+ * point found cannot be beaten. The second half of the path is then copied
+ * into state, so the result reads exactly like find_path_dijkstra()'s
+ * @param graph graph to search
+ * @param state search data for the forward search and the result, reset by this function
+ * @param backward_state search data for the backward search, reset by this function
+ * @param start_node
+ * @param end_node
+ */
+inline void find_path_bidirectional_astar(
+    const MapGraph& graph,
+    SearchState& state,
+    SearchState& backward_state,
+    NodeId start_node,
+    NodeId end_node
+)
+{
+    state.reset(graph.node_count());
+    backward_state.reset(graph.node_count());
+    auto potential = [&](NodeId node) {
+        return (estimate_distance(graph, node, end_node) - estimate_distance(graph, node, start_node)) / 2;
+    };
+    SearchQueue* queues[2] = {&state.queue, &backward_state.queue};
+    SearchState* states[2] = {&state, &backward_state};
+
+    state.set(start_node, 0, NO_NODE);
+    queues[0]->push(QueueEntry(potential(start_node), start_node));
+    backward_state.set(end_node, 0, NO_NODE);
+    queues[1]->push(QueueEntry(-potential(end_node), end_node));
+    state.heap_pushes += 2;
+
+    double best_length = UNREACHED_COST;
+    NodeId meeting_node = start_node == end_node ? start_node : NO_NODE;
+    if (meeting_node != NO_NODE)
+    {
+        best_length = 0;
+    }
+
+    // Grow Both Searches Until No Meeting Point Can Beat the Best One
+    while (!queues[0]->empty() && !queues[1]->empty())
+    {
+        if (queues[0]->top().first + queues[1]->top().first >= best_length)
+        {
+            break;
+        }
+
+        // Grow the Side With the Smaller Key
+        int side = queues[0]->top().first <= queues[1]->top().first ? 0 : 1;
+        SearchState& this_side = *states[side];
+        SearchState& other_side = *states[1 - side];
+        double sign = side == 0 ? 1 : -1;
+
+        NodeId current_node = queues[side]->top().second;
+        queues[side]->pop();
+        state.heap_pops++;
+        if (this_side.is_visited(current_node))
+        {
+            continue;
+        }
+        this_side.visit(current_node);
+        state.nodes_expanded++;
+
+        double current_cost = this_side.cost[current_node];
+        for (uint32_t edge = graph.offsets[current_node]; edge < graph.offsets[current_node + 1]; edge++)
+        {
+            NodeId neighbor = graph.targets[edge];
+            if (this_side.is_visited(neighbor))
+            {
+                continue;
+            }
+
+            double distance_through = current_cost + graph.weights[edge];
+            if (distance_through < this_side.get_cost(neighbor))
+            {
+                this_side.set(neighbor, distance_through, current_node);
+                queues[side]->push(QueueEntry(distance_through + sign * potential(neighbor), neighbor));
+                state.edges_relaxed++;
+                state.heap_pushes++;
+
+                // Check for a Better Meeting Point
+                if (other_side.is_reached(neighbor) && distance_through + other_side.cost[neighbor] < best_length)
+                {
+                    best_length = distance_through + other_side.cost[neighbor];
+                    meeting_node = neighbor;
+                }
+            }
+        }
+    }
+
+    // Copy the Second Half of the Path into the Forward Search
+    if (meeting_node != NO_NODE)
+    {
+        NodeId current_node = meeting_node;
+        state.visit(current_node);
+        while (current_node != end_node)
+        {
+            NodeId next_node = backward_state.previous[current_node];
+            state.set(next_node, state.cost[current_node] + edge_weight(graph, current_node, next_node), current_node);
+            state.visit(next_node);
+            current_node = next_node;
+        }
+    }
+    profile_search(state);
+}
+
+/**
+ * Shortest path algorithms to choose from
+ */
+enum class SearchStrategy
+{
+    Dijkstra,
+    AStar,
+    BidirectionalAStar
+};
+
+/**
+ * @param strategy
+ * @return name of the strategy as used on the command line
+ */
+inline const char* search_strategy_name(SearchStrategy strategy)
+{
+    switch (strategy)
+    {
+        case SearchStrategy::AStar:
+            return "astar";
+        case SearchStrategy::BidirectionalAStar:
+            return "bidirectional";
+        default:
+            return "dijkstra";
+    }
+}
+
+/**
+ * Looks up a strategy by the name search_strategy_name() gives it
+ * @param name
+ * @param strategy set to the strategy if the name is known
+ * @return boolean whether the name is known
+ */
+inline bool parse_search_strategy(std::string_view name, SearchStrategy& strategy)
+{
+    for (SearchStrategy candidate : {SearchStrategy::Dijkstra, SearchStrategy::AStar, SearchStrategy::BidirectionalAStar})
+    {
+        if (name == search_strategy_name(candidate))
+        {
+            strategy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Finds the shortest path between two nodes with the chosen strategy
+ * Afterwards the end node is visited in state if a path exists, and its
+ * previous nodes lead back to the start
+ * @param graph graph to search
+ * @param strategy
+ * @param state search data holding the result, reset by this function
+ * @param backward_state extra search data, only used by bidirectional search
+ * @param start_node
+ * @param end_node node to stop at; NO_NODE settles the whole graph with Dijkstra
+ */
+inline void find_path(
+    const MapGraph& graph,
+    SearchStrategy strategy,
+    SearchState& state,
+    SearchState& backward_state,
+    NodeId start_node,
+    NodeId end_node
+)
+{
+    if (end_node == NO_NODE || strategy == SearchStrategy::Dijkstra)
+    {
+        find_path_dijkstra(graph, state, start_node, end_node);
+    }
+    else if (strategy == SearchStrategy::AStar)
+    {
+        find_path_astar(graph, state, start_node, end_node);
+    }
+    else
+    {
+        find_path_bidirectional_astar(graph, state, backward_state, start_node, end_node);
+    }
+}
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+
+#include "map_graph.hpp"
+#include "path_search.hpp"
+#include "routing_profile.hpp"
+#include "wall_index.hpp"
+
+/**
+ * Start and end of one query, each either a graph node or any point on the map
+ * A point gets an id past the graph's last node (virtual_start_node() or
+ * virtual_end_node()) and a list of the nodes it can see, found through the
+ * wall index. The links only live here and are followed by
+ * find_path_between_points(), so the shared graph is never changed and any
+ * number of queries can run on it at once
+ * Links get area flags like graph edges do, and are weighed by the query's
+ * routing profile; a link the profile may not use gets a negative weight
+ */
+struct PointQuery
+{
+    NodeId start_node = NO_NODE;
+    NodeId end_node = NO_NODE; // NO_NODE to search the whole graph
+    sf::Vector2f start_point;
+    sf::Vector2f end_point;
+
+    RoutingProfile profile = RoutingProfile::Shortest; // how the links are weighed
+
+    // Links of Points That Are Not Nodes
+    std::vector<NodeId> start_links; // nodes seen from the start point
+    std::vector<float> start_lengths;
+    std::vector<EdgeFlags> start_flags;
+    std::vector<float> start_weights;
+    std::vector<float> end_lengths; // distance from each node to the end point, negative if out of sight
+    std::vector<EdgeFlags> end_flags;
+    std::vector<float> end_weights;
+    float direct_length = -1; // distance between the two points, negative if out of sight
+    EdgeFlags direct_flags = 0;
+    float direct_weight = -1;
+};
+
+/**
+ * @param graph
+ * @return id a start point gets in a PointQuery on this graph
+ */
+inline NodeId virtual_start_node(const MapGraph& graph)
+{
+    return graph.node_count();
+}
+
+/**
+ * @param graph
+ * @return id an end point gets in a PointQuery on this graph
+ */
+inline NodeId virtual_end_node(const MapGraph& graph)
+{
+    return graph.node_count() + 1;
+}
+
+/**
+ * Finds the position of a node or point of a query
+ * @param graph
+ * @param query
+ * @param node graph node or virtual id
+ * @return position
+ */
+inline sf::Vector2f query_node_position(const MapGraph& graph, const PointQuery& query, NodeId node)
+{
+    if (node == virtual_start_node(graph))
+    {
+        return query.start_point;
+    }
+    if (node == virtual_end_node(graph))
+    {
+        return query.end_point;
+    }
+    return sf::Vector2f(graph.x[node], graph.y[node]);
+}
+
+/**
+ * Finds the length of a link of a query, for measuring paths through it
+ * @param graph
+ * @param query
+ * @param from graph node or virtual id the link starts at
+ * @param to graph node or virtual id the link ends at
+ * @return link length in pixels
+ */
+inline float query_link_length(const MapGraph& graph, const PointQuery& query, NodeId from, NodeId to)
+{
+    if (from != virtual_start_node(graph))
+    {
+        return query.end_lengths[from];
+    }
+    if (to == virtual_end_node(graph))
+    {
+        return query.direct_length;
+    }
+    size_t link = std::find(query.start_links.begin(), query.start_links.end(), to) - query.start_links.begin();
+    return query.start_lengths[link];
+}
+
+/**
+ * Weighs one link of a query by its routing profile
+ * @param query
+ * @param length link length, negative if there is no link
+ * @param flags
+ * @return link weight, negative if there is no link or the profile may not use it
+ */
+inline float query_link_weight(const PointQuery& query, float length, EdgeFlags flags)
+{
+    float weight = length < 0 ? CLOSED_EDGE_WEIGHT : routing_profile_cost(query.profile, length, flags);
+    return weight == CLOSED_EDGE_WEIGHT ? -1 : weight;
+}
+
+/**
+ * Weighs every link of a query by its routing profile
+ * @param query
+ */
+inline void weigh_query_links(PointQuery& query)
+{
+    query.start_weights.resize(query.start_links.size());
+    for (size_t i = 0; i < query.start_links.size(); i++)
+    {
+        query.start_weights[i] = query_link_weight(query, query.start_lengths[i], query.start_flags[i]);
+    }
+    query.end_weights.resize(query.end_lengths.size());
+    for (size_t node = 0; node < query.end_lengths.size(); node++)
+    {
+        query.end_weights[node] = query_link_weight(query, query.end_lengths[node], query.end_flags[node]);
+    }
+    query.direct_weight = query_link_weight(query, query.direct_length, query.direct_flags);
+}
+
+/**
+ * Weighs the links of a query by another routing profile
+ * @param query
+ * @param profile
+ */
+inline void set_query_profile(PointQuery& query, RoutingProfile profile)
+{
+    query.profile = profile;
+    weigh_query_links(query);
+}
+
+/**
+ * Links the points of a query to each other and weighs every link
+ * Helper function for set_query_start() and set_query_end()
+ * @param graph
+ * @param walls index over every wall of the map
+ * @param areas areas whose flags go to the links crossing them
+ * @param query
+ */
+inline void link_query_points(const MapGraph& graph, const WallGrid& walls, const std::vector<MapArea>& areas, PointQuery& query)
+{
+    query.direct_length = -1;
+    query.direct_flags = 0;
+    if (
+            query.start_node == virtual_start_node(graph) &&
+            query.end_node == virtual_end_node(graph) &&
+            !walls.is_obstructed(query.start_point, query.end_point)
+       )
+    {
+        query.direct_length = std::hypot(query.end_point.x - query.start_point.x, query.end_point.y - query.start_point.y);
+        query.direct_flags = crossed_area_flags(areas, query.start_point.x, query.start_point.y, query.end_point.x, query.end_point.y);
+    }
+    weigh_query_links(query);
+}
+
+/**
+ * Starts a query at a graph node
+ * @param graph
+ * @param walls index over every wall of the map
+ * @param areas areas whose flags go to the links crossing them
+ * @param query
+ * @param node
+ */
+inline void set_query_start(const MapGraph& graph, const WallGrid& walls, const std::vector<MapArea>& areas, PointQuery& query, NodeId node)
+{
+    query.start_node = node;
+    query.start_links.clear();
+    query.start_lengths.clear();
+    query.start_flags.clear();
+    link_query_points(graph, walls, areas, query);
+}
+
+/**
+ * Starts a query at any point, linking it to every node it can see
+ * @param graph
+ * @param walls index over every wall of the map
+ * @param areas areas whose flags go to the links crossing them
+ * @param query
+ * @param point
+ */
+inline void set_query_start(const MapGraph& graph, const WallGrid& walls, const std::vector<MapArea>& areas, PointQuery& query, sf::Vector2f point)
+{
+    query.start_node = virtual_start_node(graph);
+    query.start_point = point;
+    query.start_links.clear();
+    query.start_lengths.clear();
+    query.start_flags.clear();
+    for (NodeId node = 0; node < graph.node_count(); node++)
+    {
+        sf::Vector2f node_point(graph.x[node], graph.y[node]);
+        if (!walls.is_obstructed(point, node_point))
+        {
+            query.start_links.push_back(node);
+            query.start_lengths.push_back(std::hypot(node_point.x - point.x, node_point.y - point.y));
+            query.start_flags.push_back(crossed_area_flags(areas, point.x, point.y, node_point.x, node_point.y));
+        }
+    }
+    link_query_points(graph, walls, areas, query);
+}
+
+/**
+ * Ends a query at a graph node
+ * @param graph
+ * @param walls index over every wall of the map
+ * @param areas areas whose flags go to the links crossing them
+ * @param query
+ * @param node graph node, or NO_NODE to search the whole graph
+ */
+inline void set_query_end(const MapGraph& graph, const WallGrid& walls, const std::vector<MapArea>& areas, PointQuery& query, NodeId node)
+{
+    query.end_node = node;
+    query.end_lengths.clear();
+    query.end_flags.clear();
+    link_query_points(graph, walls, areas, query);
+}
+
+/**
+ * Ends a query at any point, linking it to every node it can see
+ * @param graph
+ * @param walls index over every wall of the map
+ * @param areas areas whose flags go to the links crossing them
+ * @param query
+ * @param point
+ */
+inline void set_query_end(const MapGraph& graph, const WallGrid& walls, const std::vector<MapArea>& areas, PointQuery& query, sf::Vector2f point)
+{
+    query.end_node = virtual_end_node(graph);
+    query.end_point = point;
+    query.end_lengths.assign(graph.node_count(), -1);
+    query.end_flags.assign(graph.node_count(), 0);
+    for (NodeId node = 0; node < graph.node_count(); node++)
+    {
+        sf::Vector2f node_point(graph.x[node], graph.y[node]);
+        if (!walls.is_obstructed(node_point, point))
+        {
+            query.end_lengths[node] = std::hypot(point.x - node_point.x, point.y - node_point.y);
+            query.end_flags[node] = crossed_area_flags(areas, node_point.x, node_point.y, point.x, point.y);
+        }
+    }
+    link_query_points(graph, walls, areas, query);
+}
+
+/**
+ * Uses Dijkstra's Algorithm to find the shortest path between the ends of a query
+ * The state holds graph nodes plus both virtual ids, so paths are read back
+ * the usual way, from the end through get_previous()
+ * @param graph weighted by the same routing profile as the query's links
+ * @param state search data, reset by this function
+ * @param query
+ */
+inline void find_path_between_points(const MapGraph& graph, SearchState& state, const PointQuery& query)
+{
+    NodeId start_id = virtual_start_node(graph);
+    NodeId end_id = virtual_end_node(graph);
+    find_path_dijkstra(graph, state, query.start_node, query.end_node, graph.node_count() + 2, [&](NodeId node, auto& relax) {
+        // Out of the Start Point
+        if (node == start_id)
+        {
+            for (size_t i = 0; i < query.start_links.size(); i++)
+            {
+                if (query.start_weights[i] >= 0)
+                {
+                    relax(query.start_links[i], query.start_weights[i]);
+                }
+            }
+            if (query.direct_weight >= 0)
+            {
+                relax(end_id, query.direct_weight);
+            }
+        }
+
+        // Into the End Point
+        else if (node < graph.node_count() && query.end_node == end_id && query.end_weights[node] >= 0)
+        {
+            relax(end_id, query.end_weights[node]);
+        }
+    });
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * Built-in counters and timers for the hot paths
+ * Each thread tallies into its own block and adds it to the shared totals
+ * when it exits (or when a report is written), so counting costs a plain
+ * increment. Define MISSIONMAPS_NO_PROFILE to compile every PROFILE_ macro
+ * out entirely
+ */
+enum class ProfileCounter
+{
+    IntersectionTests, // segment-wall tests, including NO_WALL padding tested by the wall kernel
+    NodesExpanded, // nodes settled by searches
+    EdgeRelaxations, // edges that lowered a node's cost during searches
+    HeapPushes,
+    HeapPops,
+    TileLoads, // background tiles decoded
+    Count
+};
+
+enum class ProfileTimer
+{
+    MapParse, // reading map text
+    MapCacheOpen, // mapping and checking a compiled map
+    VisibilityBuild, // linking nodes that can see each other
+    GraphReduction, // dropping edges no route needs
+    RouteTableBuild,
+    HierarchyBuild, // contracting nodes into a contraction hierarchy
+    TilePyramidBuild, // cutting the background into tiles
+    MapImageCompile, // reading nodes and obstacle outlines out of a map image
+    DisplayBackground, // per frame
+    DisplayMap, // per frame
+    DisplayGraph, // per frame, debug mode
+    DrawLine, // per frame, the path and lines drawn one by one
+    Count
+};
+
+const size_t NUM_PROFILE_COUNTERS = (size_t) ProfileCounter::Count;
+const size_t NUM_PROFILE_TIMERS = (size_t) ProfileTimer::Count;
+
+/**
+ * @param counter
+ * @return name used in reports
+ */
+inline const char* profile_counter_name(ProfileCounter counter)
+{
+    const char* names[NUM_PROFILE_COUNTERS] = {
+        "intersection_tests", "nodes_expanded", "edge_relaxations", "heap_pushes", "heap_pops", "tile_loads"
+    };
+    return names[(size_t) counter];
+}
+
+/**
+ * @param timer
+ * @return name used in reports
+ */
+inline const char* profile_timer_name(ProfileTimer timer)
+{
+    const char* names[NUM_PROFILE_TIMERS] = {
+        "map_parse", "map_cache_open", "visibility_build", "graph_reduction", "route_table_build", "hierarchy_build",
+        "tile_pyramid_build", "map_image_compile", "display_background", "display_map", "display_graph", "draw_line"
+    };
+    return names[(size_t) timer];
+}
+
+/**
+ * Totals of every thread that has added its tallies so far
+ */
+struct ProfileTotals
+{
+    std::atomic<uint64_t> counts[NUM_PROFILE_COUNTERS] = {};
+    std::atomic<uint64_t> timer_calls[NUM_PROFILE_TIMERS] = {};
+    std::atomic<uint64_t> timer_nanoseconds[NUM_PROFILE_TIMERS] = {};
+    std::atomic<uint64_t> timer_max_nanoseconds[NUM_PROFILE_TIMERS] = {};
+};
+
+inline ProfileTotals& profile_totals()
+{
+    static ProfileTotals totals;
+    return totals;
+}
+
+/**
+ * Tallies of one thread
+ */
+struct ThreadProfile
+{
+    uint64_t counts[NUM_PROFILE_COUNTERS] = {};
+    uint64_t timer_calls[NUM_PROFILE_TIMERS] = {};
+    uint64_t timer_nanoseconds[NUM_PROFILE_TIMERS] = {};
+    uint64_t timer_max_nanoseconds[NUM_PROFILE_TIMERS] = {};
+
+    ~ThreadProfile()
+    {
+        flush();
+    }
+
+    /**
+     * Adds the tallies to the shared totals and starts over
+     */
+    void flush()
+    {
+        ProfileTotals& totals = profile_totals();
+        for (size_t i = 0; i < NUM_PROFILE_COUNTERS; i++)
+        {
+            totals.counts[i] += counts[i];
+            counts[i] = 0;
+        }
+        for (size_t i = 0; i < NUM_PROFILE_TIMERS; i++)
+        {
+            totals.timer_calls[i] += timer_calls[i];
+            totals.timer_nanoseconds[i] += timer_nanoseconds[i];
+            uint64_t max = totals.timer_max_nanoseconds[i];
+            while (timer_max_nanoseconds[i] > max && !totals.timer_max_nanoseconds[i].compare_exchange_weak(max, timer_max_nanoseconds[i])) {}
+            timer_calls[i] = timer_nanoseconds[i] = timer_max_nanoseconds[i] = 0;
+        }
+    }
+};
+
+inline ThreadProfile& thread_profile()
+{
+    thread_local ThreadProfile profile;
+    return profile;
+}
+
+/**
+ * Adds the time until the end of its scope to a timer
+ */
+class ScopedProfileTimer
+{
+public:
+    explicit ScopedProfileTimer(ProfileTimer timer) : timer((size_t) timer), start(std::chrono::steady_clock::now()) {}
+    ScopedProfileTimer(const ScopedProfileTimer&) = delete;
+    ScopedProfileTimer& operator=(const ScopedProfileTimer&) = delete;
+
+    ~ScopedProfileTimer()
+    {
+        uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        ThreadProfile& profile = thread_profile();
+        profile.timer_calls[timer]++;
+        profile.timer_nanoseconds[timer] += elapsed;
+        profile.timer_max_nanoseconds[timer] = std::max(profile.timer_max_nanoseconds[timer], elapsed);
+    }
+
+private:
+    size_t timer;
+    std::chrono::steady_clock::time_point start;
+};
+
+#ifdef MISSIONMAPS_NO_PROFILE
+// The Amount Is Named but Never Evaluated, So Variables Only Counted Are Still Used
+#define PROFILE_COUNT(counter, amount) ((void) sizeof(amount))
+#define PROFILE_SCOPE(timer) ((void) 0)
+#else
+#define PROFILE_COUNT(counter, amount) (thread_profile().counts[(size_t) ProfileCounter::counter] += (amount))
+#define PROFILE_SCOPE(timer) ScopedProfileTimer scoped_profile_timer(ProfileTimer::timer)
+#endif
+
+/**
+ * Writes every counter and timer as a JSON object
+ * Tallies of threads still running, other than the calling one, are left out
+ * @param out
+ * @param map_path map the numbers were measured on
+ */
+inline void write_profile_json(std::ostream& out, const std::string& map_path)
+{
+    thread_profile().flush();
+    ProfileTotals& totals = profile_totals();
+
+    out << "{\n";
+#ifdef MISSIONMAPS_NO_PROFILE
+    out << "  \"enabled\": false,\n";
+#else
+    out << "  \"enabled\": true,\n";
+#endif
+    out << "  \"map\": \"";
+    for (char c : map_path)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out << '\\';
+        }
+        out << c;
+    }
+    out << "\",\n";
+
+    out << "  \"counters\": {\n";
+    for (size_t i = 0; i < NUM_PROFILE_COUNTERS; i++)
+    {
+        out << "    \"" << profile_counter_name((ProfileCounter) i) << "\": " << totals.counts[i]
+            << (i + 1 < NUM_PROFILE_COUNTERS ? ",\n" : "\n");
+    }
+    out << "  },\n";
+
+    out << "  \"timers\": {\n";
+    for (size_t i = 0; i < NUM_PROFILE_TIMERS; i++)
+    {
+        out << "    \"" << profile_timer_name((ProfileTimer) i) << "\": {"
+            << "\"calls\": " << totals.timer_calls[i]
+            << ", \"total_ms\": " << totals.timer_nanoseconds[i] / 1e6
+            << ", \"max_ms\": " << totals.timer_max_nanoseconds[i] / 1e6
+            << "}" << (i + 1 < NUM_PROFILE_TIMERS ? ",\n" : "\n");
+    }
+    out << "  }\n";
+    out << "}\n";
+}
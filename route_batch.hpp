@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "alternative_routes.hpp"
+#include "contraction_hierarchy.hpp"
+#include "map_graph.hpp"
+#include "parallel.hpp"
+#include "path_search.hpp"
+#include "route_table.hpp"
+
+/**
+ * Number of queries a batch worker claims at a time
+ */
+const size_t ROUTE_QUERIES_PER_CLAIM = 4;
+
+/**
+ * One start/end pair of a batch run
+ */
+struct RouteQuery
+{
+    NodeId start_node;
+    NodeId end_node;
+};
+
+/**
+ * Outcome of one query of a batch run
+ */
+struct RouteResult
+{
+    double length = UNREACHED_COST; // path length in pixels, UNREACHED_COST if there is no path
+    uint32_t num_path_nodes = 0; // nodes on the path, counting both ends
+    uint32_t nodes_expanded = 0; // nodes settled by the search
+    double latency = 0; // seconds spent on the query
+    std::vector<double> alternative_lengths; // lengths of the other routes found, shortest first
+};
+
+/**
+ * Totals over a whole batch run
+ */
+struct BatchReport
+{
+    size_t num_queries = 0;
+    unsigned num_threads = 0;
+    double wall_time = 0; // seconds from the first query starting to the last one finishing
+    double throughput = 0; // queries per second
+    double p50_latency = 0; // seconds
+    double p99_latency = 0; // seconds
+    double mean_nodes_expanded = 0;
+};
+
+/**
+ * Maps node names to nodes, for looking up query endpoints by name
+ * Names shared by several nodes (rooms with several doors) map to the first one
+ * @param graph
+ * @return lookup table, valid as long as the graph's name text is
+ */
+inline std::unordered_map<std::string_view, NodeId> build_name_lookup(const MapGraph& graph)
+{
+    std::unordered_map<std::string_view, NodeId> lookup;
+    for (NodeId node = 0; node < graph.node_count(); node++)
+    {
+        if (graph.is_named(node))
+        {
+            lookup.emplace(graph.name(node), node);
+        }
+    }
+    return lookup;
+}
+
+/**
+ * Finds a latency percentile using the nearest-rank method
+ * @param sorted_latencies latencies in increasing order
+ * @param fraction percentile as a fraction (0.99 for p99)
+ * @return latency at that percentile, 0 if there are none
+ */
+inline double latency_percentile(const std::vector<double>& sorted_latencies, double fraction)
+{
+    if (sorted_latencies.empty())
+    {
+        return 0;
+    }
+    size_t rank = (size_t) std::ceil(fraction * sorted_latencies.size());
+    return sorted_latencies[std::clamp<size_t>(rank, 1, sorted_latencies.size()) - 1];
+}
+
+/**
+ * Answers one query, from the route table, the contraction hierarchy or a
+ * search, in that order of preference
+ * Only the search states are written, so threads with their own states
+ * can answer queries on the same graph at once
+ * @param graph graph to route on, weighted by any routing profile
+ * @param table may be empty; only used if graph weighs edges by their lengths
+ * @param hierarchy may be empty; likewise
+ * @param strategy search algorithm to use when neither has the route
+ * @param state gets the path, as find_path() leaves it
+ * @param backward_state
+ * @param path set to the nodes of the path, end to start, empty if there is none
+ * @param query end node may be NO_NODE to settle every node, which only a plain search can do
+ * @param result filled in, all but the latency
+ */
+inline void answer_route_query(
+    const MapGraph& graph,
+    const RouteTable& table,
+    const ContractionHierarchy& hierarchy,
+    SearchStrategy strategy,
+    SearchState& state,
+    SearchState& backward_state,
+    std::vector<NodeId>& path,
+    RouteQuery query,
+    RouteResult& result
+)
+{
+    // Tables and Hierarchies Hold Routes by Length, of No Use Under Other Weights
+    bool weighs_lengths = graph.weighs_lengths();
+    if (weighs_lengths && table.has_route(query.start_node, query.end_node))
+    {
+        find_path_in_table(table, graph, state, query.start_node, query.end_node);
+    }
+    else if (weighs_lengths && !hierarchy.empty() && query.end_node != NO_NODE)
+    {
+        find_path_hierarchy(hierarchy, graph, state, backward_state, query.start_node, query.end_node);
+    }
+    else
+    {
+        find_path(graph, strategy, state, backward_state, query.start_node, query.end_node);
+    }
+    result.nodes_expanded = state.nodes_expanded;
+    result.length = UNREACHED_COST;
+    path.clear();
+    if (query.end_node != NO_NODE && state.is_visited(query.end_node))
+    {
+        result.length = route_length(graph, state, query.end_node, path);
+    }
+    result.num_path_nodes = (uint32_t) path.size();
+}
+
+/**
+ * Answers many queries across worker threads, each with its own search state
+ * The graph is only read, so any number of threads can share it
+ * @param graph
+ * @param table routes looked up instead of searched where it has them, may be empty
+ * @param hierarchy used for routes the table does not have, may be empty
+ * @param queries
+ * @param strategy search algorithm to use
+ * @param num_routes routes to find per query, counting the shortest; more than 1 adds alternatives
+ * @param num_threads number of worker threads, 0 for one per core
+ * @param report filled with throughput and latency totals
+ * @return result of every query, in query order
+ */
+inline std::vector<RouteResult> run_route_batch(
+    const MapGraph& graph,
+    const RouteTable& table,
+    const ContractionHierarchy& hierarchy,
+    const std::vector<RouteQuery>& queries,
+    SearchStrategy strategy,
+    size_t num_routes,
+    unsigned num_threads,
+    BatchReport& report
+)
+{
+    typedef std::chrono::steady_clock Clock;
+    std::vector<RouteResult> results(queries.size());
+    unsigned max_threads = parallel_for_threads(queries.size(), ROUTE_QUERIES_PER_CLAIM, num_threads);
+    std::vector<SearchState> states(max_threads), backward_states(max_threads);
+    std::vector<AlternativeSearch> alternative_searches(num_routes > 1 ? max_threads : 0);
+    std::vector<std::vector<Route>> thread_routes(max_threads);
+    std::vector<std::vector<NodeId>> paths(max_threads);
+
+    // Answer Queries
+    Clock::time_point batch_start = Clock::now();
+    report.num_threads = parallel_for(queries.size(), ROUTE_QUERIES_PER_CLAIM, num_threads, [&](unsigned thread_id, size_t first, size_t last) {
+        SearchState& state = states[thread_id];
+        for (size_t i = first; i < last; i++)
+        {
+            const RouteQuery& query = queries[i];
+            RouteResult& result = results[i];
+            Clock::time_point query_start = Clock::now();
+            answer_route_query(graph, table, hierarchy, strategy, state, backward_states[thread_id], paths[thread_id], query, result);
+            if (num_routes > 1)
+            {
+                AlternativeSearch& search = alternative_searches[thread_id];
+                std::vector<Route>& routes = thread_routes[thread_id];
+                find_alternative_routes(graph, search, state, query.start_node, query.end_node, num_routes, routes);
+                result.nodes_expanded += search.nodes_expanded;
+                for (size_t route = 1; route < routes.size(); route++)
+                {
+                    result.alternative_lengths.push_back(graph.weighs_lengths() ? routes[route].length : path_length(graph, routes[route].path));
+                }
+            }
+            result.latency = std::chrono::duration<double>(Clock::now() - query_start).count();
+        }
+    });
+    report.wall_time = std::chrono::duration<double>(Clock::now() - batch_start).count();
+
+    // Totals
+    std::vector<double> latencies;
+    latencies.reserve(results.size());
+    double total_nodes_expanded = 0;
+    for (const RouteResult& result : results)
+    {
+        latencies.push_back(result.latency);
+        total_nodes_expanded += result.nodes_expanded;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    report.num_queries = queries.size();
+    report.throughput = report.wall_time > 0 ? queries.size() / report.wall_time : 0;
+    report.p50_latency = latency_percentile(latencies, 0.50);
+    report.p99_latency = latency_percentile(latencies, 0.99);
+    report.mean_nodes_expanded = queries.empty() ? 0 : total_nodes_expanded / queries.size();
+    return results;
+}
@@ -0,0 +1,549 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "contraction_hierarchy.hpp"
+#include "http_socket.hpp"
+#include "map_graph.hpp"
+#include "parallel.hpp"
+#include "path_search.hpp"
+#include "route_batch.hpp"
+#include "route_table.hpp"
+#include "routing_profile.hpp"
+
+/**
+ * How often the server checks whether it is stopping, in milliseconds
+ */
+const int SERVER_POLL_MILLISECONDS = 200;
+
+/**
+ * Keep-alive connections quiet for this long are closed, in milliseconds
+ */
+const int SERVER_IDLE_MILLISECONDS = 5000;
+
+/**
+ * Room left in front of a response body for its status line and headers
+ */
+const size_t HTTP_RESPONSE_HEADER_SPACE = 256;
+
+/**
+ * Read-only data every worker of a route server shares
+ */
+struct RouteService
+{
+    const MapGraph& graph; // weighted by the profile requests get unless they name another
+    const RouteTable& table; // may be empty
+    const ContractionHierarchy& hierarchy; // may be empty
+    std::vector<MapGraph> profile_graphs; // graph weighted by each routing profile, by profile
+    SearchStrategy strategy;
+    std::unordered_map<std::string_view, NodeId> lookup; // from build_name_lookup()
+    double feet_per_pixel;
+};
+
+/**
+ * Memory one server worker reuses for every request it answers
+ * Everything is sized for the largest request and route up front, so past
+ * the first few requests (while the search queues find their size) a
+ * request allocates nothing
+ */
+struct RouteArena
+{
+    SearchState state;
+    SearchState backward_state;
+    std::vector<NodeId> path; // end to start
+    std::vector<char> names; // decoded from and to
+    std::vector<char> response; // headers, then body
+    size_t requests_served = 0;
+
+    explicit RouteArena(const MapGraph& graph)
+    {
+        state.reset(graph.node_count());
+        backward_state.reset(graph.node_count());
+        path.reserve(graph.node_count());
+        names.resize(2 * HTTP_HEADER_BUFFER_SIZE);
+
+        // Two Names Escaped at Worst Six Bytes a Byte, and Every Node as [x,y]
+        response.resize(HTTP_RESPONSE_HEADER_SPACE + 1024 + 12 * HTTP_HEADER_BUFFER_SIZE + 48 * (size_t) graph.node_count());
+    }
+};
+
+/**
+ * @param status
+ * @return reason phrase of the HTTP status codes the server sends
+ */
+inline const char* http_status_text(int status)
+{
+    switch (status)
+    {
+        case 200:
+            return "OK";
+        case 400:
+            return "Bad Request";
+        case 404:
+            return "Not Found";
+        case 405:
+            return "Method Not Allowed";
+        case 431:
+            return "Request Header Fields Too Large";
+        default:
+            return "Internal Server Error";
+    }
+}
+
+/**
+ * Puts the status line and headers in front of a finished body
+ * Helper for answer_route_request()
+ * @param body written at HTTP_RESPONSE_HEADER_SPACE into the arena's response
+ * @param status
+ * @param keep_alive
+ * @return whole response, within the arena's response buffer
+ */
+inline std::string_view finish_http_response(HttpWriter& body, int status, bool keep_alive)
+{
+    if (body.overflowed)
+    {
+        status = 500;
+        body.size = 0;
+        body.overflowed = false;
+        body.append("{\"error\":\"response too large\"}");
+    }
+    char header[HTTP_RESPONSE_HEADER_SPACE];
+    int header_size = std::snprintf(
+        header,
+        sizeof(header),
+        "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n",
+        status,
+        http_status_text(status),
+        body.size,
+        keep_alive ? "keep-alive" : "close"
+    );
+    char* start = body.data - header_size;
+    std::memcpy(start, header, header_size);
+    return std::string_view(start, header_size + body.size);
+}
+
+/**
+ * Finds a parameter in a query string
+ * @param query text after the '?'
+ * @param key
+ * @param value set to the parameter's value, still URL encoded
+ * @return boolean whether the parameter is there
+ */
+inline bool find_query_parameter(std::string_view query, std::string_view key, std::string_view& value)
+{
+    while (!query.empty())
+    {
+        size_t end = query.find('&');
+        std::string_view parameter = query.substr(0, end);
+        if (parameter.size() > key.size() && parameter.substr(0, key.size()) == key && parameter[key.size()] == '=')
+        {
+            value = parameter.substr(key.size() + 1);
+            return true;
+        }
+        query.remove_prefix(end == std::string_view::npos ? query.size() : end + 1);
+    }
+    return false;
+}
+
+/**
+ * Answers one HTTP request
+ *   GET /route?from=A1&to=B30[&profile=accessible]
+ * gives {"from", "to", "length_ft" (null if unreachable), "nodes_expanded",
+ * "path": [[x, y], ...]}; anything else gives {"error"} with a 4xx status
+ * @param service
+ * @param arena the worker's buffers; the response is written into it
+ * @param request header block of the request
+ * @param keep_alive set to whether the connection stays open afterwards
+ * @return response to send, valid until the arena answers another request
+ */
+inline std::string_view answer_route_request(const RouteService& service, RouteArena& arena, std::string_view request, bool& keep_alive)
+{
+    HttpWriter body(arena.response.data() + HTTP_RESPONSE_HEADER_SPACE, arena.response.size() - HTTP_RESPONSE_HEADER_SPACE);
+    auto fail = [&](int status, const char* message) {
+        body.append("{\"error\":");
+        body.append_json_string(message);
+        body.append("}");
+        return finish_http_response(body, status, keep_alive);
+    };
+
+    // Split the Request Line
+    std::string_view line = request.substr(0, request.find("\r\n"));
+    size_t target_start = line.find(' ');
+    size_t version_start = target_start == std::string_view::npos ? target_start : line.find(' ', target_start + 1);
+    if (version_start == std::string_view::npos)
+    {
+        keep_alive = false;
+        return fail(400, "malformed request line");
+    }
+    std::string_view method = line.substr(0, target_start);
+    std::string_view target = line.substr(target_start + 1, version_start - target_start - 1);
+    std::string_view version = line.substr(version_start + 1);
+
+    // HTTP/1.1 Connections Stay Open Unless Asked Not To, HTTP/1.0 Ones the Other Way Round
+    std::string_view connection = http_header_value(request, "Connection");
+    keep_alive = version == "HTTP/1.1" ? !http_equal_ignoring_case(connection, "close") : http_equal_ignoring_case(connection, "keep-alive");
+
+    // A Body Would Be Read as the Next Request, So Close After Answering
+    std::string_view content_length = http_header_value(request, "Content-Length");
+    if (!content_length.empty() && content_length != "0")
+    {
+        keep_alive = false;
+    }
+
+    if (method != "GET")
+    {
+        return fail(405, "only GET is supported");
+    }
+    size_t query_start = target.find('?');
+    if (target.substr(0, query_start) != "/route")
+    {
+        return fail(404, "not found");
+    }
+
+    // Read Endpoint Names
+    std::string_view query = query_start == std::string_view::npos ? std::string_view() : target.substr(query_start + 1);
+    std::string_view encoded[2];
+    if (!find_query_parameter(query, "from", encoded[0]) || !find_query_parameter(query, "to", encoded[1]))
+    {
+        return fail(400, "expected from and to");
+    }
+    std::string_view names[2];
+    NodeId nodes[2];
+    for (int i = 0; i < 2; i++)
+    {
+        char* decoded = arena.names.data() + i * HTTP_HEADER_BUFFER_SIZE;
+        size_t decoded_size = url_decode(encoded[i], decoded);
+        if (decoded_size > encoded[i].size())
+        {
+            return fail(400, "malformed escape in node name");
+        }
+        names[i] = std::string_view(decoded, decoded_size);
+        auto node = service.lookup.find(names[i]);
+        if (node == service.lookup.end())
+        {
+            body.append("{\"error\":\"unknown node\",\"node\":");
+            body.append_json_string(names[i]);
+            body.append("}");
+            return finish_http_response(body, 404, keep_alive);
+        }
+        nodes[i] = node->second;
+    }
+
+    // Routing Profile, if Another Than the Default is Asked For
+    const MapGraph* graph = &service.graph;
+    std::string_view profile_name;
+    if (find_query_parameter(query, "profile", profile_name))
+    {
+        RoutingProfile profile;
+        if (!parse_routing_profile(profile_name, profile))
+        {
+            return fail(400, "unknown profile");
+        }
+        graph = &service.profile_graphs[(size_t) profile];
+    }
+
+    // Route
+    RouteResult result;
+    answer_route_query(*graph, service.table, service.hierarchy, service.strategy, arena.state, arena.backward_state, arena.path, RouteQuery{nodes[0], nodes[1]}, result);
+
+    // Write the Route
+    body.append("{\"from\":");
+    body.append_json_string(names[0]);
+    body.append(",\"to\":");
+    body.append_json_string(names[1]);
+    body.append(",\"length_ft\":");
+    if (result.num_path_nodes > 0)
+    {
+        body.append_number(result.length * service.feet_per_pixel, 1);
+    }
+    else
+    {
+        body.append("null");
+    }
+    body.append(",\"nodes_expanded\":");
+    body.append_number((size_t) result.nodes_expanded);
+    body.append(",\"path\":[");
+    for (size_t i = arena.path.size(); i-- > 0;)
+    {
+        body.append(i + 1 == arena.path.size() ? "[" : ",[");
+        body.append_number(service.graph.x[arena.path[i]], 1);
+        body.append(",");
+        body.append_number(service.graph.y[arena.path[i]], 1);
+        body.append("]");
+    }
+    body.append("]}");
+    return finish_http_response(body, 200, keep_alive);
+}
+
+/**
+ * A client connection and the bytes received on it not yet answered
+ */
+struct ServerConnection
+{
+    int socket = -1;
+    std::vector<char> received = std::vector<char>(HTTP_HEADER_BUFFER_SIZE);
+    size_t filled = 0;
+    bool open = true;
+    std::chrono::steady_clock::time_point last_active;
+};
+
+/**
+ * Reads what has arrived on a connection and answers every whole request in it
+ * Helper for run_route_server()
+ * @param service
+ * @param arena
+ * @param connection marked closed if the client hung up or asked to close
+ */
+inline void serve_route_connection(const RouteService& service, RouteArena& arena, ServerConnection& connection)
+{
+    ssize_t received = recv(connection.socket, connection.received.data() + connection.filled, connection.received.size() - connection.filled, MSG_DONTWAIT);
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+        connection.open = false;
+        return;
+    }
+    connection.filled += std::max<ssize_t>(received, 0);
+
+    // Answer, Then Keep Whatever Was Pipelined After the Request
+    while (connection.open)
+    {
+        size_t header_size = http_header_size(connection.received.data(), connection.filled);
+        bool keep_alive = false;
+        std::string_view response;
+        if (header_size > 0)
+        {
+            response = answer_route_request(service, arena, std::string_view(connection.received.data(), header_size), keep_alive);
+        }
+        else if (connection.filled == connection.received.size())
+        {
+            HttpWriter body(arena.response.data() + HTTP_RESPONSE_HEADER_SPACE, arena.response.size() - HTTP_RESPONSE_HEADER_SPACE);
+            body.append("{\"error\":\"request too large\"}");
+            response = finish_http_response(body, 431, keep_alive);
+        }
+        else
+        {
+            break;
+        }
+
+        connection.open = send_all(connection.socket, response.data(), response.size()) && keep_alive;
+        arena.requests_served++;
+        std::memmove(connection.received.data(), connection.received.data() + header_size, connection.filled - header_size);
+        connection.filled -= header_size;
+    }
+    connection.last_active = std::chrono::steady_clock::now();
+}
+
+/**
+ * Serves routes over HTTP on 127.0.0.1 until stopping is set
+ * The calling thread polls the listening socket and every idle connection,
+ * and hands connections with data waiting to a fixed pool of workers.
+ * A worker answers the requests that have arrived with its own RouteArena
+ * and gives the connection back, so any number of keep-alive clients share
+ * the pool. The graph, route table and hierarchy are only read, so workers
+ * never lock or copy them
+ * @param service
+ * @param port
+ * @param num_threads number of workers, 0 for one per core
+ * @param stopping set (e.g. by a signal handler) to stop serving
+ * @param requests_served set to the number of requests answered
+ * @return boolean whether the port could be listened on
+ */
+inline bool run_route_server(
+    const RouteService& service,
+    uint16_t port,
+    unsigned num_threads,
+    const std::atomic<bool>& stopping,
+    size_t& requests_served
+)
+{
+    typedef std::chrono::steady_clock Clock;
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int wake_pipe[2];
+    if (listener < 0 || pipe(wake_pipe) < 0)
+    {
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, (sockaddr*) &address, sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0)
+    {
+        close(listener);
+        close(wake_pipe[0]);
+        close(wake_pipe[1]);
+        return false;
+    }
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(wake_pipe[0], F_SETFL, fcntl(wake_pipe[0], F_GETFL, 0) | O_NONBLOCK);
+
+    // Every Worker's Memory Is Set Up Before the First Request
+    num_threads = worker_thread_count(num_threads);
+    std::vector<RouteArena> arenas;
+    arenas.reserve(num_threads);
+    for (unsigned i = 0; i < num_threads; i++)
+    {
+        arenas.emplace_back(service.graph);
+    }
+
+    // Connections Pass Between the Poller and the Workers
+    std::mutex mutex;
+    std::condition_variable wake_worker;
+    std::vector<ServerConnection*> ready; // data waiting, for a worker to answer
+    std::vector<ServerConnection*> returned; // answered, for the poller to watch again
+    bool shutting_down = false;
+    std::vector<std::thread> workers;
+    for (unsigned thread_id = 0; thread_id < num_threads; thread_id++)
+    {
+        workers.emplace_back([&, thread_id]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                wake_worker.wait(lock, [&]() { return shutting_down || !ready.empty(); });
+                if (shutting_down)
+                {
+                    return;
+                }
+                ServerConnection* connection = ready.back();
+                ready.pop_back();
+                lock.unlock();
+
+                serve_route_connection(service, arenas[thread_id], *connection);
+
+                lock.lock();
+                returned.push_back(connection);
+                char wake = 0;
+                (void) !write(wake_pipe[1], &wake, 1);
+            }
+        });
+    }
+
+    // Poll the Listener and Idle Connections
+    std::vector<std::unique_ptr<ServerConnection>> connections; // every open connection
+    std::vector<ServerConnection*> idle;
+    std::vector<pollfd> waiting;
+    while (!stopping)
+    {
+        Clock::time_point now = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            idle.insert(idle.end(), returned.begin(), returned.end());
+            returned.clear();
+        }
+
+        // Drop Closed Connections and Ones Quiet for Too Long
+        for (size_t i = 0; i < idle.size();)
+        {
+            if (!idle[i]->open || now - idle[i]->last_active > std::chrono::milliseconds(SERVER_IDLE_MILLISECONDS))
+            {
+                close(idle[i]->socket);
+                idle[i]->socket = -1;
+                idle[i] = idle.back();
+                idle.pop_back();
+            }
+            else
+            {
+                i++;
+            }
+        }
+        connections.erase(std::remove_if(connections.begin(), connections.end(), [](const std::unique_ptr<ServerConnection>& connection) {
+            return connection->socket < 0;
+        }), connections.end());
+
+        waiting.clear();
+        waiting.push_back(pollfd{listener, POLLIN, 0});
+        waiting.push_back(pollfd{wake_pipe[0], POLLIN, 0});
+        for (ServerConnection* connection : idle)
+        {
+            waiting.push_back(pollfd{connection->socket, POLLIN, 0});
+        }
+        if (poll(waiting.data(), waiting.size(), SERVER_POLL_MILLISECONDS) <= 0)
+        {
+            continue;
+        }
+        char drained[64];
+        while (read(wake_pipe[0], drained, sizeof(drained)) > 0) {}
+
+        // Hand Connections With Data Waiting to the Workers
+        size_t num_ready = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = waiting.size(); i-- > 2;)
+            {
+                if (waiting[i].revents != 0)
+                {
+                    ready.push_back(idle[i - 2]);
+                    idle[i - 2] = idle.back();
+                    idle.pop_back();
+                    num_ready++;
+                }
+            }
+        }
+        if (num_ready > 0)
+        {
+            wake_worker.notify_all();
+        }
+
+        // Take New Connections
+        int socket;
+        while ((waiting[0].revents & POLLIN) && (socket = accept(listener, nullptr, nullptr)) >= 0)
+        {
+            int no_delay = 1;
+            setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+            connections.push_back(std::make_unique<ServerConnection>());
+            connections.back()->socket = socket;
+            connections.back()->last_active = now;
+            idle.push_back(connections.back().get());
+        }
+    }
+
+    // Let Workers Finish What They Hold, Then Close Everything
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shutting_down = true;
+    }
+    wake_worker.notify_all();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    for (const std::unique_ptr<ServerConnection>& connection : connections)
+    {
+        if (connection->socket >= 0)
+        {
+            close(connection->socket);
+        }
+    }
+    close(listener);
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+
+    requests_served = 0;
+    for (const RouteArena& arena : arenas)
+    {
+        requests_served += arena.requests_served;
+    }
+    return true;
+}
@@ -0,0 +1,355 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "map_cache.hpp"
+#include "map_graph.hpp"
+#include "parallel.hpp"
+#include "path_search.hpp"
+#include "profiling.hpp"
+
+/**
+ * Route table file format
+ * A fixed header followed by 8-byte aligned sections holding the arrays of a
+ * RouteTable, used in place once mapped, like a compiled map. The table is
+ * tied to the exact graph it was computed on through checksum_graph()
+ */
+const char ROUTE_TABLE_MAGIC[8] = {'M', 'M', 'A', 'P', 'S', 'R', 'T', 'E'};
+const uint32_t ROUTE_TABLE_VERSION = 1;
+
+/**
+ * Placeholder for "not a place" in RouteTable::place_of
+ */
+const uint32_t NO_PLACE = UINT32_MAX;
+
+/**
+ * Number of sources a route table worker claims at a time
+ */
+const size_t ROUTE_TABLE_SOURCES_PER_CLAIM = 1;
+
+struct RouteTableHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t graph_checksum; // checksum_graph() of the graph this was computed on
+    uint64_t file_size;
+
+    uint32_t num_nodes;
+    uint32_t num_places;
+
+    // Byte Offsets of Sections From the Start of the File
+    uint64_t places_section;
+    uint64_t distances_section;
+    uint64_t previous_section;
+};
+
+/**
+ * Hashes the adjacency of a graph with checksum_bytes()
+ * Two graphs with the same checksum route identically
+ * @param graph
+ * @return hash
+ */
+inline uint64_t checksum_graph(const MapGraph& graph)
+{
+    uint64_t checksum = checksum_bytes((const char*) graph.offsets.begin(), graph.offsets.size() * sizeof(uint32_t));
+    checksum = checksum_bytes((const char*) graph.targets.begin(), graph.targets.size() * sizeof(NodeId), checksum);
+    return checksum_bytes((const char*) graph.weights.begin(), graph.weights.size() * sizeof(float), checksum);
+}
+
+/**
+ * Precomputed shortest paths between every pair of named nodes ("places")
+ * Holds the distance between every pair of places, and for every place the
+ * tree of shortest paths out of it (the node before each node on its path),
+ * so a place-to-place route is read off by walking back along it instead of
+ * searching.
+ * Both come from a full Dijkstra search out of each place, so lengths and
+ * paths are exactly the ones find_path_dijkstra() gives
+ * The arrays are either computed in memory or point into a mapped file
+ */
+struct RouteTable
+{
+    ArrayView<NodeId> places; // every named node, in increasing order
+    ArrayView<double> distances; // distances[i * places.size() + j] is from place i to place j
+    ArrayView<NodeId> previous; // previous[i * num_nodes + node] is the node before node on the path from place i
+    size_t num_nodes = 0;
+    std::vector<uint32_t> place_of; // index of each node in places, NO_PLACE for unnamed nodes
+
+    // Arrays Behind the Views
+    std::vector<NodeId> place_storage;
+    std::vector<double> distance_storage;
+    std::vector<NodeId> previous_storage;
+    MappedFile file;
+
+    bool empty() const
+    {
+        return places.size() == 0;
+    }
+
+    /**
+     * @param start_node
+     * @param end_node
+     * @return boolean whether the table holds the route between these nodes
+     */
+    bool has_route(NodeId start_node, NodeId end_node) const
+    {
+        return start_node < place_of.size() && end_node < place_of.size()
+            && place_of[start_node] != NO_PLACE && place_of[end_node] != NO_PLACE;
+    }
+
+    /**
+     * @param start_node place
+     * @param end_node place
+     * @return shortest distance, UNREACHED_COST if there is no path
+     */
+    double distance(NodeId start_node, NodeId end_node) const
+    {
+        return distances[(size_t) place_of[start_node] * places.size() + place_of[end_node]];
+    }
+
+    /**
+     * @param start_node place
+     * @param node
+     * @return node before node on the path from start_node, NO_NODE at start_node or if unreachable
+     */
+    NodeId previous_node(NodeId start_node, NodeId node) const
+    {
+        return previous[(size_t) place_of[start_node] * num_nodes + node];
+    }
+
+    /**
+     * Maps a route table file and checks that it belongs to a graph
+     * @param path
+     * @param graph
+     * @return boolean whether the file exists, is intact, and was computed on this graph
+     */
+    bool open(const std::string& path, const MapGraph& graph)
+    {
+        close();
+        if (!file.open(path))
+        {
+            return false;
+        }
+
+        // Check Header
+        RouteTableHeader header;
+        if (file.size() < sizeof(header))
+        {
+            close();
+            return false;
+        }
+        memcpy(&header, file.data(), sizeof(header));
+        if (
+                memcmp(header.magic, ROUTE_TABLE_MAGIC, sizeof(ROUTE_TABLE_MAGIC)) != 0 ||
+                header.version != ROUTE_TABLE_VERSION ||
+                header.header_size != sizeof(header) ||
+                header.file_size != file.size() ||
+                header.num_nodes != graph.node_count() ||
+                header.graph_checksum != checksum_graph(graph)
+           )
+        {
+            close();
+            return false;
+        }
+
+        // Check Every Section Fits in the File
+        uint64_t num_places = header.num_places;
+        bool fits =
+                fits_in_file(header.places_section, num_places, sizeof(NodeId)) &&
+                fits_in_file(header.distances_section, num_places * num_places, sizeof(double)) &&
+                fits_in_file(header.previous_section, num_places * header.num_nodes, sizeof(NodeId));
+        if (!fits)
+        {
+            close();
+            return false;
+        }
+
+        // Point Table Into File
+        places = ArrayView<NodeId>((const NodeId*) (file.data() + header.places_section), num_places);
+        distances = ArrayView<double>((const double*) (file.data() + header.distances_section), num_places * num_places);
+        previous = ArrayView<NodeId>((const NodeId*) (file.data() + header.previous_section), num_places * header.num_nodes);
+        num_nodes = header.num_nodes;
+        if (!index_places())
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        file.close();
+        place_storage.clear();
+        distance_storage.clear();
+        previous_storage.clear();
+        places = ArrayView<NodeId>();
+        distances = ArrayView<double>();
+        previous = ArrayView<NodeId>();
+        num_nodes = 0;
+        place_of.clear();
+    }
+
+    /**
+     * Fills place_of from places
+     * @return boolean whether every place is a distinct node of the graph
+     */
+    bool index_places()
+    {
+        place_of.assign(num_nodes, NO_PLACE);
+        for (uint32_t i = 0; i < places.size(); i++)
+        {
+            if (places[i] >= num_nodes || place_of[places[i]] != NO_PLACE)
+            {
+                return false;
+            }
+            place_of[places[i]] = i;
+        }
+        return true;
+    }
+
+private:
+    bool fits_in_file(uint64_t offset, uint64_t count, uint64_t item_size) const
+    {
+        return offset % 8 == 0 && offset <= file.size() && count * item_size <= file.size() - offset;
+    }
+};
+
+/**
+ * Computes a route table by searching out of every place, across worker threads
+ * @param table replaced by the new table
+ * @param graph
+ * @param num_threads number of worker threads, 0 for one per core
+ */
+inline void build_route_table(RouteTable& table, const MapGraph& graph, unsigned num_threads)
+{
+    PROFILE_SCOPE(RouteTableBuild);
+    table.close();
+    for (NodeId node = 0; node < graph.node_count(); node++)
+    {
+        if (graph.is_named(node))
+        {
+            table.place_storage.push_back(node);
+        }
+    }
+    size_t num_places = table.place_storage.size();
+    size_t num_nodes = graph.node_count();
+    table.distance_storage.resize(num_places * num_places);
+    table.previous_storage.resize(num_places * num_nodes);
+
+    // One Full Search per Place, Each Writing Only Its Own Rows
+    std::vector<SearchState> states(parallel_for_threads(num_places, ROUTE_TABLE_SOURCES_PER_CLAIM, num_threads));
+    parallel_for(num_places, ROUTE_TABLE_SOURCES_PER_CLAIM, num_threads, [&](unsigned thread_id, size_t first, size_t last) {
+        SearchState& state = states[thread_id];
+        for (size_t source = first; source < last; source++)
+        {
+            find_path_dijkstra(graph, state, table.place_storage[source], NO_NODE);
+            for (size_t place = 0; place < num_places; place++)
+            {
+                table.distance_storage[source * num_places + place] = state.get_cost(table.place_storage[place]);
+            }
+            for (NodeId node = 0; node < num_nodes; node++)
+            {
+                table.previous_storage[source * num_nodes + node] = state.get_previous(node);
+            }
+        }
+    });
+
+    table.places = table.place_storage;
+    table.distances = table.distance_storage;
+    table.previous = table.previous_storage;
+    table.num_nodes = num_nodes;
+    table.index_places();
+}
+
+/**
+ * Writes a route table file
+ * Written next to its final path and renamed over it, like write_map_cache()
+ * @param path
+ * @param table
+ * @param graph graph the table was computed on
+ * @return boolean whether the file was written
+ */
+inline bool write_route_table(const std::string& path, const RouteTable& table, const MapGraph& graph)
+{
+    std::string temporary_path = path + ".tmp";
+    std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        return false;
+    }
+
+    // Reserve Header Space
+    RouteTableHeader header;
+    memset(&header, 0, sizeof(header));
+    out.write((const char*) &header, sizeof(header));
+
+    // Sections
+    header.places_section = write_map_cache_section(out, table.places.begin(), table.places.size() * sizeof(NodeId));
+    header.distances_section = write_map_cache_section(out, table.distances.begin(), table.distances.size() * sizeof(double));
+    header.previous_section = write_map_cache_section(out, table.previous.begin(), table.previous.size() * sizeof(NodeId));
+
+    // Fill In Header
+    memcpy(header.magic, ROUTE_TABLE_MAGIC, sizeof(ROUTE_TABLE_MAGIC));
+    header.version = ROUTE_TABLE_VERSION;
+    header.header_size = sizeof(header);
+    header.graph_checksum = checksum_graph(graph);
+    header.file_size = out.tellp();
+    header.num_nodes = table.num_nodes;
+    header.num_places = table.places.size();
+    out.seekp(0);
+    out.write((const char*) &header, sizeof(header));
+    out.close();
+    if (!out)
+    {
+        std::remove(temporary_path.c_str());
+        return false;
+    }
+
+    // Replace Old File
+#ifdef _WIN32
+    std::remove(path.c_str());
+#endif
+    return std::rename(temporary_path.c_str(), path.c_str()) == 0;
+}
+
+/**
+ * Reads a place-to-place route out of the table into a search state
+ * The state ends up as find_path_dijkstra() would leave it along the path:
+ * every path node visited, with its previous node and cost from the start
+ * @param table
+ * @param graph
+ * @param state
+ * @param start_node place
+ * @param end_node place
+ */
+inline void find_path_in_table(
+    const RouteTable& table,
+    const MapGraph& graph,
+    SearchState& state,
+    NodeId start_node,
+    NodeId end_node
+)
+{
+    state.reset(graph.node_count());
+    if (table.distance(start_node, end_node) >= UNREACHED_COST)
+    {
+        state.set(start_node, 0, NO_NODE);
+        state.visit(start_node);
+        return;
+    }
+
+    // Collect Path Back to Front
+    thread_local std::vector<NodeId> path;
+    path.clear();
+    for (NodeId node = end_node; node != NO_NODE; node = table.previous_node(start_node, node))
+    {
+        path.push_back(node);
+    }
+    set_path(graph, state, path);
+}
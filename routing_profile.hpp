@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include "map_graph.hpp"
+
+/**
+ * Weight of an edge a profile may not use; searches never relax it
+ */
+const float CLOSED_EDGE_WEIGHT = std::numeric_limits<float>::infinity();
+
+/**
+ * How many times its length an outdoor edge costs the indoor profile
+ */
+const float OUTDOOR_COST_FACTOR = 2.0f;
+
+/**
+ * Ways of weighing edges to choose from
+ */
+enum class RoutingProfile
+{
+    Shortest,
+    Accessible,
+    Indoor,
+    Night
+};
+
+const size_t NUM_ROUTING_PROFILES = 4;
+
+/**
+ * @param profile
+ * @return name of the profile as used on the command line
+ */
+inline const char* routing_profile_name(RoutingProfile profile)
+{
+    switch (profile)
+    {
+        case RoutingProfile::Accessible:
+            return "accessible";
+        case RoutingProfile::Indoor:
+            return "indoor";
+        case RoutingProfile::Night:
+            return "night";
+        default:
+            return "shortest";
+    }
+}
+
+/**
+ * Looks up a profile by the name routing_profile_name() gives it
+ * @param name
+ * @param profile set to the profile if the name is known
+ * @return boolean whether the name is known
+ */
+inline bool parse_routing_profile(std::string_view name, RoutingProfile& profile)
+{
+    for (size_t i = 0; i < NUM_ROUTING_PROFILES; i++)
+    {
+        if (name == routing_profile_name((RoutingProfile) i))
+        {
+            profile = (RoutingProfile) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Cost functions of the routing profiles, each a type so the loop in
+ * fill_profile_weights() is compiled once per profile with its cost inlined
+ */
+struct ShortestCost
+{
+    static float cost(float length, EdgeFlags)
+    {
+        return length;
+    }
+};
+
+struct AccessibleCost
+{
+    static float cost(float length, EdgeFlags flags)
+    {
+        return flags & EDGE_STAIRS ? CLOSED_EDGE_WEIGHT : length;
+    }
+};
+
+struct IndoorCost
+{
+    static float cost(float length, EdgeFlags flags)
+    {
+        return flags & EDGE_OUTDOOR ? length * OUTDOOR_COST_FACTOR : length;
+    }
+};
+
+struct NightCost
+{
+    static float cost(float length, EdgeFlags flags)
+    {
+        return flags & EDGE_CLOSED_AT_NIGHT ? CLOSED_EDGE_WEIGHT : length;
+    }
+};
+
+/**
+ * Weighs one edge by a profile chosen at run time, for edges that are not
+ * stored in a graph and so have no profile weights worked out ahead
+ * @param profile
+ * @param length
+ * @param flags
+ * @return weight of the edge, CLOSED_EDGE_WEIGHT if the profile may not use it
+ */
+inline float routing_profile_cost(RoutingProfile profile, float length, EdgeFlags flags)
+{
+    switch (profile)
+    {
+        case RoutingProfile::Accessible:
+            return AccessibleCost::cost(length, flags);
+        case RoutingProfile::Indoor:
+            return IndoorCost::cost(length, flags);
+        case RoutingProfile::Night:
+            return NightCost::cost(length, flags);
+        default:
+            return ShortestCost::cost(length, flags);
+    }
+}
+
+/**
+ * Weighs every edge of a graph by one profile's cost function
+ * @param graph
+ * @param weights set to the weight of every edge, or emptied if every
+ *        weight is the edge's length so the graph's own lengths will do
+ */
+template <class Cost>
+void fill_profile_weights(const MapGraph& graph, std::vector<float>& weights)
+{
+    weights.resize(graph.edge_count());
+    bool changed = false;
+    for (size_t edge = 0; edge < graph.edge_count(); edge++)
+    {
+        weights[edge] = Cost::cost(graph.lengths[edge], graph.flags[edge]);
+        changed = changed || weights[edge] != graph.lengths[edge];
+    }
+    if (!changed)
+    {
+        weights.clear();
+    }
+}
+
+/**
+ * Edge weights of every routing profile for one graph
+ * They are worked out once whenever the graph is built or changed, so
+ * switching profiles between queries only points the weights of a graph
+ * view at another array; every search then runs on it as it is. Profiles
+ * that weigh every edge by its length (the shortest one, or any profile on
+ * a map with no areas flagging its edges) use the graph's own lengths
+ */
+struct ProfileWeights
+{
+    std::vector<float> weights[NUM_ROUTING_PROFILES]; // by profile, empty where the lengths serve
+
+    /**
+     * @param graph
+     */
+    void build(const MapGraph& graph)
+    {
+        fill_profile_weights<ShortestCost>(graph, weights[(size_t) RoutingProfile::Shortest]);
+        fill_profile_weights<AccessibleCost>(graph, weights[(size_t) RoutingProfile::Accessible]);
+        fill_profile_weights<IndoorCost>(graph, weights[(size_t) RoutingProfile::Indoor]);
+        fill_profile_weights<NightCost>(graph, weights[(size_t) RoutingProfile::Night]);
+    }
+
+    /**
+     * @param graph the graph these weights were built for
+     * @param profile
+     * @return the graph weighted by the profile, valid while both the graph and these weights are
+     */
+    MapGraph view(const MapGraph& graph, RoutingProfile profile) const
+    {
+        MapGraph weighted = graph;
+        if (!weights[(size_t) profile].empty())
+        {
+            weighted.weights = weights[(size_t) profile];
+        }
+        return weighted;
+    }
+};
+
+/**
+ * Flags every edge of a graph with the areas it crosses
+ * @param graph
+ * @param areas
+ */
+inline void flag_edges(MapGraphStorage& graph, const std::vector<MapArea>& areas)
+{
+    graph.flags.assign(graph.targets.size(), 0);
+    if (areas.empty())
+    {
+        return;
+    }
+    for (NodeId node = 0; node < graph.node_count(); node++)
+    {
+        for (uint32_t edge = graph.offsets[node]; edge < graph.offsets[node + 1]; edge++)
+        {
+            NodeId neighbor = graph.targets[edge];
+            graph.flags[edge] = crossed_area_flags(areas, graph.x[node], graph.y[node], graph.x[neighbor], graph.y[neighbor]);
+        }
+    }
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+#include "map_graph.hpp"
+#include "path_search.hpp"
+
+/**
+ * Shortest paths from a set of roots, as one Dijkstra search leaves them
+ * Edges are assumed to go both ways, as visibility edges do, so distances
+ * and next hops read the same towards the roots as away from them
+ */
+struct SearchTree
+{
+    std::vector<double> distance; // per node, length of the path from its root; UNREACHED_COST if not settled
+    std::vector<NodeId> next_hop; // per node, neighbor one step closer to its root; NO_NODE at roots
+    std::vector<NodeId> root; // per node, the root it is closest to; NO_NODE if not settled
+    std::vector<NodeId> settled; // settled nodes, nearest first
+};
+
+/**
+ * Uses Dijkstra's Algorithm seeded from every root at once
+ * With several roots (exits) this finds every node's nearest root in a
+ * single search; with one root (a gate) and some targets (classrooms) it
+ * stops as soon as every target is settled. Either way one search replaces
+ * a search per pair
+ * @param graph
+ * @param state search data, reset by this function
+ * @param roots nodes at distance 0
+ * @param targets nodes to stop after settling, or empty to settle every reachable node
+ * @param tree filled with the distance, next hop and root of every settled node
+ */
+inline void grow_search_tree(
+    const MapGraph& graph,
+    SearchState& state,
+    const std::vector<NodeId>& roots,
+    const std::vector<NodeId>& targets,
+    SearchTree& tree
+)
+{
+    state.reset(graph.node_count());
+    SearchQueue& queue = state.queue;
+    tree.distance.assign(graph.node_count(), UNREACHED_COST);
+    tree.next_hop.assign(graph.node_count(), NO_NODE);
+    tree.root.assign(graph.node_count(), NO_NODE);
+    tree.settled.clear();
+
+    // Mark Targets, Counting Each Once
+    std::vector<uint8_t> is_target(targets.empty() ? 0 : graph.node_count(), 0);
+    size_t targets_left = 0;
+    for (NodeId target : targets)
+    {
+        targets_left += !is_target[target];
+        is_target[target] = 1;
+    }
+
+    for (NodeId root : roots)
+    {
+        state.set(root, 0, NO_NODE);
+        queue.push(QueueEntry(0, root));
+        state.heap_pushes++;
+    }
+
+    // Loop Until Every Target is Settled or No Reachable Nodes Remain
+    while (!queue.empty())
+    {
+        NodeId current_node = queue.top().second;
+        queue.pop();
+        state.heap_pops++;
+        if (state.is_visited(current_node))
+        {
+            continue;
+        }
+        state.visit(current_node);
+        state.nodes_expanded++;
+
+        // A Node's Root is Its Previous Node's, Which Was Settled First
+        // Distances are lengths even when a routing profile weighs the search
+        NodeId previous = state.previous[current_node];
+        if (graph.weighs_lengths() || previous == NO_NODE)
+        {
+            tree.distance[current_node] = state.cost[current_node];
+        }
+        else
+        {
+            tree.distance[current_node] = tree.distance[previous] + edge_length(graph, previous, current_node);
+        }
+        tree.next_hop[current_node] = previous;
+        tree.root[current_node] = previous == NO_NODE ? current_node : tree.root[previous];
+        tree.settled.push_back(current_node);
+
+        if (!targets.empty() && is_target[current_node] && --targets_left == 0)
+        {
+            break;
+        }
+
+        // Update Paths to Unvisited Neighbors
+        double current_cost = state.cost[current_node];
+        for (uint32_t edge = graph.offsets[current_node]; edge < graph.offsets[current_node + 1]; edge++)
+        {
+            NodeId neighbor = graph.targets[edge];
+            if (state.is_visited(neighbor))
+            {
+                continue;
+            }
+
+            double distance_through = current_cost + graph.weights[edge];
+            if (distance_through < state.get_cost(neighbor))
+            {
+                state.set(neighbor, distance_through, current_node);
+                queue.push(QueueEntry(distance_through, neighbor));
+                state.edges_relaxed++;
+                state.heap_pushes++;
+            }
+        }
+    }
+    profile_search(state);
+}
+
+/**
+ * Writes a CSV field, quoted if it holds a comma, quote or line break
+ * @param out
+ * @param text
+ */
+inline void write_csv_field(std::ostream& out, std::string_view text)
+{
+    if (text.find_first_of(",\"\r\n") == std::string_view::npos)
+    {
+        out << text;
+        return;
+    }
+    out << '"';
+    for (char c : text)
+    {
+        if (c == '"')
+        {
+            out << '"';
+        }
+        out << c;
+    }
+    out << '"';
+}
+
+/**
+ * Writes every settled node of a search tree as CSV, nearest first
+ * Columns are the node id, its name (empty for unnamed nodes), position,
+ * distance in feet, next hop towards its root (empty at roots) and the
+ * root's id and name
+ * @param out
+ * @param graph
+ * @param tree
+ * @param feet_per_pixel
+ */
+inline void write_search_tree_csv(std::ostream& out, const MapGraph& graph, const SearchTree& tree, double feet_per_pixel)
+{
+    out << "node,name,x,y,distance_ft,next_hop,root,root_name\n";
+    for (NodeId node : tree.settled)
+    {
+        char numbers[96];
+        out << node << ',';
+        write_csv_field(out, graph.is_named(node) ? graph.name(node) : std::string_view());
+        std::snprintf(numbers, sizeof(numbers), ",%g,%g,%.1f,", graph.x[node], graph.y[node], tree.distance[node] * feet_per_pixel);
+        out << numbers;
+        if (tree.next_hop[node] != NO_NODE)
+        {
+            out << tree.next_hop[node];
+        }
+        out << ',' << tree.root[node] << ',';
+        write_csv_field(out, graph.is_named(tree.root[node]) ? graph.name(tree.root[node]) : std::string_view());
+        out << '\n';
+    }
+}
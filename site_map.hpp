@@ -0,0 +1,428 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "map_cache.hpp"
+#include "map_graph.hpp"
+#include "map_text.hpp"
+#include "path_search.hpp"
+#include "profiling.hpp"
+#include "route_batch.hpp"
+#include "routing_profile.hpp"
+#include "visibility_graph.hpp"
+#include "wall_index.hpp"
+
+/**
+ * Stand-in for "no floor"
+ */
+const uint32_t NO_FLOOR = UINT32_MAX;
+
+/**
+ * Node on one floor of a site
+ */
+struct SitePlace
+{
+    uint32_t floor = NO_FLOOR;
+    NodeId node = NO_NODE;
+
+    bool operator==(const SitePlace& other) const
+    {
+        return floor == other.floor && node == other.node;
+    }
+};
+
+/**
+ * One floor (or campus) of a site, with a map file of its own
+ * Nothing but the name and path is read until a query first needs the floor
+ */
+struct SiteFloor
+{
+    std::string name;
+    std::string map_path;
+    bool loaded = false; // load_site_floor() has run, whether or not the map could be read
+    bool usable = false; // the map was read and its graph is ready
+    MapGraph graph;
+    MapGraphStorage storage; // arrays behind graph when built from map text
+    MapCache cache; // arrays behind graph when loaded from a compiled map
+    std::unordered_map<std::string_view, NodeId> lookup; // named nodes
+    std::vector<std::pair<NodeId, uint32_t>> portal_ends; // (node, portal) for every portal end on this floor, sorted
+    std::vector<MapTextError> errors; // malformed lines of the map text
+};
+
+/**
+ * Link between named nodes on two floors: stairs, an elevator, or a path between campuses
+ * Portals can be taken both ways
+ */
+struct SitePortal
+{
+    uint32_t floors[2];
+    std::string names[2];
+    NodeId nodes[2] = {NO_NODE, NO_NODE}; // filled in as each floor loads, NO_NODE if it has no such name
+    double cost = 0; // in map units, like edge weights
+    size_t line = 0; // line of the site file, for reporting
+};
+
+/**
+ * Several maps joined by portals
+ * Floors are kept in a deque so a floor's graph stays put while others load
+ */
+struct SiteMap
+{
+    std::deque<SiteFloor> floors;
+    std::vector<SitePortal> portals;
+
+    /**
+     * @param name
+     * @return id of the floor with that name, NO_FLOOR if there is none
+     */
+    uint32_t find_floor(std::string_view name) const
+    {
+        for (uint32_t floor = 0; floor < floors.size(); floor++)
+        {
+            if (floors[floor].name == name)
+            {
+                return floor;
+            }
+        }
+        return NO_FLOOR;
+    }
+
+    size_t loaded_floor_count() const
+    {
+        return std::count_if(floors.begin(), floors.end(), [](const SiteFloor& floor) { return floor.usable; });
+    }
+};
+
+/**
+ * Reads a site file, which lists floors and the portals between them
+ * One item per line, fields separated by spaces:
+ *   f name map.txt                      floor, with its map relative to the site file
+ *   p floor1 node1 floor2 node2 cost    portal between two named nodes
+ *   # ...                               comment
+ * A portal's floors must be listed before it. Malformed lines are skipped
+ * and reported in errors
+ * @param site_file
+ * @param directory directory of the site file, with a trailing slash (or empty)
+ * @param site gets every floor and portal, none of them loaded
+ * @param errors gets a problem for every malformed line
+ */
+inline void read_site_text(std::istream& site_file, const std::string& directory, SiteMap& site, std::vector<MapTextError>& errors)
+{
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(site_file, line))
+    {
+        line_number++;
+        MapLineCursor cursor{line.data(), line.data(), line.data() + line.size()};
+        auto fail = [&](const char* message) {
+            errors.push_back(MapTextError{line_number, cursor.column(), message});
+        };
+
+        // Ignore Blank Lines and Comments
+        cursor.skip_spaces();
+        if (cursor.position == cursor.line_end || *cursor.position == '#')
+        {
+            continue;
+        }
+        const char* command_start = cursor.position;
+        std::string_view command = cursor.read_word();
+
+        if (command == "f") // Floor
+        {
+            cursor.skip_spaces();
+            const char* name_start = cursor.position;
+            std::string_view name = cursor.read_word();
+            std::string_view map_path = cursor.read_word();
+            if (map_path.empty())
+            {
+                fail("expected a floor name and map file");
+                continue;
+            }
+            if (site.find_floor(name) != NO_FLOOR)
+            {
+                cursor.position = name_start;
+                fail("floor listed twice");
+                continue;
+            }
+            SiteFloor& floor = site.floors.emplace_back();
+            floor.name = name;
+            floor.map_path = map_path[0] == '/' ? std::string(map_path) : directory + std::string(map_path);
+        }
+        else if (command == "p") // Portal
+        {
+            SitePortal portal;
+            portal.line = line_number;
+            bool known_floors = true;
+            for (int side = 0; side < 2 && known_floors; side++)
+            {
+                cursor.skip_spaces();
+                const char* floor_start = cursor.position;
+                portal.floors[side] = site.find_floor(cursor.read_word());
+                portal.names[side] = cursor.read_word();
+                if (portal.floors[side] == NO_FLOOR || portal.names[side].empty())
+                {
+                    cursor.position = floor_start;
+                    known_floors = false;
+                }
+            }
+            float cost;
+            if (!known_floors)
+            {
+                fail("expected a listed floor and a node name");
+                continue;
+            }
+            if (!cursor.read_number(cost) || cost < 0)
+            {
+                fail("expected a cost of 0 or more");
+                continue;
+            }
+            site.portals.push_back(portal);
+            site.portals.back().cost = cost;
+        }
+        else
+        {
+            cursor.position = command_start;
+            fail("unknown command");
+        }
+    }
+}
+
+/**
+ * Loads a floor the first time it is needed
+ * Uses the floor's compiled map if it matches the map text; otherwise
+ * parses the text, builds the visibility graph and saves the compiled map
+ * (as a single --map run would) so the next run can skip the build
+ * Then finds the floor's ends of every portal
+ * @param site
+ * @param floor_id
+ * @param num_threads threads for building the visibility graph, 0 for one per core
+ * @return boolean whether the floor is usable
+ */
+inline bool load_site_floor(SiteMap& site, uint32_t floor_id, unsigned num_threads)
+{
+    SiteFloor& floor = site.floors[floor_id];
+    if (floor.loaded)
+    {
+        return floor.usable;
+    }
+    floor.loaded = true;
+
+    uint64_t checksum;
+    if (!checksum_file(floor.map_path, checksum))
+    {
+        return false;
+    }
+    std::string cache_path = floor.map_path + ".bin";
+    if (floor.cache.open(cache_path, checksum))
+    {
+        floor.graph = floor.cache.graph;
+    }
+    else
+    {
+        // Build From Map Text
+        std::vector<Wall> walls;
+        std::vector<MapArea> areas;
+        NodeId start_node = NO_NODE, end_node = NO_NODE;
+        {
+            PROFILE_SCOPE(MapParse);
+            std::ifstream map_file(floor.map_path, std::ios::binary);
+            read_map_text(map_file, walls, areas, floor.storage, start_node, end_node, floor.errors);
+        }
+        WallGrid wall_index;
+        wall_index.build(walls);
+        build_visibility_graph(floor.storage, wall_index, num_threads);
+        flag_edges(floor.storage, areas);
+        floor.graph = floor.storage.view();
+
+        // Failing to Save Only Costs the Next Run a Rebuild
+        write_map_cache(cache_path, floor.graph, walls, areas, start_node, end_node, checksum);
+    }
+
+    // Find This Floor's Portal Ends
+    floor.lookup = build_name_lookup(floor.graph);
+    for (uint32_t portal_id = 0; portal_id < site.portals.size(); portal_id++)
+    {
+        SitePortal& portal = site.portals[portal_id];
+        for (int side = 0; side < 2; side++)
+        {
+            auto node = floor.lookup.find(portal.names[side]);
+            if (portal.floors[side] == floor_id && node != floor.lookup.end())
+            {
+                portal.nodes[side] = node->second;
+                floor.portal_ends.emplace_back(node->second, portal_id);
+            }
+        }
+    }
+    std::sort(floor.portal_ends.begin(), floor.portal_ends.end());
+    floor.usable = true;
+    return true;
+}
+
+/**
+ * Portal a search has reached but not yet crossed
+ * Helper for find_site_route()
+ */
+struct SiteCrossing
+{
+    uint32_t portal;
+    int far_side;
+    SitePlace departure;
+};
+
+/**
+ * Search data of site routes, one per thread
+ */
+struct SiteSearch
+{
+    std::vector<SearchState> states; // one per floor
+    std::vector<uint8_t> touched; // floors reached by the current query
+    std::vector<SiteCrossing> crossings; // portals reached, in the order they were reached
+    std::vector<std::pair<SitePlace, SitePlace>> portal_arrivals; // (arrival, departure) of each portal taken, latest last
+};
+
+/**
+ * Route found across a site
+ */
+struct SiteRoute
+{
+    double length = UNREACHED_COST; // UNREACHED_COST if there is no route
+    std::vector<SitePlace> path; // start to end, empty if there is no route
+    uint32_t nodes_expanded = 0;
+};
+
+/**
+ * Uses Dijkstra's Algorithm to find the shortest route between nodes on any floors
+ * The search follows each floor's edges and every portal at the nodes it
+ * settles. Crossing a portal is queued like any other step, and the floor
+ * on its far side is only loaded once the crossing comes off the queue, so
+ * floors that are farther away than the end are never loaded
+ * @param site start and end floors must be loaded
+ * @param search search data, reset by this function
+ * @param start
+ * @param end
+ * @param num_threads threads for building floors loaded along the way
+ * @param route filled with the route
+ */
+inline void find_site_route(SiteMap& site, SiteSearch& search, SitePlace start, SitePlace end, unsigned num_threads, SiteRoute& route)
+{
+    route = SiteRoute();
+    search.states.resize(site.floors.size());
+    search.touched.assign(site.floors.size(), 0);
+    search.crossings.clear();
+    search.portal_arrivals.clear();
+    auto state_of = [&](uint32_t floor) -> SearchState& {
+        if (!search.touched[floor])
+        {
+            search.states[floor].reset(site.floors[floor].graph.node_count());
+            search.touched[floor] = 1;
+        }
+        return search.states[floor];
+    };
+
+    typedef std::tuple<double, uint32_t, NodeId, uint32_t> SiteQueueEntry; // cost, floor, node, crossing (or UINT32_MAX)
+    std::priority_queue<SiteQueueEntry, std::vector<SiteQueueEntry>, std::greater<SiteQueueEntry>> queue;
+    state_of(start.floor).set(start.node, 0, NO_NODE);
+    queue.push(SiteQueueEntry(0, start.floor, start.node, UINT32_MAX));
+
+    while (!queue.empty())
+    {
+        auto [current_cost, floor_id, current_node, crossing_id] = queue.top();
+        queue.pop();
+
+        // Cross a Portal, Loading the Floor Behind It
+        if (crossing_id != UINT32_MAX)
+        {
+            const SiteCrossing& crossing = search.crossings[crossing_id];
+            const SitePortal& portal = site.portals[crossing.portal];
+            if (!load_site_floor(site, floor_id, num_threads) || portal.nodes[crossing.far_side] == NO_NODE)
+            {
+                continue;
+            }
+            NodeId far_node = portal.nodes[crossing.far_side];
+            SearchState& far_state = state_of(floor_id);
+            if (current_cost < far_state.get_cost(far_node))
+            {
+                far_state.set(far_node, current_cost, NO_NODE);
+                search.portal_arrivals.emplace_back(SitePlace{floor_id, far_node}, crossing.departure);
+                queue.push(SiteQueueEntry(current_cost, floor_id, far_node, UINT32_MAX));
+            }
+            continue;
+        }
+
+        SearchState& state = search.states[floor_id];
+        if (state.is_visited(current_node))
+        {
+            continue;
+        }
+        state.visit(current_node);
+        route.nodes_expanded++;
+        if (floor_id == end.floor && current_node == end.node)
+        {
+            break;
+        }
+
+        // Edges Within the Floor
+        const SiteFloor& floor = site.floors[floor_id];
+        for (uint32_t edge = floor.graph.offsets[current_node]; edge < floor.graph.offsets[current_node + 1]; edge++)
+        {
+            NodeId neighbor = floor.graph.targets[edge];
+            double distance_through = current_cost + floor.graph.weights[edge];
+            if (distance_through < state.get_cost(neighbor))
+            {
+                state.set(neighbor, distance_through, current_node);
+                queue.push(SiteQueueEntry(distance_through, floor_id, neighbor, UINT32_MAX));
+            }
+        }
+
+        // Portals Leaving This Node
+        auto portal_end = std::lower_bound(floor.portal_ends.begin(), floor.portal_ends.end(), std::make_pair(current_node, (uint32_t) 0));
+        for (; portal_end != floor.portal_ends.end() && portal_end->first == current_node; ++portal_end)
+        {
+            const SitePortal& portal = site.portals[portal_end->second];
+            int far_side = portal.floors[0] == floor_id && portal.nodes[0] == current_node ? 1 : 0;
+            search.crossings.push_back(SiteCrossing{portal_end->second, far_side, SitePlace{floor_id, current_node}});
+            queue.push(SiteQueueEntry(current_cost + portal.cost, portal.floors[far_side], NO_NODE, search.crossings.size() - 1));
+        }
+    }
+    PROFILE_COUNT(NodesExpanded, route.nodes_expanded);
+
+    if (!search.touched[end.floor] || !search.states[end.floor].is_visited(end.node))
+    {
+        return;
+    }
+    route.length = search.states[end.floor].cost[end.node];
+
+    // Walk Back Along Previous Nodes, Crossing Portals Where a Floor's Walk Began
+    SitePlace place = end;
+    while (true)
+    {
+        route.path.push_back(place);
+        if (place == start)
+        {
+            break;
+        }
+        NodeId previous = search.states[place.floor].get_previous(place.node);
+        if (previous != NO_NODE)
+        {
+            place.node = previous;
+            continue;
+        }
+        auto arrival = std::find_if(search.portal_arrivals.rbegin(), search.portal_arrivals.rend(), [&](const std::pair<SitePlace, SitePlace>& entry) {
+            return entry.first == place;
+        });
+        place = arrival->second;
+    }
+    std::reverse(route.path.begin(), route.path.end());
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "map_graph.hpp"
+#include "parallel.hpp"
+#include "profiling.hpp"
+#include "wall_index.hpp"
+
+/**
+ * Number of rows a visibility worker claims at a time
+ * Small enough to balance rows of different lengths, large enough that the
+ * shared counter is rarely touched
+ */
+const uint32_t VISIBILITY_ROWS_PER_CLAIM = 16;
+
+/**
+ * Edges found by one visibility worker
+ * Row i lists the visible nodes j < i in increasing order; the rows a worker
+ * claimed are stored back to back
+ */
+struct VisibilityRows
+{
+    std::vector<NodeId> rows; // row id of every stored row
+    std::vector<uint32_t> row_ends; // end of every stored row in targets
+    std::vector<NodeId> targets;
+};
+
+/**
+ * Links every pair of nodes that can see each other and packs the edges into the graph
+ * The node pairs are split across worker threads and each worker keeps its
+ * own edge buffer; the buffers are merged by row afterwards, so the result
+ * (including neighbor order, which is always increasing by id) is the same
+ * for any thread count
+ * @param graph storage with node data set; adjacency is replaced
+ * @param walls index over every wall of the map
+ * @param num_threads number of worker threads, 0 for one per core
+ */
+inline void build_visibility_graph(MapGraphStorage& graph, const WallGrid& walls, unsigned num_threads)
+{
+    PROFILE_SCOPE(VisibilityBuild);
+    NodeId num_nodes = graph.node_count();
+
+    // Check Pairs Row by Row, Each Worker Claiming Rows as It Goes
+    std::vector<VisibilityRows> buffers(parallel_for_threads(num_nodes, VISIBILITY_ROWS_PER_CLAIM, num_threads));
+    parallel_for(num_nodes, VISIBILITY_ROWS_PER_CLAIM, num_threads, [&](unsigned thread_id, NodeId first, NodeId last) {
+        VisibilityRows& buffer = buffers[thread_id];
+        for (NodeId row = first; row < last; row++)
+        {
+            sf::Vector2f point(graph.x[row], graph.y[row]);
+            for (NodeId other = 0; other < row; other++)
+            {
+                if (!walls.is_obstructed(point, sf::Vector2f(graph.x[other], graph.y[other])))
+                {
+                    buffer.targets.push_back(other);
+                }
+            }
+            buffer.rows.push_back(row);
+            buffer.row_ends.push_back(buffer.targets.size());
+        }
+    });
+
+    // Find Each Row in the Worker Buffers
+    std::vector<const NodeId*> row_begin(num_nodes), row_end(num_nodes);
+    std::vector<uint32_t> degree(num_nodes, 0);
+    for (const VisibilityRows& buffer : buffers)
+    {
+        uint32_t begin = 0;
+        for (size_t i = 0; i < buffer.rows.size(); i++)
+        {
+            NodeId row = buffer.rows[i];
+            row_begin[row] = buffer.targets.data() + begin;
+            row_end[row] = buffer.targets.data() + buffer.row_ends[i];
+            degree[row] += buffer.row_ends[i] - begin;
+            for (uint32_t entry = begin; entry < buffer.row_ends[i]; entry++)
+            {
+                degree[buffer.targets[entry]]++;
+            }
+            begin = buffer.row_ends[i];
+        }
+    }
+
+    // Merge Rows in Order, Giving Every Node Its Lower Neighbors Then Its Higher Ones
+    graph.offsets.assign(num_nodes + 1, 0);
+    for (NodeId node = 0; node < num_nodes; node++)
+    {
+        graph.offsets[node + 1] = graph.offsets[node] + degree[node];
+    }
+    graph.targets.resize(graph.offsets[num_nodes]);
+    graph.weights.resize(graph.offsets[num_nodes]);
+    graph.flags.assign(graph.offsets[num_nodes], 0); // set from the map's areas afterwards
+    std::vector<uint32_t> fill(graph.offsets.begin(), graph.offsets.end() - 1);
+    for (NodeId row = 0; row < num_nodes; row++)
+    {
+        for (const NodeId* other = row_begin[row]; other != row_end[row]; ++other)
+        {
+            float weight = std::hypot(graph.x[*other] - graph.x[row], graph.y[*other] - graph.y[row]);
+            graph.targets[fill[row]] = *other;
+            graph.weights[fill[row]++] = weight;
+            graph.targets[fill[*other]] = row;
+            graph.weights[fill[*other]++] = weight;
+        }
+    }
+}
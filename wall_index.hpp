@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "geometry.hpp"
+#include "wall_kernel.hpp"
+
+/**
+ * Uniform grid over the walls of a map, used to find the walls near a segment
+ * Each cell lists every wall whose bounding box, grown by a small padding,
+ * touches the cell. A query walks the column strips the segment passes
+ * through and only looks at the rows it covers within each strip, so any
+ * wall sharing a point with the segment is always among the candidates and
+ * the final answer matches checking every wall with do_intersect()
+ * Each cell's walls are stored back to back as a struct of arrays, so
+ * any_wall_intersects() can test several at a time
+ */
+struct WallGrid
+{
+    double origin_x = 0;
+    double origin_y = 0;
+    double cell_size = 1;
+    double padding = 0;
+    int columns = 0;
+    int rows = 0;
+
+    // Walls per Cell (cell i holds entries cell_offsets[i] ... cell_offsets[i + 1] - 1,
+    // the last few of which may be NO_WALL with id UINT32_MAX)
+    std::vector<uint32_t> cell_offsets;
+    std::vector<uint32_t> cell_wall_ids;
+    WallArrays cell_walls;
+    size_t wall_count = 0;
+
+    /**
+     * Rebuilds the grid from scratch
+     * @param walls all walls of the map; ids in queries are indices into this list
+     */
+    void build(const std::vector<Wall>& walls)
+    {
+        wall_count = walls.size();
+        columns = rows = 0;
+        cell_offsets.clear();
+        cell_wall_ids.clear();
+        cell_walls.clear();
+        if (walls.empty())
+        {
+            return;
+        }
+
+        // Bounding Box of All Walls
+        double min_x = walls[0].a.x, max_x = min_x;
+        double min_y = walls[0].a.y, max_y = min_y;
+        for (const Wall& wall : walls)
+        {
+            min_x = std::min({min_x, (double) wall.a.x, (double) wall.b.x});
+            max_x = std::max({max_x, (double) wall.a.x, (double) wall.b.x});
+            min_y = std::min({min_y, (double) wall.a.y, (double) wall.b.y});
+            max_y = std::max({max_y, (double) wall.a.y, (double) wall.b.y});
+        }
+        double width = std::max(max_x - min_x, 1.0);
+        double height = std::max(max_y - min_y, 1.0);
+
+        // Size Cells for About Two Walls per Kernel Lane Each, With at Most 1024 Cells per Side
+        // (a whole kernel step costs about as much as testing a single wall)
+        cell_size = std::sqrt(width * height * WALL_KERNEL_WIDTH / (2.0 * walls.size()));
+        cell_size = std::max(cell_size, std::max(width, height) / 1024);
+        padding = cell_size * 1e-3;
+        origin_x = min_x - padding;
+        origin_y = min_y - padding;
+        columns = (int) ((width + 2 * padding) / cell_size) + 1;
+        rows = (int) ((height + 2 * padding) / cell_size) + 1;
+
+        // Count Walls per Cell, Rounded Up to Whole Kernel Steps
+        cell_offsets.assign((size_t) columns * rows + 1, 0);
+        for (const Wall& wall : walls)
+        {
+            for_each_cell_of(wall, [&](size_t cell) { cell_offsets[cell + 1]++; });
+        }
+        for (size_t cell = 0; cell < (size_t) columns * rows; cell++)
+        {
+            uint32_t count = cell_offsets[cell + 1];
+            count = (count + WALL_KERNEL_WIDTH - 1) / WALL_KERNEL_WIDTH * WALL_KERNEL_WIDTH;
+            cell_offsets[cell + 1] = cell_offsets[cell] + count;
+        }
+
+        // Fill Cells, Padding With NO_WALL
+        cell_wall_ids.assign(cell_offsets.back(), UINT32_MAX);
+        cell_walls.resize(cell_offsets.back());
+        for (size_t entry = 0; entry < cell_walls.size(); entry++)
+        {
+            cell_walls.set(entry, NO_WALL);
+        }
+        std::vector<uint32_t> fill(cell_offsets.begin(), cell_offsets.end() - 1);
+        for (uint32_t id = 0; id < walls.size(); id++)
+        {
+            for_each_cell_of(walls[id], [&](size_t cell) {
+                cell_wall_ids[fill[cell]] = id;
+                cell_walls.set(fill[cell], walls[id]);
+                fill[cell]++;
+            });
+        }
+    }
+
+    /**
+     * Calls visit(first, last) for the entries of every cell segment ab passes
+     * through; entries first ... last - 1 of cell_walls hold the cell's walls
+     * A wall spanning several cells may be visited more than once
+     * @param a
+     * @param b
+     * @param visit callback returning true to stop the search
+     * @return boolean whether a callback stopped the search
+     */
+    template <class Visit>
+    bool for_each_candidate_cell(sf::Vector2f a, sf::Vector2f b, Visit visit) const
+    {
+        if (columns == 0)
+        {
+            return false;
+        }
+
+        // Sweep Left to Right in Double Precision
+        double x0 = a.x, y0 = a.y, x1 = b.x, y1 = b.y;
+        if (x1 < x0)
+        {
+            std::swap(x0, x1);
+            std::swap(y0, y1);
+        }
+        double slope = x1 > x0 ? (y1 - y0) / (x1 - x0) : 0;
+
+        int first_column = column_of(x0 - padding);
+        int last_column = column_of(x1 + padding);
+        for (int column = first_column; column <= last_column; column++)
+        {
+            // Part of the Segment Inside This Column
+            double strip_start = std::clamp(origin_x + column * cell_size, x0, x1);
+            double strip_end = std::clamp(origin_x + (column + 1) * cell_size, x0, x1);
+            double y_start = strip_start == x0 ? y0 : y0 + slope * (strip_start - x0);
+            double y_end = strip_end == x1 ? y1 : y0 + slope * (strip_end - x0);
+            if (x1 == x0)
+            {
+                y_start = y0;
+                y_end = y1;
+            }
+
+            // Visit Every Cell of the Column the Segment Covers
+            int first_row = row_of(std::min(y_start, y_end) - padding);
+            int last_row = row_of(std::max(y_start, y_end) + padding);
+            for (int row = first_row; row <= last_row; row++)
+            {
+                size_t cell = (size_t) row * columns + column;
+                if (cell_offsets[cell] != cell_offsets[cell + 1] && visit(cell_offsets[cell], cell_offsets[cell + 1]))
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Checks whether any wall intersects segment ab
+     * Gives the same answer as crosses_any_wall() on the indexed walls
+     * @param a
+     * @param b
+     * @return boolean whether the segment is obstructed
+     */
+    bool is_obstructed(sf::Vector2f a, sf::Vector2f b) const
+    {
+        // Walls Spanning Several Cells are Retested; That Is Cheaper Than Branching on Marks
+        return for_each_candidate_cell(a, b, [&](uint32_t first, uint32_t last) {
+            return any_wall_intersects(a, b, cell_walls, first, last);
+        });
+    }
+
+private:
+    int column_of(double x) const
+    {
+        double column = std::floor((x - origin_x) / cell_size);
+        return (int) std::clamp(column, 0.0, columns - 1.0);
+    }
+
+    int row_of(double y) const
+    {
+        double row = std::floor((y - origin_y) / cell_size);
+        return (int) std::clamp(row, 0.0, rows - 1.0);
+    }
+
+    /**
+     * Calls visit(cell) for every cell touched by the padded bounding box of a wall
+     * @param wall
+     * @param visit
+     */
+    template <class Visit>
+    void for_each_cell_of(const Wall& wall, Visit visit) const
+    {
+        int first_column = column_of(std::min(wall.a.x, wall.b.x) - padding);
+        int last_column = column_of(std::max(wall.a.x, wall.b.x) + padding);
+        int first_row = row_of(std::min(wall.a.y, wall.b.y) - padding);
+        int last_row = row_of(std::max(wall.a.y, wall.b.y) + padding);
+        for (int row = first_row; row <= last_row; row++)
+        {
+            for (int column = first_column; column <= last_column; column++)
+            {
+                visit((size_t) row * columns + column);
+            }
+        }
+    }
+};
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+
+#include "geometry.hpp"
+#include "profiling.hpp"
+
+#if !defined(MISSIONMAPS_NO_SIMD) && defined(__AVX__)
+#include <immintrin.h>
+#define MISSIONMAPS_WALL_KERNEL_AVX
+#elif !defined(MISSIONMAPS_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define MISSIONMAPS_WALL_KERNEL_SSE
+#endif
+
+/**
+ * Number of walls any_wall_intersects() tests per step
+ * Build with -mavx2 (or -mavx) for 8, SSE2 (any x86-64) gives 4, and
+ * -DMISSIONMAPS_NO_SIMD falls back to 1
+ */
+#if defined(MISSIONMAPS_WALL_KERNEL_AVX)
+const size_t WALL_KERNEL_WIDTH = 8;
+#elif defined(MISSIONMAPS_WALL_KERNEL_SSE)
+const size_t WALL_KERNEL_WIDTH = 4;
+#else
+const size_t WALL_KERNEL_WIDTH = 1;
+#endif
+
+/**
+ * Stand-in for a missing wall, used to fill runs of walls up to a multiple of
+ * WALL_KERNEL_WIDTH: every comparison with NaN is false, so it never
+ * intersects anything, in any_wall_intersects() or do_intersect()
+ */
+const Wall NO_WALL = {
+    sf::Vector2f(std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN()),
+    sf::Vector2f(std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN())
+};
+
+/**
+ * Walls stored as a struct of arrays, so several can be loaded at once
+ */
+struct WallArrays
+{
+    std::vector<float> ax;
+    std::vector<float> ay;
+    std::vector<float> bx;
+    std::vector<float> by;
+
+    size_t size() const
+    {
+        return ax.size();
+    }
+
+    void resize(size_t count)
+    {
+        ax.resize(count);
+        ay.resize(count);
+        bx.resize(count);
+        by.resize(count);
+    }
+
+    void clear()
+    {
+        resize(0);
+    }
+
+    void set(size_t i, const Wall& wall)
+    {
+        ax[i] = wall.a.x;
+        ay[i] = wall.a.y;
+        bx[i] = wall.b.x;
+        by[i] = wall.b.y;
+    }
+};
+
+/**
+ * @return name of the instruction set any_wall_intersects() was compiled for
+ */
+inline const char* wall_kernel_name()
+{
+#if defined(MISSIONMAPS_WALL_KERNEL_AVX)
+    return "avx";
+#elif defined(MISSIONMAPS_WALL_KERNEL_SSE)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+// Kernel Arithmetic Rounds Like do_intersect(), See geometry.hpp
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#if defined(MISSIONMAPS_WALL_KERNEL_AVX)
+
+/**
+ * Tests segment pq against 8 walls, with the same arithmetic as do_intersect()
+ * @return mask of the walls hit, one bit per wall
+ */
+inline int wall_kernel_step(
+    __m256 px, __m256 py, __m256 qx, __m256 qy, __m256 dx, __m256 dy,
+    __m256 min_x, __m256 max_x, __m256 min_y, __m256 max_y,
+    const float* ax, const float* ay, const float* bx, const float* by
+)
+{
+#ifdef __clang__
+#pragma clang fp contract(off)
+#endif
+    __m256 zero = _mm256_setzero_ps();
+    __m256 wax = _mm256_loadu_ps(ax), way = _mm256_loadu_ps(ay);
+    __m256 wbx = _mm256_loadu_ps(bx), wby = _mm256_loadu_ps(by);
+    __m256 wdx = _mm256_sub_ps(wbx, wax), wdy = _mm256_sub_ps(wby, way);
+
+    // Orientations, Split Into "Collinear" and "Clockwise" Masks
+    __m256 o1 = _mm256_sub_ps(_mm256_mul_ps(dy, _mm256_sub_ps(wax, qx)), _mm256_mul_ps(dx, _mm256_sub_ps(way, qy)));
+    __m256 o2 = _mm256_sub_ps(_mm256_mul_ps(dy, _mm256_sub_ps(wbx, qx)), _mm256_mul_ps(dx, _mm256_sub_ps(wby, qy)));
+    __m256 o3 = _mm256_sub_ps(_mm256_mul_ps(wdy, _mm256_sub_ps(px, wbx)), _mm256_mul_ps(wdx, _mm256_sub_ps(py, wby)));
+    __m256 o4 = _mm256_sub_ps(_mm256_mul_ps(wdy, _mm256_sub_ps(qx, wbx)), _mm256_mul_ps(wdx, _mm256_sub_ps(qy, wby)));
+    __m256 eq1 = _mm256_cmp_ps(o1, zero, _CMP_EQ_OQ), cw1 = _mm256_cmp_ps(o1, zero, _CMP_GT_OQ);
+    __m256 eq2 = _mm256_cmp_ps(o2, zero, _CMP_EQ_OQ), cw2 = _mm256_cmp_ps(o2, zero, _CMP_GT_OQ);
+    __m256 eq3 = _mm256_cmp_ps(o3, zero, _CMP_EQ_OQ), cw3 = _mm256_cmp_ps(o3, zero, _CMP_GT_OQ);
+    __m256 eq4 = _mm256_cmp_ps(o4, zero, _CMP_EQ_OQ), cw4 = _mm256_cmp_ps(o4, zero, _CMP_GT_OQ);
+
+    // General Case: o1 != o2 and o3 != o4
+    __m256 hit = _mm256_and_ps(
+        _mm256_or_ps(_mm256_xor_ps(eq1, eq2), _mm256_xor_ps(cw1, cw2)),
+        _mm256_or_ps(_mm256_xor_ps(eq3, eq4), _mm256_xor_ps(cw3, cw4))
+    );
+
+    // Special Cases: a Collinear End Lying on the Other Segment
+    auto on_query = [&](__m256 x, __m256 y) {
+        return _mm256_and_ps(
+            _mm256_and_ps(_mm256_cmp_ps(x, max_x, _CMP_LE_OQ), _mm256_cmp_ps(x, min_x, _CMP_GE_OQ)),
+            _mm256_and_ps(_mm256_cmp_ps(y, max_y, _CMP_LE_OQ), _mm256_cmp_ps(y, min_y, _CMP_GE_OQ))
+        );
+    };
+    __m256 wall_max_x = _mm256_max_ps(wax, wbx), wall_min_x = _mm256_min_ps(wax, wbx);
+    __m256 wall_max_y = _mm256_max_ps(way, wby), wall_min_y = _mm256_min_ps(way, wby);
+    auto on_wall = [&](__m256 x, __m256 y) {
+        return _mm256_and_ps(
+            _mm256_and_ps(_mm256_cmp_ps(x, wall_max_x, _CMP_LE_OQ), _mm256_cmp_ps(x, wall_min_x, _CMP_GE_OQ)),
+            _mm256_and_ps(_mm256_cmp_ps(y, wall_max_y, _CMP_LE_OQ), _mm256_cmp_ps(y, wall_min_y, _CMP_GE_OQ))
+        );
+    };
+    hit = _mm256_or_ps(hit, _mm256_and_ps(eq1, on_query(wax, way)));
+    hit = _mm256_or_ps(hit, _mm256_and_ps(eq2, on_query(wbx, wby)));
+    hit = _mm256_or_ps(hit, _mm256_and_ps(eq3, on_wall(px, py)));
+    hit = _mm256_or_ps(hit, _mm256_and_ps(eq4, on_wall(qx, qy)));
+    return _mm256_movemask_ps(hit);
+}
+
+#elif defined(MISSIONMAPS_WALL_KERNEL_SSE)
+
+/**
+ * Tests segment pq against 4 walls, with the same arithmetic as do_intersect()
+ * @return mask of the walls hit, one bit per wall
+ */
+inline int wall_kernel_step(
+    __m128 px, __m128 py, __m128 qx, __m128 qy, __m128 dx, __m128 dy,
+    __m128 min_x, __m128 max_x, __m128 min_y, __m128 max_y,
+    const float* ax, const float* ay, const float* bx, const float* by
+)
+{
+#ifdef __clang__
+#pragma clang fp contract(off)
+#endif
+    __m128 zero = _mm_setzero_ps();
+    __m128 wax = _mm_loadu_ps(ax), way = _mm_loadu_ps(ay);
+    __m128 wbx = _mm_loadu_ps(bx), wby = _mm_loadu_ps(by);
+    __m128 wdx = _mm_sub_ps(wbx, wax), wdy = _mm_sub_ps(wby, way);
+
+    // Orientations, Split Into "Collinear" and "Clockwise" Masks
+    __m128 o1 = _mm_sub_ps(_mm_mul_ps(dy, _mm_sub_ps(wax, qx)), _mm_mul_ps(dx, _mm_sub_ps(way, qy)));
+    __m128 o2 = _mm_sub_ps(_mm_mul_ps(dy, _mm_sub_ps(wbx, qx)), _mm_mul_ps(dx, _mm_sub_ps(wby, qy)));
+    __m128 o3 = _mm_sub_ps(_mm_mul_ps(wdy, _mm_sub_ps(px, wbx)), _mm_mul_ps(wdx, _mm_sub_ps(py, wby)));
+    __m128 o4 = _mm_sub_ps(_mm_mul_ps(wdy, _mm_sub_ps(qx, wbx)), _mm_mul_ps(wdx, _mm_sub_ps(qy, wby)));
+    __m128 eq1 = _mm_cmpeq_ps(o1, zero), cw1 = _mm_cmpgt_ps(o1, zero);
+    __m128 eq2 = _mm_cmpeq_ps(o2, zero), cw2 = _mm_cmpgt_ps(o2, zero);
+    __m128 eq3 = _mm_cmpeq_ps(o3, zero), cw3 = _mm_cmpgt_ps(o3, zero);
+    __m128 eq4 = _mm_cmpeq_ps(o4, zero), cw4 = _mm_cmpgt_ps(o4, zero);
+
+    // General Case: o1 != o2 and o3 != o4
+    __m128 hit = _mm_and_ps(
+        _mm_or_ps(_mm_xor_ps(eq1, eq2), _mm_xor_ps(cw1, cw2)),
+        _mm_or_ps(_mm_xor_ps(eq3, eq4), _mm_xor_ps(cw3, cw4))
+    );
+
+    // Special Cases: a Collinear End Lying on the Other Segment
+    auto on_query = [&](__m128 x, __m128 y) {
+        return _mm_and_ps(
+            _mm_and_ps(_mm_cmple_ps(x, max_x), _mm_cmpge_ps(x, min_x)),
+            _mm_and_ps(_mm_cmple_ps(y, max_y), _mm_cmpge_ps(y, min_y))
+        );
+    };
+    __m128 wall_max_x = _mm_max_ps(wax, wbx), wall_min_x = _mm_min_ps(wax, wbx);
+    __m128 wall_max_y = _mm_max_ps(way, wby), wall_min_y = _mm_min_ps(way, wby);
+    auto on_wall = [&](__m128 x, __m128 y) {
+        return _mm_and_ps(
+            _mm_and_ps(_mm_cmple_ps(x, wall_max_x), _mm_cmpge_ps(x, wall_min_x)),
+            _mm_and_ps(_mm_cmple_ps(y, wall_max_y), _mm_cmpge_ps(y, wall_min_y))
+        );
+    };
+    hit = _mm_or_ps(hit, _mm_and_ps(eq1, on_query(wax, way)));
+    hit = _mm_or_ps(hit, _mm_and_ps(eq2, on_query(wbx, wby)));
+    hit = _mm_or_ps(hit, _mm_and_ps(eq3, on_wall(px, py)));
+    hit = _mm_or_ps(hit, _mm_and_ps(eq4, on_wall(qx, qy)));
+    return _mm_movemask_ps(hit);
+}
+
+#endif
+
+/**
+ * Checks segment pq against a run of walls, several walls per step
+ * Gives exactly the answer do_intersect() gives for each wall: the
+ * orientations are computed with the same float operations in the same
+ * order (neither is allowed to fuse them into multiply-adds), and
+ * "collinear" and "clockwise" are kept as two masks so o1 != o2 compares
+ * the same three cases. Runs padded with NO_WALL to a multiple of
+ * WALL_KERNEL_WIDTH need no scalar steps; any walls left over are tested
+ * one at a time with do_intersect()
+ * @param p
+ * @param q
+ * @param walls
+ * @param first index of the first wall to test
+ * @param last index past the last wall to test
+ * @return boolean whether any of the walls intersects pq
+ */
+inline bool any_wall_intersects(sf::Vector2f p, sf::Vector2f q, const WallArrays& walls, size_t first, size_t last)
+{
+    size_t i = first;
+#if defined(MISSIONMAPS_WALL_KERNEL_AVX) || defined(MISSIONMAPS_WALL_KERNEL_SSE)
+#if defined(MISSIONMAPS_WALL_KERNEL_AVX)
+    auto broadcast = [](float value) { return _mm256_set1_ps(value); };
+#else
+    auto broadcast = [](float value) { return _mm_set1_ps(value); };
+#endif
+    if (last - first >= WALL_KERNEL_WIDTH)
+    {
+        // Everything About pq Is Loaded Once
+        auto px = broadcast(p.x), py = broadcast(p.y), qx = broadcast(q.x), qy = broadcast(q.y);
+        auto dx = broadcast(q.x - p.x), dy = broadcast(q.y - p.y);
+        auto min_x = broadcast(std::min(p.x, q.x)), max_x = broadcast(std::max(p.x, q.x));
+        auto min_y = broadcast(std::min(p.y, q.y)), max_y = broadcast(std::max(p.y, q.y));
+        for (; i + WALL_KERNEL_WIDTH <= last; i += WALL_KERNEL_WIDTH)
+        {
+            int hits = wall_kernel_step(
+                px, py, qx, qy, dx, dy, min_x, max_x, min_y, max_y,
+                walls.ax.data() + i, walls.ay.data() + i, walls.bx.data() + i, walls.by.data() + i
+            );
+            if (hits != 0)
+            {
+                PROFILE_COUNT(IntersectionTests, i + WALL_KERNEL_WIDTH - first);
+                return true;
+            }
+        }
+        PROFILE_COUNT(IntersectionTests, i - first);
+    }
+#endif
+
+    // Remaining Walls One by One
+    for (; i < last; i++)
+    {
+        if (do_intersect(p, q, sf::Vector2f(walls.ax[i], walls.ay[i]), sf::Vector2f(walls.bx[i], walls.by[i])))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#endif